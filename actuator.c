@@ -0,0 +1,390 @@
+/******************************************************************************
+* File Name:   actuator.c
+*
+* Description: This file contains the actuator task, which drives the servo.
+*              Move commands are posted to a one-entry mailbox and return at
+*              once, so the MQTT callback that receives them is never held
+*              up by the servo travel. For every new target the task plans a
+*              trapezoidal or S-curve motion profile within the configured
+*              speed and acceleration limits, one pulse width per PWM period.
+*              The PWM period interrupt applies the samples, so the servo
+*              moves on the hardware timing of its own signal whatever the
+*              load of the other tasks.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include "cyhal.h"
+#include "cybsp.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "cy_retarget_io.h"
+
+#include "actuator.h"
+#include "deferred_log.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Speed and acceleration limits in microseconds of pulse width. */
+#define SERVO_US_PER_DEGREE             ((float)SERVO_PULSE_RANGE_US / (float)SERVO_MAXIMUM_ROTATION_DEGREES)
+#define SERVO_MAX_VELOCITY_US_S         ((float)SERVO_MAX_VELOCITY_DEG_S * SERVO_US_PER_DEGREE)
+#define SERVO_MAX_ACCEL_US_S2           ((float)SERVO_MAX_ACCEL_DEG_S2 * SERVO_US_PER_DEGREE)
+
+/* Time spent accelerating to full speed, relative to a constant acceleration
+ * at the limit. The S-curve accelerates at the limit only halfway.
+ */
+#if (SERVO_MOTION_PROFILE == SERVO_PROFILE_S_CURVE)
+#define SERVO_RAMP_FACTOR               (1.5f)
+#else
+#define SERVO_RAMP_FACTOR               (1.0f)
+#endif
+
+/* Upper bound of the duration of a full-range move, and the number of PWM
+ * periods it spans. A move takes at most its travel at full speed plus
+ * SERVO_RAMP_FACTOR ramps to full speed.
+ */
+#define SERVO_FULL_MOVE_MS              ((((uint32_t)SERVO_MAXIMUM_ROTATION_DEGREES * 1000u) / SERVO_MAX_VELOCITY_DEG_S) + \
+                                         ((2u * SERVO_MAX_VELOCITY_DEG_S * 1000u) / SERVO_MAX_ACCEL_DEG_S2) + 1u)
+#define SERVO_PROFILE_MAX_POINTS        (((SERVO_FULL_MOVE_MS * 1000u) / SERVO_PULSE_PERIOD_US) + 2u)
+
+#define SERVO_PULSE_PERIOD_S            ((float)SERVO_PULSE_PERIOD_US / 1000000.0f)
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Pulse widths of a move, one per PWM period. */
+typedef struct
+{
+    uint16_t width_us[SERVO_PROFILE_MAX_POINTS];
+    uint32_t length;
+} servo_profile_t;
+
+/* FreeRTOS task handle for this task. */
+TaskHandle_t actuator_task_handle;
+
+/* Mailbox holding the newest servo target in degrees. */
+static QueueHandle_t actuator_q;
+
+/* PWM driving the servo. */
+static cyhal_pwm_t servo_pwm;
+
+/* Profiles of the current and the next move. The task only plans into the
+ * profile that the interrupt does not play, and switches profiles in a
+ * critical section.
+ */
+static servo_profile_t servo_profiles[2];
+static volatile uint32_t servo_active_profile;
+static volatile uint32_t servo_next_point;
+
+/* Pulse width applied last. */
+static volatile uint32_t servo_width_us = SERVO_MINIMUM_PULSE_WIDTH_US;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static uint32_t servo_pulse_width(int32_t degree);
+static uint32_t servo_plan(uint32_t start_us, uint32_t target_us, uint16_t *width_us);
+static float servo_ramp_distance(float t, float ramp_s, float velocity);
+static uint32_t square_root(uint64_t value);
+static void isr_servo_period(void *callback_arg, cyhal_pwm_event_t event);
+
+/******************************************************************************
+ * Function Name: actuator_task
+ ******************************************************************************
+ * Summary:
+ *  Task that sets up the servo PWM and plans a motion profile from the
+ *  current pulse width to every new target. The servo is assumed to rest at
+ *  0 degrees when the first target arrives; the PWM is only started then.
+ *  A target that arrives during a move starts a new move from the pulse
+ *  width reached so far.
+ *
+ * Parameters:
+ *  void *pvParameters : Task parameter defined during task creation (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void actuator_task(void *pvParameters)
+{
+    bool started = false;
+
+    (void) pvParameters;
+
+    if (CY_RSLT_SUCCESS != cyhal_pwm_init(&servo_pwm, SERVO_PWM_PIN, NULL))
+    {
+        printf("Servo PWM initialization failed!\n");
+        vTaskDelete(NULL);
+    }
+    cyhal_pwm_register_callback(&servo_pwm, isr_servo_period, NULL);
+
+    /* Created last, as actuator_move_servo() checks it. */
+    actuator_q = xQueueCreate(1, sizeof(int32_t));
+    if (actuator_q == NULL)
+    {
+        printf("Actuator queue creation failed!\n");
+        vTaskDelete(NULL);
+    }
+
+    while (true)
+    {
+        int32_t degree;
+        uint32_t next;
+        uint32_t length;
+        uint32_t state;
+
+        if (pdTRUE != xQueueReceive(actuator_q, &degree, portMAX_DELAY))
+        {
+            continue;
+        }
+
+        next = servo_active_profile ^ 1u;
+        length = servo_plan(servo_width_us, servo_pulse_width(degree), servo_profiles[next].width_us);
+
+        state = cyhal_system_critical_section_enter();
+        servo_profiles[next].length = length;
+        servo_next_point = 0;
+        servo_active_profile = next;
+        cyhal_system_critical_section_exit(state);
+
+        LOG_INFO("Actuator: moving servo to %d in %u periods\n", (int)degree, (unsigned int)length);
+
+        if (!started)
+        {
+            cyhal_pwm_set_period(&servo_pwm, SERVO_PULSE_PERIOD_US, servo_width_us);
+            cyhal_pwm_enable_event(&servo_pwm, CYHAL_PWM_IRQ_TERMINAL_COUNT, SERVO_PWM_INTR_PRIORITY, true);
+            cyhal_pwm_start(&servo_pwm);
+            started = true;
+        }
+    }
+}
+
+/******************************************************************************
+ * Function Name: actuator_move_servo
+ ******************************************************************************
+ * Summary:
+ *  Function that sets a new servo target. It never waits, so it can be
+ *  called from the MQTT callback; a target that was not reached yet is
+ *  replaced.
+ *
+ * Parameters:
+ *  int32_t degree : Target position, 0 to 'SERVO_MAXIMUM_ROTATION_DEGREES'
+ *
+ * Return:
+ *  bool : true if the target was accepted, false if it is out of range or
+ *         the actuator task is not running
+ *
+ ******************************************************************************/
+bool actuator_move_servo(int32_t degree)
+{
+    if ((actuator_q == NULL) || (degree < 0) || (degree > SERVO_MAXIMUM_ROTATION_DEGREES))
+    {
+        return false;
+    }
+
+    xQueueOverwrite(actuator_q, &degree);
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: servo_pulse_width
+ ******************************************************************************
+ * Summary:
+ *  Function that converts a servo position into a pulse width.
+ *
+ * Parameters:
+ *  int32_t degree : Position, 0 to 'SERVO_MAXIMUM_ROTATION_DEGREES'
+ *
+ * Return:
+ *  uint32_t : Pulse width in microseconds
+ *
+ ******************************************************************************/
+static uint32_t servo_pulse_width(int32_t degree)
+{
+    return SERVO_MINIMUM_PULSE_WIDTH_US +
+           (((uint32_t)degree * SERVO_PULSE_RANGE_US) / (uint32_t)SERVO_MAXIMUM_ROTATION_DEGREES);
+}
+
+/******************************************************************************
+ * Function Name: servo_plan
+ ******************************************************************************
+ * Summary:
+ *  Function that plans a move from rest to rest. The move ramps up to the
+ *  maximum speed, cruises and ramps down again; a move too short to reach
+ *  the maximum speed ramps straight from up to down at a lower peak speed.
+ *
+ * Parameters:
+ *  uint32_t start_us : Pulse width at the start of the move
+ *  uint32_t target_us : Pulse width at the end of the move
+ *  uint16_t *width_us : Pulse widths of the move, one per PWM period, of at
+ *                       least 'SERVO_PROFILE_MAX_POINTS' entries
+ *
+ * Return:
+ *  uint32_t : Number of pulse widths written, the last one being 'target_us'
+ *
+ ******************************************************************************/
+static uint32_t servo_plan(uint32_t start_us, uint32_t target_us, uint16_t *width_us)
+{
+    float distance = (target_us > start_us) ? (float)(target_us - start_us) : (float)(start_us - target_us);
+    float velocity = SERVO_MAX_VELOCITY_US_S;
+    float ramp_s = (SERVO_RAMP_FACTOR * SERVO_MAX_VELOCITY_US_S) / SERVO_MAX_ACCEL_US_S2;
+    float cruise_s = 0.0f;
+    float total_s;
+    uint32_t length;
+
+    if (target_us == start_us)
+    {
+        return 0;
+    }
+
+    /* The two ramps cover velocity * ramp_s together. */
+    if (distance > (velocity * ramp_s))
+    {
+        cruise_s = (distance - (velocity * ramp_s)) / velocity;
+    }
+    else
+    {
+        ramp_s = (float)square_root((uint64_t)((SERVO_RAMP_FACTOR * distance * 1.0e12f) / SERVO_MAX_ACCEL_US_S2)) / 1.0e6f;
+        velocity = distance / ramp_s;
+    }
+    total_s = (2.0f * ramp_s) + cruise_s;
+
+    length = (uint32_t)(total_s / SERVO_PULSE_PERIOD_S) + 1u;
+    if (length > SERVO_PROFILE_MAX_POINTS)
+    {
+        length = SERVO_PROFILE_MAX_POINTS;
+    }
+
+    for (uint32_t i = 0; i < (length - 1u); i++)
+    {
+        float t = (float)(i + 1u) * SERVO_PULSE_PERIOD_S;
+        float position;
+
+        if (t < ramp_s)
+        {
+            position = servo_ramp_distance(t, ramp_s, velocity);
+        }
+        else if (t < (ramp_s + cruise_s))
+        {
+            position = servo_ramp_distance(ramp_s, ramp_s, velocity) + (velocity * (t - ramp_s));
+        }
+        else if (t < total_s)
+        {
+            position = distance - servo_ramp_distance(total_s - t, ramp_s, velocity);
+        }
+        else
+        {
+            position = distance;
+        }
+
+        width_us[i] = (uint16_t)((target_us > start_us) ? (start_us + (uint32_t)(position + 0.5f))
+                                                         : (start_us - (uint32_t)(position + 0.5f)));
+    }
+    width_us[length - 1u] = (uint16_t)target_us;
+
+    return length;
+}
+
+/******************************************************************************
+ * Function Name: servo_ramp_distance
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the distance covered while ramping up from rest.
+ *  The trapezoidal profile accelerates evenly; the S-curve profile follows
+ *  the speed 3u^2 - 2u^3 of the relative ramp time u, so its acceleration
+ *  starts and ends at zero.
+ *
+ * Parameters:
+ *  float t : Time since the start of the ramp in seconds, up to 'ramp_s'
+ *  float ramp_s : Duration of the ramp in seconds
+ *  float velocity : Speed at the end of the ramp in microseconds per second
+ *
+ * Return:
+ *  float : Distance in microseconds of pulse width
+ *
+ ******************************************************************************/
+static float servo_ramp_distance(float t, float ramp_s, float velocity)
+{
+    float u = t / ramp_s;
+
+#if (SERVO_MOTION_PROFILE == SERVO_PROFILE_S_CURVE)
+    return velocity * ramp_s * u * u * u * (1.0f - (0.5f * u));
+#else
+    return 0.5f * velocity * ramp_s * u * u;
+#endif
+}
+
+/******************************************************************************
+ * Function Name: square_root
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the integer square root, rounded down.
+ *
+ * Parameters:
+ *  uint64_t value : Value
+ *
+ * Return:
+ *  uint32_t : Square root
+ *
+ ******************************************************************************/
+static uint32_t square_root(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ull << 62;
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0u)
+    {
+        if (value >= (root + bit))
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)root;
+}
+
+/******************************************************************************
+ * Function Name: isr_servo_period
+ ******************************************************************************
+ * Summary:
+ *  PWM terminal count interrupt, which applies the next pulse width of the
+ *  active profile for the period that just started.
+ *
+ * Parameters:
+ *  void *callback_arg : Callback argument (unused)
+ *  cyhal_pwm_event_t event : PWM event (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void isr_servo_period(void *callback_arg, cyhal_pwm_event_t event)
+{
+    const servo_profile_t *profile = &servo_profiles[servo_active_profile];
+    uint32_t point = servo_next_point;
+
+    (void) callback_arg;
+    (void) event;
+
+    if (point < profile->length)
+    {
+        servo_width_us = profile->width_us[point];
+        servo_next_point = point + 1u;
+        cyhal_pwm_set_period(&servo_pwm, SERVO_PULSE_PERIOD_US, servo_width_us);
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,65 @@
+/******************************************************************************
+* File Name:   actuator.h
+*
+* Description: This file is the public interface of actuator.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef ACTUATOR_H_
+#define ACTUATOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Task parameters for the actuator task. */
+#define ACTUATOR_TASK_PRIORITY              (3)
+#define ACTUATOR_TASK_STACK_SIZE            (1024 * 1)
+
+/* Servo PWM pin and signal: a pulse of SERVO_MINIMUM_PULSE_WIDTH_US to
+ * SERVO_MINIMUM_PULSE_WIDTH_US + SERVO_PULSE_RANGE_US every
+ * SERVO_PULSE_PERIOD_US for 0 to SERVO_MAXIMUM_ROTATION_DEGREES.
+ */
+#define SERVO_PWM_PIN                       (P6_2)
+#define SERVO_MAXIMUM_ROTATION_DEGREES      (270)
+#define SERVO_PULSE_RANGE_US                (2000u)
+#define SERVO_MINIMUM_PULSE_WIDTH_US        (500u)
+#define SERVO_PULSE_PERIOD_US               (20000u)
+
+/* Motion profiles of the servo moves. A trapezoidal profile ramps the
+ * speed up and down at the maximum acceleration; an S-curve profile also
+ * ramps the acceleration, so it starts and stops more softly and takes a
+ * little longer.
+ */
+#define SERVO_PROFILE_TRAPEZOIDAL           (0)
+#define SERVO_PROFILE_S_CURVE               (1)
+#define SERVO_MOTION_PROFILE                (SERVO_PROFILE_S_CURVE)
+
+/* Speed and acceleration limits of the servo moves. */
+#define SERVO_MAX_VELOCITY_DEG_S            (180u)
+#define SERVO_MAX_ACCEL_DEG_S2              (720u)
+
+/* Interrupt priority of the PWM period interrupt that applies the profile. */
+#define SERVO_PWM_INTR_PRIORITY             (5u)
+
+/*******************************************************************************
+* Extern Variables
+********************************************************************************/
+extern TaskHandle_t actuator_task_handle;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void actuator_task(void *pvParameters);
+bool actuator_move_servo(int32_t degree);
+
+#endif /* ACTUATOR_H_ */
+
+/* [] END OF FILE */
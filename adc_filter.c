@@ -0,0 +1,169 @@
+/******************************************************************************
+* File Name:   adc_filter.c
+*
+* Description: This file contains an oversample-and-decimate filter for the
+*              raw ADC samples. It implements a cascaded integrator-comb (CIC)
+*              decimator of configurable order; order 1 is a boxcar average.
+*              Samples are consumed a block at a time and the integrators run
+*              in modular arithmetic, so the per-sample cost is a few
+*              additions and only one shift is done per output sample.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <string.h>
+
+#include "adc_filter.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Upper bound for the filter gain in bits, so that a 12-bit sample scaled by
+ * the gain and the fractional bits still fits in a signed 64-bit word.
+ */
+#define ADC_FILTER_MAX_GAIN_SHIFT       (48u)
+
+/******************************************************************************
+ * Function Name: adc_filter_init
+ ******************************************************************************
+ * Summary:
+ *  Function that configures a filter channel for the given decimation factor
+ *  and CIC order and clears its state.
+ *
+ * Parameters:
+ *  adc_filter_t *filter : Filter channel to configure
+ *  uint32_t decimation : Number of input samples per output sample. Must be a
+ *                        power of two so the gain can be removed by a shift.
+ *  uint32_t order : CIC order, 1 to ADC_FILTER_MAX_ORDER
+ *
+ * Return:
+ *  bool : true if the configuration is supported, else false
+ *
+ ******************************************************************************/
+bool adc_filter_init(adc_filter_t *filter, uint32_t decimation, uint32_t order)
+{
+    uint32_t log2_decimation = 0;
+
+    if ((decimation == 0u) || ((decimation & (decimation - 1u)) != 0u) ||
+        (order == 0u) || (order > ADC_FILTER_MAX_ORDER))
+    {
+        return false;
+    }
+
+    while ((1lu << log2_decimation) < decimation)
+    {
+        log2_decimation++;
+    }
+
+    if ((order * log2_decimation) > ADC_FILTER_MAX_GAIN_SHIFT)
+    {
+        return false;
+    }
+
+    filter->order = order;
+    filter->decimation = decimation;
+    filter->gain_shift = order * log2_decimation;
+    adc_filter_reset(filter);
+
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: adc_filter_reset
+ ******************************************************************************
+ * Summary:
+ *  Function that clears the integrator and comb state of a filter channel
+ *  while keeping its configuration.
+ *
+ * Parameters:
+ *  adc_filter_t *filter : Filter channel to reset
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void adc_filter_reset(adc_filter_t *filter)
+{
+    filter->phase = 0;
+    memset(filter->integrator, 0, sizeof(filter->integrator));
+    memset(filter->comb_delay, 0, sizeof(filter->comb_delay));
+}
+
+/******************************************************************************
+ * Function Name: adc_filter_process
+ ******************************************************************************
+ * Summary:
+ *  Function that runs a block of raw samples through the filter. The samples
+ *  of one channel may be interleaved with other channels, in which case the
+ *  distance between two samples of this channel is given by 'stride'. The
+ *  filter state carries over between calls, so blocks do not need to be a
+ *  multiple of the decimation factor.
+ *
+ * Parameters:
+ *  adc_filter_t *filter : Filter channel
+ *  const int32_t *samples : First raw sample of this channel in the block
+ *  uint32_t count : Number of samples of this channel in the block
+ *  uint32_t stride : Distance in elements between consecutive samples
+ *  int32_t *output : Buffer receiving the decimated samples, in ADC counts
+ *                    scaled by 2^ADC_FILTER_FRAC_BITS
+ *  uint32_t output_max : Capacity of the output buffer
+ *
+ * Return:
+ *  uint32_t : Number of decimated samples written to 'output'
+ *
+ ******************************************************************************/
+uint32_t adc_filter_process(adc_filter_t *filter, const int32_t *samples,
+                            uint32_t count, uint32_t stride,
+                            int32_t *output, uint32_t output_max)
+{
+    uint32_t produced = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        /* Integrator section, running at the input rate. */
+        uint64_t value = (uint64_t)(int64_t)samples[i * stride];
+        for (uint32_t stage = 0; stage < filter->order; stage++)
+        {
+            filter->integrator[stage] += value;
+            value = filter->integrator[stage];
+        }
+
+        if (++filter->phase < filter->decimation)
+        {
+            continue;
+        }
+        filter->phase = 0;
+
+        /* Comb section, running at the decimated rate. */
+        for (uint32_t stage = 0; stage < filter->order; stage++)
+        {
+            uint64_t delayed = filter->comb_delay[stage];
+            filter->comb_delay[stage] = value;
+            value -= delayed;
+        }
+
+        if (produced < output_max)
+        {
+            int64_t scaled = (int64_t)value;
+
+            /* Remove the filter gain, keeping ADC_FILTER_FRAC_BITS of the
+             * extra resolution and rounding to nearest.
+             */
+            if (filter->gain_shift > ADC_FILTER_FRAC_BITS)
+            {
+                uint32_t shift = filter->gain_shift - ADC_FILTER_FRAC_BITS;
+                scaled = (scaled + (1ll << (shift - 1u))) >> shift;
+            }
+            else
+            {
+                scaled <<= (ADC_FILTER_FRAC_BITS - filter->gain_shift);
+            }
+            output[produced++] = (int32_t)scaled;
+        }
+    }
+
+    return produced;
+}
+
+/* [] END OF FILE */
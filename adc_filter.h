@@ -0,0 +1,55 @@
+/******************************************************************************
+* File Name:   adc_filter.h
+*
+* Description: This file is the public interface of adc_filter.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef ADC_FILTER_H_
+#define ADC_FILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Highest CIC order supported by the filter. Order 1 is a plain boxcar
+ * (integrate-and-dump) average.
+ */
+#define ADC_FILTER_MAX_ORDER            (3u)
+
+/* Number of fractional bits in the filter output. The output is expressed in
+ * ADC counts scaled by 2^ADC_FILTER_FRAC_BITS, which keeps the resolution
+ * gained by oversampling.
+ */
+#define ADC_FILTER_FRAC_BITS            (8u)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* State of one oversample-and-decimate (CIC) filter channel. */
+typedef struct
+{
+    uint32_t order;
+    uint32_t decimation;
+    uint32_t gain_shift;
+    uint32_t phase;
+    uint64_t integrator[ADC_FILTER_MAX_ORDER];
+    uint64_t comb_delay[ADC_FILTER_MAX_ORDER];
+} adc_filter_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+bool adc_filter_init(adc_filter_t *filter, uint32_t decimation, uint32_t order);
+void adc_filter_reset(adc_filter_t *filter);
+uint32_t adc_filter_process(adc_filter_t *filter, const int32_t *samples,
+                            uint32_t count, uint32_t stride,
+                            int32_t *output, uint32_t output_max);
+
+#endif /* ADC_FILTER_H_ */
+
+/* [] END OF FILE */
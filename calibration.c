@@ -0,0 +1,223 @@
+/******************************************************************************
+* File Name:   calibration.c
+*
+* Description: This file contains the fixed-point calibration engine that
+*              converts filtered ADC readings into physical values. Each
+*              channel is described by a piecewise-linear table that can be
+*              replaced at runtime. All arithmetic is done on integers, so the
+*              conversion does not depend on the FPU or the soft-float library.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <string.h>
+
+#include "calibration.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Largest shift applied to a segment slope. */
+#define CALIBRATION_MAX_SLOPE_SHIFT     (30u)
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static uint32_t find_segment(const calibration_table_t *table, int32_t raw, uint32_t hint);
+static int32_t convert_segment(const calibration_table_t *table, uint32_t segment, int32_t raw);
+
+/******************************************************************************
+ * Function Name: calibration_load
+ ******************************************************************************
+ * Summary:
+ *  Function that validates a set of calibration points and builds the table
+ *  used for conversion. The slope of every segment is computed once here, so
+ *  this is the only place where a division is needed.
+ *
+ * Parameters:
+ *  calibration_table_t *table : Table to build
+ *  const calibration_point_t *points : Calibration points sorted by strictly
+ *                                      increasing raw reading
+ *  uint32_t count : Number of points, 1 to CALIBRATION_MAX_POINTS
+ *
+ * Return:
+ *  bool : true if the table was loaded, else false and the table is unchanged
+ *
+ ******************************************************************************/
+bool calibration_load(calibration_table_t *table, const calibration_point_t *points,
+                      uint32_t count)
+{
+    calibration_table_t loaded;
+
+    if ((points == NULL) || (count == 0u) || (count > CALIBRATION_MAX_POINTS))
+    {
+        return false;
+    }
+
+    memset(&loaded, 0, sizeof(loaded));
+    loaded.count = count;
+    memcpy(loaded.points, points, count * sizeof(calibration_point_t));
+
+    for (uint32_t i = 0; (i + 1u) < count; i++)
+    {
+        int64_t dx = (int64_t)points[i + 1u].raw - points[i].raw;
+        int64_t dy = (int64_t)points[i + 1u].value - points[i].value;
+        uint32_t shift = CALIBRATION_MAX_SLOPE_SHIFT;
+        int64_t slope;
+
+        if (dx <= 0)
+        {
+            return false;
+        }
+
+        /* Keep as many fractional bits as the 32-bit slope can hold. */
+        while (true)
+        {
+            slope = (dy * (1ll << shift)) / dx;
+            if (((slope <= INT32_MAX) && (slope >= INT32_MIN)) || (shift == 0u))
+            {
+                break;
+            }
+            shift--;
+        }
+
+        if ((slope > INT32_MAX) || (slope < INT32_MIN))
+        {
+            return false;
+        }
+
+        loaded.slope[i] = (int32_t)slope;
+        loaded.slope_shift[i] = (uint8_t)shift;
+    }
+
+    *table = loaded;
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: calibration_convert
+ ******************************************************************************
+ * Summary:
+ *  Function that converts a single filtered ADC reading. Readings outside the
+ *  table are extrapolated from the first or last segment.
+ *
+ * Parameters:
+ *  const calibration_table_t *table : Calibration table of the channel
+ *  int32_t raw : Filtered reading in counts scaled by 2^ADC_FILTER_FRAC_BITS
+ *
+ * Return:
+ *  int32_t : Physical value in Q16.16
+ *
+ ******************************************************************************/
+int32_t calibration_convert(const calibration_table_t *table, int32_t raw)
+{
+    return convert_segment(table, find_segment(table, raw, 0), raw);
+}
+
+/******************************************************************************
+ * Function Name: calibration_apply
+ ******************************************************************************
+ * Summary:
+ *  Function that converts a block of filtered ADC readings. Consecutive
+ *  readings usually fall in the same segment, so the segment of the previous
+ *  reading is tried first. 'raw' and 'value' may point to the same buffer.
+ *
+ * Parameters:
+ *  const calibration_table_t *table : Calibration table of the channel
+ *  const int32_t *raw : Filtered readings
+ *  int32_t *value : Buffer receiving the physical values in Q16.16
+ *  uint32_t count : Number of readings
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void calibration_apply(const calibration_table_t *table, const int32_t *raw,
+                       int32_t *value, uint32_t count)
+{
+    uint32_t segment = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        segment = find_segment(table, raw[i], segment);
+        value[i] = convert_segment(table, segment, raw[i]);
+    }
+}
+
+/******************************************************************************
+ * Function Name: find_segment
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the index of the segment that covers a reading,
+ *  starting the search from a hint.
+ *
+ * Parameters:
+ *  const calibration_table_t *table : Calibration table
+ *  int32_t raw : Filtered reading
+ *  uint32_t hint : Segment to start the search from
+ *
+ * Return:
+ *  uint32_t : Segment index. Readings below or above the table map to the
+ *             first or last segment respectively.
+ *
+ ******************************************************************************/
+static uint32_t find_segment(const calibration_table_t *table, int32_t raw, uint32_t hint)
+{
+    uint32_t last = (table->count > 1u) ? (table->count - 2u) : 0u;
+    uint32_t segment = (hint <= last) ? hint : last;
+
+    while ((segment > 0u) && (raw < table->points[segment].raw))
+    {
+        segment--;
+    }
+    while ((segment < last) && (raw >= table->points[segment + 1u].raw))
+    {
+        segment++;
+    }
+
+    return segment;
+}
+
+/******************************************************************************
+ * Function Name: convert_segment
+ ******************************************************************************
+ * Summary:
+ *  Function that evaluates one segment of the table for a reading,
+ *  saturating the result to the Q16.16 range.
+ *
+ * Parameters:
+ *  const calibration_table_t *table : Calibration table
+ *  uint32_t segment : Segment index
+ *  int32_t raw : Filtered reading
+ *
+ * Return:
+ *  int32_t : Physical value in Q16.16
+ *
+ ******************************************************************************/
+static int32_t convert_segment(const calibration_table_t *table, uint32_t segment, int32_t raw)
+{
+    const calibration_point_t *origin = &table->points[segment];
+    int64_t value;
+
+    if (table->count < 2u)
+    {
+        return origin->value;
+    }
+
+    value = origin->value +
+            ((((int64_t)raw - origin->raw) * table->slope[segment]) >> table->slope_shift[segment]);
+
+    if (value > INT32_MAX)
+    {
+        value = INT32_MAX;
+    }
+    else if (value < INT32_MIN)
+    {
+        value = INT32_MIN;
+    }
+
+    return (int32_t)value;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,68 @@
+/******************************************************************************
+* File Name:   calibration.h
+*
+* Description: This file is the public interface of calibration.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef CALIBRATION_H_
+#define CALIBRATION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "adc_filter.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Maximum number of points in one calibration table. */
+#define CALIBRATION_MAX_POINTS          (8u)
+
+/* Number of fractional bits of a calibrated value (Q16.16). */
+#define CALIBRATION_FRAC_BITS           (16u)
+
+/* Helpers to write calibration tables in engineering units. Both expand to
+ * integer constants at compile time, no floating point code is generated.
+ */
+#define CALIBRATION_RAW(counts)         ((int32_t)((counts) * (1l << ADC_FILTER_FRAC_BITS)))
+#define CALIBRATION_VALUE(value)        ((int32_t)(((value) * (1l << CALIBRATION_FRAC_BITS)) + \
+                                                   (((value) < 0) ? -0.5 : 0.5)))
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* One calibration point: a filtered ADC reading in counts scaled by
+ * 2^ADC_FILTER_FRAC_BITS and the physical value it maps to in Q16.16.
+ */
+typedef struct
+{
+    int32_t raw;
+    int32_t value;
+} calibration_point_t;
+
+/* Piecewise-linear calibration table. Each segment between two points keeps
+ * a precomputed slope so conversions need only a multiply and a shift.
+ */
+typedef struct
+{
+    uint32_t count;
+    calibration_point_t points[CALIBRATION_MAX_POINTS];
+    int32_t slope[CALIBRATION_MAX_POINTS - 1u];
+    uint8_t slope_shift[CALIBRATION_MAX_POINTS - 1u];
+} calibration_table_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+bool calibration_load(calibration_table_t *table, const calibration_point_t *points,
+                      uint32_t count);
+int32_t calibration_convert(const calibration_table_t *table, int32_t raw);
+void calibration_apply(const calibration_table_t *table, const int32_t *raw,
+                       int32_t *value, uint32_t count);
+
+#endif /* CALIBRATION_H_ */
+
+/* [] END OF FILE */
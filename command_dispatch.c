@@ -0,0 +1,267 @@
+/******************************************************************************
+* File Name:   command_dispatch.c
+*
+* Description: This file contains the dispatcher of the commands received on
+*              the subscribed MQTT topic. The commands of a node are listed
+*              in a constant table; at start-up the names are hashed into an
+*              open addressed index of COMMAND_TABLE_SLOTS slots. A payload
+*              is dispatched by hashing its name in the same pass that finds
+*              its end, so the cost does not grow with the number of
+*              commands, and the argument is parsed in place without
+*              copies or allocations.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <string.h>
+
+#include "command_dispatch.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+#define SLOT_MASK                       (COMMAND_TABLE_SLOTS - 1u)
+
+/* FNV-1a hash parameters. */
+#define HASH_OFFSET                     (2166136261lu)
+#define HASH_PRIME                      (16777619lu)
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static bool is_name_char(char c);
+static uint32_t hash_step(uint32_t hash, char c);
+
+/******************************************************************************
+ * Function Name: command_table_init
+ ******************************************************************************
+ * Summary:
+ *  Function that builds the hash index of a command table.
+ *
+ * Parameters:
+ *  command_table_t *table : Index to build
+ *  const command_t *commands : Commands, which must stay valid
+ *  uint32_t count : Number of commands
+ *
+ * Return:
+ *  bool : true if the index was built, false if there are too many commands
+ *         or a name is invalid or listed twice
+ *
+ ******************************************************************************/
+bool command_table_init(command_table_t *table, const command_t *commands, uint32_t count)
+{
+    memset(table, 0, sizeof(*table));
+
+    if ((2u * count) > COMMAND_TABLE_SLOTS)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t hash = HASH_OFFSET;
+        uint32_t slot;
+
+        if (commands[i].name_len == 0u)
+        {
+            return false;
+        }
+        for (size_t c = 0; c < commands[i].name_len; c++)
+        {
+            if (!is_name_char(commands[i].name[c]))
+            {
+                return false;
+            }
+            hash = hash_step(hash, commands[i].name[c]);
+        }
+
+        for (slot = hash & SLOT_MASK; table->slot[slot] != 0u; slot = (slot + 1u) & SLOT_MASK)
+        {
+            const command_t *other = &commands[table->slot[slot] - 1u];
+
+            if ((other->name_len == commands[i].name_len) &&
+                (memcmp(other->name, commands[i].name, other->name_len) == 0))
+            {
+                return false;
+            }
+        }
+        table->slot[slot] = (uint8_t)(i + 1u);
+    }
+
+    table->commands = commands;
+    table->count = count;
+
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: command_dispatch
+ ******************************************************************************
+ * Summary:
+ *  Function that looks up the command of a payload, parses its argument and
+ *  calls its handler. The payload does not need to be null terminated.
+ *
+ * Parameters:
+ *  const command_table_t *table : Command table
+ *  const char *payload : Received payload
+ *  size_t length : Length of the payload
+ *
+ * Return:
+ *  command_result_t : COMMAND_OK if the handler was called
+ *
+ ******************************************************************************/
+command_result_t command_dispatch(const command_table_t *table, const char *payload, size_t length)
+{
+    uint32_t hash = HASH_OFFSET;
+    size_t name_len = 0;
+    int32_t argument = 0;
+
+    while ((name_len < length) && is_name_char(payload[name_len]))
+    {
+        hash = hash_step(hash, payload[name_len]);
+        name_len++;
+    }
+    if (name_len == 0u)
+    {
+        return COMMAND_UNKNOWN;
+    }
+
+    for (uint32_t slot = hash & SLOT_MASK; table->slot[slot] != 0u; slot = (slot + 1u) & SLOT_MASK)
+    {
+        const command_t *command = &table->commands[table->slot[slot] - 1u];
+
+        if ((command->name_len != name_len) || (memcmp(command->name, payload, name_len) != 0))
+        {
+            continue;
+        }
+
+        switch (command->arg_type)
+        {
+            case COMMAND_ARG_NONE:
+            {
+                if (name_len != length)
+                {
+                    return COMMAND_BAD_ARGUMENT;
+                }
+                break;
+            }
+
+            case COMMAND_ARG_INT:
+            {
+                if (!command_parse_int(&payload[name_len], length - name_len,
+                               command->min, command->max, &argument))
+                {
+                    return COMMAND_BAD_ARGUMENT;
+                }
+                break;
+            }
+
+            default:
+            {
+                return COMMAND_BAD_ARGUMENT;
+            }
+        }
+
+        command->handler(argument);
+        return COMMAND_OK;
+    }
+
+    return COMMAND_UNKNOWN;
+}
+
+/******************************************************************************
+ * Function Name: is_name_char
+ ******************************************************************************
+ * Summary:
+ *  Function that tells whether a character can be part of a command name.
+ *
+ * Parameters:
+ *  char c : Character
+ *
+ * Return:
+ *  bool : true for letters and underscores
+ *
+ ******************************************************************************/
+static bool is_name_char(char c)
+{
+    return (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || (c == '_'));
+}
+
+/******************************************************************************
+ * Function Name: hash_step
+ ******************************************************************************
+ * Summary:
+ *  Function that adds one character to an FNV-1a hash.
+ *
+ * Parameters:
+ *  uint32_t hash : Hash of the preceding characters
+ *  char c : Character
+ *
+ * Return:
+ *  uint32_t : Updated hash
+ *
+ ******************************************************************************/
+static uint32_t hash_step(uint32_t hash, char c)
+{
+    return (hash ^ (uint8_t)c) * HASH_PRIME;
+}
+
+/******************************************************************************
+ * Function Name: command_parse_int
+ ******************************************************************************
+ * Summary:
+ *  Function that parses a decimal integer with an optional sign that makes
+ *  up the whole text.
+ *
+ * Parameters:
+ *  const char *text : Text, not necessarily null terminated
+ *  size_t length : Length of the text
+ *  int32_t min : Lowest accepted value
+ *  int32_t max : Highest accepted value
+ *  int32_t *value : Parsed value
+ *
+ * Return:
+ *  bool : true if the text is an integer from 'min' to 'max'
+ *
+ ******************************************************************************/
+bool command_parse_int(const char *text, size_t length, int32_t min, int32_t max, int32_t *value)
+{
+    bool negative = false;
+    int64_t result = 0;
+    size_t i = 0;
+
+    if ((length > 0u) && ((text[0] == '-') || (text[0] == '+')))
+    {
+        negative = (text[0] == '-');
+        i++;
+    }
+    if (i == length)
+    {
+        return false;
+    }
+
+    for (; i < length; i++)
+    {
+        if ((text[i] < '0') || (text[i] > '9'))
+        {
+            return false;
+        }
+        result = (result * 10) + (text[i] - '0');
+        if (result > ((int64_t)INT32_MAX + 1))
+        {
+            return false;
+        }
+    }
+
+    result = negative ? -result : result;
+    if ((result < min) || (result > max))
+    {
+        return false;
+    }
+    *value = (int32_t)result;
+
+    return true;
+}
+
+/* [] END OF FILE */
@@ -69,6 +69,12 @@
 #define MQTT_PUB_TOPIC                    "jonas_UHasselt_IoT_node2"
 #define MQTT_SUB_TOPIC                    "jonas_UHasselt_IoT_py"
 
+/* Topic under which the commands addressed to this node alone are published,
+ * one sub-topic per command. The commands on MQTT_SUB_TOPIC itself are
+ * accepted as well.
+ */
+#define MQTT_SUB_NODE_TOPIC               MQTT_SUB_TOPIC "/node2"
+
 /* Set the QoS that is associated with the MQTT publish, and subscribe messages.
  * Valid choices are 0, 1, and 2. Other values should not be used in this macro.
  */
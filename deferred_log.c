@@ -0,0 +1,199 @@
+/******************************************************************************
+* File Name:   deferred_log.c
+*
+* Description: This file contains the deferred logger used on the hot paths
+*              instead of printf(). A log call only stores the format string
+*              pointer, its integer arguments, the level and the tick count
+*              in a ring; formatting and the UART output are done later by a
+*              low priority task.
+*
+*              The ring is a bounded multi-producer queue with a sequence
+*              number per slot. A producer claims a slot by advancing the
+*              head with a compare-and-swap and publishes the record by
+*              storing the slot sequence, so log calls neither lock nor
+*              block and can be made from tasks and interrupts. When the
+*              ring is full the record is dropped and counted.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+#include "cy_retarget_io.h"
+
+#include "deferred_log.h"
+
+/******************************************************************************
+* Macros
+*******************************************************************************/
+#define RING_MASK                           (DEFERRED_LOG_RING_SIZE - 1u)
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* One log record. 'sequence' equals the position of the record in the ring
+ * while the slot is free and the position + 1 once the record is complete.
+ */
+typedef struct
+{
+    uint32_t sequence;
+    const char *format;
+    uintptr_t args[DEFERRED_LOG_MAX_ARGS];
+    TickType_t tick;
+    uint8_t level;
+} log_record_t;
+
+/* FreeRTOS task handle for this task. */
+TaskHandle_t deferred_log_task_handle;
+
+static log_record_t ring[DEFERRED_LOG_RING_SIZE];
+
+/* Next position to be claimed by a producer and to be read by the task. */
+static uint32_t ring_head;
+static uint32_t ring_tail;
+
+/* Number of records dropped because the ring was full. */
+static uint32_t dropped_count;
+
+/* Level tags printed in front of each record. */
+static const char *const level_tags[] =
+{
+    [LOG_LEVEL_NONE] = "",
+    [LOG_LEVEL_ERROR] = "E",
+    [LOG_LEVEL_WARN] = "W",
+    [LOG_LEVEL_INFO] = "I",
+    [LOG_LEVEL_DEBUG] = "D"
+};
+
+/******************************************************************************
+ * Function Name: deferred_log_task
+ ******************************************************************************
+ * Summary:
+ *  Task that formats the queued log records in order and prints them over
+ *  the debug UART. When the ring is empty it sleeps for
+ *  'DEFERRED_LOG_POLL_INTERVAL_MS'.
+ *
+ * Parameters:
+ *  void *pvParameters : Task parameter defined during task creation (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void deferred_log_task(void *pvParameters)
+{
+    uint32_t reported_drops = 0;
+
+    (void) pvParameters;
+
+    for (uint32_t i = 0; i < DEFERRED_LOG_RING_SIZE; i++)
+    {
+        ring[i].sequence = i;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    deferred_log_task_handle = xTaskGetCurrentTaskHandle();
+
+    while (true)
+    {
+        log_record_t *record = &ring[ring_tail & RING_MASK];
+        uint32_t drops;
+
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != (ring_tail + 1u))
+        {
+            drops = __atomic_load_n(&dropped_count, __ATOMIC_RELAXED);
+            if (drops != reported_drops)
+            {
+                printf("Log: %lu records dropped\n", (unsigned long)(drops - reported_drops));
+                reported_drops = drops;
+            }
+            vTaskDelay(pdMS_TO_TICKS(DEFERRED_LOG_POLL_INTERVAL_MS));
+            continue;
+        }
+
+        printf("[%lu] %s: ", (unsigned long)record->tick, level_tags[record->level]);
+        printf(record->format, record->args[0], record->args[1],
+               record->args[2], record->args[3]);
+
+        /* Hand the slot back to the producers for the next lap. */
+        __atomic_store_n(&record->sequence, ring_tail + DEFERRED_LOG_RING_SIZE,
+                         __ATOMIC_RELEASE);
+        ring_tail++;
+    }
+}
+
+/******************************************************************************
+ * Function Name: deferred_log_write
+ ******************************************************************************
+ * Summary:
+ *  Function that queues a log record for the log task. It is called through
+ *  the LOG_ERROR, LOG_WARN, LOG_INFO and LOG_DEBUG macros, can be called
+ *  from tasks and interrupts, and never blocks. Records logged before the
+ *  log task runs, or while the ring is full, are dropped.
+ *
+ * Parameters:
+ *  uint8_t level : Log level of the record
+ *  const char *format : printf() format, which must stay valid
+ *  uint32_t count : Number of arguments that follow
+ *  ... : Integer or pointer arguments of the format
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void deferred_log_write(uint8_t level, const char *format, uint32_t count, ...)
+{
+    log_record_t *record;
+    uint32_t position;
+    va_list args;
+
+    if (__atomic_load_n(&deferred_log_task_handle, __ATOMIC_ACQUIRE) == NULL)
+    {
+        __atomic_fetch_add(&dropped_count, 1u, __ATOMIC_RELAXED);
+        return;
+    }
+
+    position = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    while (true)
+    {
+        record = &ring[position & RING_MASK];
+        int32_t lag = (int32_t)(__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) - position);
+
+        if (lag == 0)
+        {
+            /* The slot is free; claim it unless another producer did. */
+            if (__atomic_compare_exchange_n(&ring_head, &position, position + 1u, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (lag < 0)
+        {
+            /* The log task has not printed this slot of the last lap yet. */
+            __atomic_fetch_add(&dropped_count, 1u, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            position = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    record->format = format;
+    record->level = level;
+    record->tick = xTaskGetTickCountFromISR();
+
+    va_start(args, count);
+    for (uint32_t i = 0; i < DEFERRED_LOG_MAX_ARGS; i++)
+    {
+        record->args[i] = (i < count) ? va_arg(args, uintptr_t) : 0u;
+    }
+    va_end(args);
+
+    __atomic_store_n(&record->sequence, position + 1u, __ATOMIC_RELEASE);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,98 @@
+/******************************************************************************
+* File Name:   deferred_log.h
+*
+* Description: This file is the public interface of deferred_log.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef DEFERRED_LOG_H_
+#define DEFERRED_LOG_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Log levels. Records above DEFERRED_LOG_LEVEL are removed at compile time. */
+#define LOG_LEVEL_NONE                      (0)
+#define LOG_LEVEL_ERROR                     (1)
+#define LOG_LEVEL_WARN                      (2)
+#define LOG_LEVEL_INFO                      (3)
+#define LOG_LEVEL_DEBUG                     (4)
+
+#ifndef DEFERRED_LOG_LEVEL
+#define DEFERRED_LOG_LEVEL                  LOG_LEVEL_INFO
+#endif
+
+/* Task parameters for the deferred log task. It runs below all other tasks
+ * so the UART output only uses otherwise idle time.
+ */
+#define DEFERRED_LOG_TASK_PRIORITY          (1)
+#define DEFERRED_LOG_TASK_STACK_SIZE        (1024 * 1)
+
+/* Number of records in the log ring. Must be a power of two. */
+#define DEFERRED_LOG_RING_SIZE              (64u)
+
+/* Largest number of arguments of one record. */
+#define DEFERRED_LOG_MAX_ARGS               (4u)
+
+/* Interval in milliseconds at which the log task checks the ring once it
+ * has emptied it.
+ */
+#define DEFERRED_LOG_POLL_INTERVAL_MS       (20u)
+
+/* Number of arguments after the format, 0 to DEFERRED_LOG_MAX_ARGS. */
+#define LOG_ARG_COUNT(...)                  LOG_ARG_COUNT_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define LOG_ARG_COUNT_(_0, _1, _2, _3, _4, count, ...) (count)
+
+/* Logging macros for the hot paths. The format must be a string literal and
+ * each argument an integer of at most 32 bits or a pointer to a string that
+ * stays valid, such as a topic name, since it is only formatted later by the
+ * log task. The format is expected to end with a newline.
+ */
+#define LOG_WRITE(level, format, ...)       deferred_log_write((level), (format), \
+                                                LOG_ARG_COUNT(__VA_ARGS__), ##__VA_ARGS__)
+
+#if (DEFERRED_LOG_LEVEL >= LOG_LEVEL_ERROR)
+#define LOG_ERROR(format, ...)              LOG_WRITE(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...)              ((void)0)
+#endif
+
+#if (DEFERRED_LOG_LEVEL >= LOG_LEVEL_WARN)
+#define LOG_WARN(format, ...)               LOG_WRITE(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...)               ((void)0)
+#endif
+
+#if (DEFERRED_LOG_LEVEL >= LOG_LEVEL_INFO)
+#define LOG_INFO(format, ...)               LOG_WRITE(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...)               ((void)0)
+#endif
+
+#if (DEFERRED_LOG_LEVEL >= LOG_LEVEL_DEBUG)
+#define LOG_DEBUG(format, ...)              LOG_WRITE(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...)              ((void)0)
+#endif
+
+/*******************************************************************************
+* Extern Variables
+********************************************************************************/
+extern TaskHandle_t deferred_log_task_handle;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void deferred_log_task(void *pvParameters);
+void deferred_log_write(uint8_t level, const char *format, uint32_t count, ...);
+
+#endif /* DEFERRED_LOG_H_ */
+
+/* [] END OF FILE */
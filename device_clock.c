@@ -0,0 +1,159 @@
+/******************************************************************************
+* File Name:   device_clock.c
+*
+* Description: This file contains the monotonic device clock used to
+*              timestamp samples where they are captured. A free-running
+*              1 MHz hardware timer provides the low bits and its terminal
+*              count interrupt extends it to 64 bits, so the clock has
+*              microsecond resolution, never wraps and is independent of the
+*              RTOS tick. It can be read from tasks and from ISRs.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include "cyhal.h"
+#include "cy_retarget_io.h"
+
+#include "device_clock.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Frequency of the clock timer. One tick is one microsecond. */
+#define CLOCK_TIMER_FREQUENCY_HZ        (1000000u)
+
+/* The timer wraps at 16 bits so the same code works on 16-bit and 32-bit
+ * counters. The overflow interrupt then fires every 65.536 ms.
+ */
+#define CLOCK_TIMER_PERIOD              (0xFFFFu)
+#define CLOCK_TIMER_SPAN                ((uint64_t)CLOCK_TIMER_PERIOD + 1u)
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void isr_clock_overflow(void *callback_arg, cyhal_timer_event_t event);
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Free-running timer providing the low bits of the clock. */
+static cyhal_timer_t clock_timer;
+
+/* Time in microseconds at which the timer last wrapped. */
+static volatile uint64_t clock_base_us;
+
+/******************************************************************************
+ * Function Name: device_clock_init
+ ******************************************************************************
+ * Summary:
+ *  Function that starts the free-running clock timer and its overflow
+ *  interrupt. It must be called once before the clock is read.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code
+ *
+ ******************************************************************************/
+cy_rslt_t device_clock_init(void)
+{
+    cy_rslt_t result;
+    const cyhal_timer_cfg_t timer_cfg =
+    {
+        .compare_value = 0,
+        .period = CLOCK_TIMER_PERIOD,
+        .direction = CYHAL_TIMER_DIR_UP,
+        .is_compare = false,
+        .is_continuous = true,
+        .value = 0
+    };
+
+    result = cyhal_timer_init(&clock_timer, NC, NULL);
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = cyhal_timer_configure(&clock_timer, &timer_cfg);
+    }
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = cyhal_timer_set_frequency(&clock_timer, CLOCK_TIMER_FREQUENCY_HZ);
+    }
+    if (CY_RSLT_SUCCESS == result)
+    {
+        cyhal_timer_register_callback(&clock_timer, isr_clock_overflow, NULL);
+        cyhal_timer_enable_event(&clock_timer, CYHAL_TIMER_IRQ_TERMINAL_COUNT,
+                                 DEVICE_CLOCK_INTR_PRIORITY, true);
+        result = cyhal_timer_start(&clock_timer);
+    }
+
+    if (CY_RSLT_SUCCESS != result)
+    {
+        printf("Device clock initialization failed. Error: %ld\n", (long unsigned int)result);
+    }
+
+    return result;
+}
+
+/******************************************************************************
+ * Function Name: device_clock_now_us
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the time since device_clock_init() in
+ *  microseconds. The value never decreases.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  uint64_t : Current time in microseconds
+ *
+ ******************************************************************************/
+uint64_t device_clock_now_us(void)
+{
+    uint32_t saved_intr = cyhal_system_critical_section_enter();
+    uint32_t count = cyhal_timer_read(&clock_timer);
+    uint64_t now = clock_base_us + count;
+
+    /* The timer has wrapped but the overflow interrupt has not run yet,
+     * because interrupts are disabled here or in the caller. The pending
+     * terminal count flag tells; a low count shows that it was read after
+     * that wrap and not just before it.
+     */
+    if (((Cy_TCPWM_GetInterruptStatus(clock_timer.tcpwm.base,
+                                      _CYHAL_TCPWM_CNT_NUMBER(clock_timer.tcpwm.resource)) &
+          CY_TCPWM_INT_ON_TC) != 0u) &&
+        (count < (CLOCK_TIMER_SPAN / 2u)))
+    {
+        now += CLOCK_TIMER_SPAN;
+    }
+
+    cyhal_system_critical_section_exit(saved_intr);
+
+    return now;
+}
+
+/******************************************************************************
+ * Function Name: isr_clock_overflow
+ ******************************************************************************
+ * Summary:
+ *  Timer interrupt service routine invoked when the clock timer wraps. It
+ *  advances the high part of the clock by one timer span.
+ *
+ * Parameters:
+ *  void *callback_arg : pointer to variable passed to the ISR (unused)
+ *  cyhal_timer_event_t event : Timer event type (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void isr_clock_overflow(void *callback_arg, cyhal_timer_event_t event)
+{
+    (void) callback_arg;
+    (void) event;
+
+    clock_base_us += CLOCK_TIMER_SPAN;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,36 @@
+/******************************************************************************
+* File Name:   device_clock.h
+*
+* Description: This file is the public interface of device_clock.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef DEVICE_CLOCK_H_
+#define DEVICE_CLOCK_H_
+
+#include <stdint.h>
+
+#include "cyhal.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Interrupt priority of the device clock overflow event. */
+#define DEVICE_CLOCK_INTR_PRIORITY          (3u)
+
+/* Number of microseconds in one second, used to split timestamps for
+ * printing since the C library does not print 64-bit integers.
+ */
+#define DEVICE_CLOCK_US_PER_SEC             (1000000u)
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t device_clock_init(void);
+uint64_t device_clock_now_us(void);
+
+#endif /* DEVICE_CLOCK_H_ */
+
+/* [] END OF FILE */
@@ -0,0 +1,1231 @@
+/******************************************************************************
+* File Name:   journal.c
+*
+* Description: This file contains the store-and-forward journal for the
+*              telemetry. While the MQTT broker is unreachable, the records
+*              produced by the telemetry are appended to a ring of erase
+*              sectors in the last JOURNAL_FLASH_SIZE bytes of the external
+*              QSPI NOR flash, past the end of the XIP image that holds the
+*              Wi-Fi firmware. The region is not part of the application
+*              image, so programming the device leaves the journal intact;
+*              its sectors are erased the first time they are used. After
+*              reconnection the journal task hands them in
+*              batches to the publisher on its bulk lane, once per telemetry
+*              topic, and marks each published slot as consumed in place,
+*              so the read position survives a reset. All flash accesses
+*              are done by the journal task, which never blocks the
+*              sampling; a sector erase only delays the journal itself.
+*
+*              The QSPI flash is memory mapped (XIP) for the Wi-Fi firmware,
+*              but no code runs from it: it only holds the firmware, which
+*              the WLAN driver reads once while it starts, and the journal.
+*              The journal task is only created after that, and takes XIP
+*              off around each of its flash operations.
+*
+*              Slot layout (JOURNAL_SLOT_SIZE bytes, little-endian):
+*                0  magic, programmed last to commit the slot
+*                1  state, 0xFF pending, 0x00 consumed
+*                2  length of the encoded record
+*                3  topics to publish the record on, bit i for
+*                   telemetry_topics[i], cleared as they are published
+*                4  sequence number
+*                8  record encoded by telemetry_codec.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <string.h>
+
+#include "cyhal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "cy_retarget_io.h"
+
+#include "journal.h"
+#include "deferred_log.h"
+
+#if JOURNAL_ENABLE
+#include "cy_serial_flash_qspi.h"
+
+#include "telemetry.h"
+#include "telemetry_delta.h"
+#include "publisher_task.h"
+#include "mqtt_client_config.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Values of the slot header fields. */
+#define SLOT_MAGIC                      (0x4Bu)
+#define SLOT_ERASED                     (0xFFu)
+#define SLOT_PENDING                    (0xFFu)
+#define SLOT_CONSUMED                   (0x00u)
+#define SLOT_LENGTH_ERASED              (0xFFu)
+
+/* Size of the slot header and of the record stored after it. */
+#define SLOT_HEADER_SIZE                (8u)
+#define SLOT_PAYLOAD_SIZE               (JOURNAL_SLOT_SIZE - SLOT_HEADER_SIZE)
+
+/* Offsets of the state and topics bytes in the slot header. */
+#define SLOT_STATE_OFFSET               (1u)
+#define SLOT_TOPICS_OFFSET              (3u)
+
+/* Topics of a record journaled while disconnected. */
+#define JOURNAL_ALL_TOPICS              ((1u << TELEMETRY_TOPIC_COUNT) - 1u)
+
+/* Smallest ring: one sector being written, one erased ahead of it and one
+ * holding the oldest records.
+ */
+#define JOURNAL_MIN_SECTORS             (3u)
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Header at the start of every slot. */
+typedef struct
+{
+    uint8_t magic;
+    uint8_t state;
+    uint8_t length;
+    uint8_t topics;
+    uint32_t sequence;
+} journal_slot_header_t;
+
+/* Position of a slot in the ring. */
+typedef struct
+{
+    uint32_t sector;
+    uint32_t slot;
+} journal_position_t;
+
+/* An encoded record waiting to be written to the flash. */
+typedef struct
+{
+    uint8_t length;
+    uint8_t topics;
+    uint8_t data[SLOT_PAYLOAD_SIZE];
+} journal_entry_t;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static bool journal_open(void);
+static cy_rslt_t flash_read(uint32_t address, size_t length, uint8_t *data);
+static cy_rslt_t flash_write(uint32_t address, size_t length, const uint8_t *data);
+static cy_rslt_t flash_erase(uint32_t address, size_t length);
+static void journal_wake(void);
+static void journal_write(const journal_entry_t *entry);
+static void journal_drain(void);
+static bool drain_finish(void);
+static void drain_complete(char *data, bool published);
+static uint32_t drain_select(uint32_t topic, const telemetry_record_t *records,
+                             uint32_t count, telemetry_record_t *selected);
+static uint32_t drain_build(uint32_t encoding, const telemetry_record_t *records,
+                            uint32_t count, char *payload, size_t *length);
+static void prepare_sector(uint32_t sector);
+static bool read_header(journal_position_t position, journal_slot_header_t *header);
+static bool slot_is_free(const journal_slot_header_t *header);
+static bool slot_is_record(const journal_slot_header_t *header);
+static uint32_t slot_address(journal_position_t position);
+static journal_position_t next_position(journal_position_t position);
+static bool same_position(journal_position_t a, journal_position_t b);
+
+/* End of the XIP section of the image, defined by the linker script. */
+extern const uint8_t __cy_xip_end[];
+
+/* FreeRTOS task handle for this task. */
+TaskHandle_t journal_task_handle;
+
+/* Set while the MQTT connection is up. */
+static volatile bool journal_online;
+
+/* Records handed over by the telemetry, written by the journal task. */
+static QueueHandle_t journal_q;
+
+/* Geometry of the journal in the external flash. */
+static uint32_t journal_base;
+static uint32_t sector_size;
+static uint32_t sector_count;
+static uint32_t slots_per_sector;
+
+/* Next slot to write, oldest slot not yet published, and the sequence
+ * number of the next record.
+ */
+static journal_position_t write_pos;
+static journal_position_t read_pos;
+static uint32_t next_sequence;
+
+/* Statistics of the journal. */
+static uint32_t stored_count;
+static uint32_t drained_count;
+static uint32_t overwritten_count;
+static uint32_t overflow_count;
+static uint32_t skipped_count;
+
+/* Drain handed to the publisher: the slots of its records with their
+ * sequence numbers and topics, the read position it started from, the
+ * publishes that have not completed yet, the topics whose publish was
+ * acknowledged and whether one of them failed.
+ */
+static struct
+{
+    journal_position_t positions[JOURNAL_DRAIN_BATCH];
+    uint32_t sequences[JOURNAL_DRAIN_BATCH];
+    uint8_t topics[JOURNAL_DRAIN_BATCH];
+    journal_position_t start;
+    uint32_t count;
+    volatile uint32_t pending;
+    volatile uint32_t published;
+    volatile bool failed;
+} drain;
+
+/* Payload of the drain publish of every telemetry topic. */
+static char drain_payloads[TELEMETRY_TOPIC_COUNT][PUBLISHER_BATCH_MAX_SIZE + 1u];
+
+/******************************************************************************
+ * Function Name: journal_task
+ ******************************************************************************
+ * Summary:
+ *  Task that locates the journal in the external flash, writes the records
+ *  received while disconnected and drains the journal while connected. It
+ *  sleeps until a record arrives, the connection state changes or a drain
+ *  publish completes.
+ *
+ * Parameters:
+ *  void *pvParameters : Task parameter defined during task creation (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void journal_task(void *pvParameters)
+{
+    static journal_entry_t entry;
+
+    (void) pvParameters;
+
+    if (!journal_open())
+    {
+        printf("Journal: no usable journal in the external flash!\n");
+        vTaskDelete(NULL);
+    }
+
+    journal_q = xQueueCreate(JOURNAL_QUEUE_LENGTH, sizeof(journal_entry_t));
+    if (journal_q == NULL)
+    {
+        printf("Journal: queue creation failed!\n");
+        vTaskDelete(NULL);
+    }
+
+    while (true)
+    {
+        /* Writing has priority; drain only when no record is waiting. */
+        while (pdTRUE == xQueueReceive(journal_q, &entry, 0))
+        {
+            journal_write(&entry);
+        }
+
+        /* One drain at a time: its records are consumed once the publisher
+         * has completed all of its publishes.
+         */
+        if (drain.count != 0u)
+        {
+            if (drain.pending == 0u)
+            {
+                if (!drain_finish())
+                {
+                    vTaskDelay(pdMS_TO_TICKS(JOURNAL_POLL_INTERVAL_MS));
+                }
+                continue;
+            }
+        }
+        else if (journal_online && !same_position(read_pos, write_pos))
+        {
+            journal_drain();
+            continue;
+        }
+
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(JOURNAL_POLL_INTERVAL_MS));
+    }
+}
+
+/******************************************************************************
+ * Function Name: journal_set_online
+ ******************************************************************************
+ * Summary:
+ *  Function that tells the journal whether the MQTT connection is up. While
+ *  it is down new records are journaled; once it is up the journal drains.
+ *
+ * Parameters:
+ *  bool online : true if the MQTT connection is up
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void journal_set_online(bool online)
+{
+    journal_online = online;
+    journal_wake();
+}
+
+/******************************************************************************
+ * Function Name: journal_append
+ ******************************************************************************
+ * Summary:
+ *  Function that takes a telemetry record while the MQTT connection is down.
+ *  It does not block; if the journal task lags too far behind, the record
+ *  is not taken.
+ *
+ * Parameters:
+ *  const telemetry_record_t *record : Record to journal
+ *
+ * Return:
+ *  bool : true if the journal took the record, false if it must be
+ *         published directly
+ *
+ ******************************************************************************/
+bool journal_append(const telemetry_record_t *record)
+{
+    if (journal_online)
+    {
+        return false;
+    }
+
+    return journal_store(record, JOURNAL_ALL_TOPICS);
+}
+
+/******************************************************************************
+ * Function Name: journal_store
+ ******************************************************************************
+ * Summary:
+ *  Function that takes a telemetry record whatever the connection state,
+ *  for records that the publisher could not queue. The record is drained
+ *  only on the given topics. It does not block; if the journal task lags
+ *  too far behind, the record is not taken.
+ *
+ * Parameters:
+ *  const telemetry_record_t *record : Record to journal
+ *  uint32_t topics : Topics to publish the record on, bit i for
+ *                    telemetry_topics[i]
+ *
+ * Return:
+ *  bool : true if the journal took the record, else false
+ *
+ ******************************************************************************/
+bool journal_store(const telemetry_record_t *record, uint32_t topics)
+{
+    journal_entry_t entry;
+
+    if (journal_q == NULL)
+    {
+        return false;
+    }
+
+    entry.length = (uint8_t)telemetry_codec_encode(record, entry.data, sizeof(entry.data));
+    entry.topics = (uint8_t)(topics & JOURNAL_ALL_TOPICS);
+    if (entry.length == 0u)
+    {
+        return false;
+    }
+
+    if (pdTRUE != xQueueSend(journal_q, &entry, 0))
+    {
+        overflow_count++;
+        LOG_WARN("Journal: queue full, %lu records lost\n", (unsigned long)overflow_count);
+        return false;
+    }
+
+    journal_wake();
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: journal_wake
+ ******************************************************************************
+ * Summary:
+ *  Function that wakes the journal task, once it is running.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void journal_wake(void)
+{
+    if (journal_q != NULL)
+    {
+        xTaskNotifyGive(journal_task_handle);
+    }
+}
+
+/******************************************************************************
+ * Function Name: journal_open
+ ******************************************************************************
+ * Summary:
+ *  Function that places the journal region at the end of the external
+ *  flash, checks it against the XIP image and the erase sectors, computes
+ *  the geometry of the journal and restores the write and read positions
+ *  by scanning the slot headers. A region without records, as after the
+ *  first programming, is erased ahead of the writer.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  bool : true if the journal is usable, else false
+ *
+ ******************************************************************************/
+static bool journal_open(void)
+{
+    journal_slot_header_t header;
+    bool found = false;
+    uint32_t newest_sector = 0;
+    uint32_t oldest_sector = 0;
+    uint32_t newest_sequence = 0;
+    uint32_t oldest_sequence = 0;
+    size_t flash_size = cy_serial_flash_qspi_get_size();
+
+    /* The region is the end of the flash and must not overlap the data
+     * the application image places in the XIP section.
+     */
+    if (flash_size < JOURNAL_FLASH_SIZE)
+    {
+        return false;
+    }
+    journal_base = (uint32_t)(flash_size - JOURNAL_FLASH_SIZE);
+    if (((uintptr_t)__cy_xip_end > CY_XIP_BASE) &&
+        (((uintptr_t)__cy_xip_end - CY_XIP_BASE) > journal_base))
+    {
+        printf("Journal: XIP image overlaps the journal region!\n");
+        return false;
+    }
+
+    sector_size = cy_serial_flash_qspi_get_erase_size(journal_base);
+    if ((sector_size == 0u) || ((sector_size % JOURNAL_SLOT_SIZE) != 0u) ||
+        ((journal_base % sector_size) != 0u) || ((JOURNAL_FLASH_SIZE % sector_size) != 0u))
+    {
+        return false;
+    }
+    sector_count = JOURNAL_FLASH_SIZE / sector_size;
+    slots_per_sector = sector_size / JOURNAL_SLOT_SIZE;
+    if (sector_count < JOURNAL_MIN_SECTORS)
+    {
+        return false;
+    }
+
+    /* The first slot of every sector in use tells its age. */
+    for (uint32_t sector = 0; sector < sector_count; sector++)
+    {
+        journal_position_t position = { sector, 0 };
+
+        if (!read_header(position, &header) || !slot_is_record(&header))
+        {
+            continue;
+        }
+        if (!found || ((int32_t)(header.sequence - newest_sequence) > 0))
+        {
+            newest_sequence = header.sequence;
+            newest_sector = sector;
+        }
+        if (!found || ((int32_t)(header.sequence - oldest_sequence) < 0))
+        {
+            oldest_sequence = header.sequence;
+            oldest_sector = sector;
+        }
+        found = true;
+    }
+
+    if (!found)
+    {
+        write_pos = (journal_position_t){ 0, 0 };
+        read_pos = write_pos;
+        next_sequence = 0;
+        prepare_sector(0);
+        prepare_sector(1);
+        return true;
+    }
+
+    /* The write position is the first free slot of the newest sector. */
+    write_pos = (journal_position_t){ newest_sector, 0 };
+    next_sequence = newest_sequence + 1u;
+    do
+    {
+        if (!read_header(write_pos, &header))
+        {
+            return false;
+        }
+        if (slot_is_free(&header))
+        {
+            break;
+        }
+        if (slot_is_record(&header))
+        {
+            next_sequence = header.sequence + 1u;
+        }
+        write_pos = next_position(write_pos);
+    } while (write_pos.slot != 0u);
+
+    if (write_pos.slot == 0u)
+    {
+        prepare_sector(write_pos.sector);
+    }
+    prepare_sector((write_pos.sector + 1u) % sector_count);
+
+    /* Records are consumed in order, so a sector whose last slot is consumed
+     * is skipped as a whole.
+     */
+    read_pos = (journal_position_t){ oldest_sector, 0 };
+    while (!same_position(read_pos, write_pos))
+    {
+        journal_position_t last = { read_pos.sector, slots_per_sector - 1u };
+
+        if ((read_pos.slot == 0u) && (read_pos.sector != write_pos.sector) &&
+            read_header(last, &header) && slot_is_record(&header) &&
+            (header.state == SLOT_CONSUMED))
+        {
+            read_pos = (journal_position_t){ (read_pos.sector + 1u) % sector_count, 0 };
+            continue;
+        }
+        if (!read_header(read_pos, &header))
+        {
+            return false;
+        }
+        if (slot_is_record(&header) && (header.state == SLOT_PENDING))
+        {
+            break;
+        }
+        read_pos = next_position(read_pos);
+    }
+
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: journal_write
+ ******************************************************************************
+ * Summary:
+ *  Function that writes one record to the next free slot. The slot is
+ *  programmed with its magic byte left erased, which is programmed last to
+ *  commit it. Entering a new sector erases the sector after it.
+ *
+ * Parameters:
+ *  const journal_entry_t *entry : Encoded record
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void journal_write(const journal_entry_t *entry)
+{
+    static uint8_t slot[JOURNAL_SLOT_SIZE];
+    journal_slot_header_t header =
+    {
+        .magic = SLOT_ERASED,
+        .state = SLOT_PENDING,
+        .length = entry->length,
+        .topics = entry->topics,
+        .sequence = next_sequence
+    };
+    uint8_t magic = SLOT_MAGIC;
+    uint32_t address = slot_address(write_pos);
+
+    memcpy(slot, &header, SLOT_HEADER_SIZE);
+    memcpy(&slot[SLOT_HEADER_SIZE], entry->data, entry->length);
+
+    if ((CY_RSLT_SUCCESS != flash_write(address, SLOT_HEADER_SIZE + entry->length, slot)) ||
+        (CY_RSLT_SUCCESS != flash_write(address, 1u, &magic)))
+    {
+        LOG_ERROR("Journal: write failed at 0x%08lx\n", (unsigned long)address);
+    }
+    else
+    {
+        next_sequence++;
+        stored_count++;
+    }
+
+    /* A failed slot is skipped; it is never taken for a record. */
+    write_pos = next_position(write_pos);
+    if (write_pos.slot == 0u)
+    {
+        prepare_sector((write_pos.sector + 1u) % sector_count);
+    }
+}
+
+/******************************************************************************
+ * Function Name: journal_drain
+ ******************************************************************************
+ * Summary:
+ *  Function that reads the oldest pending records and hands them to the
+ *  publisher on the bulk lane, as many as fit in one payload, on every
+ *  telemetry topic they were journaled for. The publisher shapes them with the rate limit of the
+ *  topics and publishes them behind the live messages; drain_finish() marks
+ *  them as consumed once all publishes have completed.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void journal_drain(void)
+{
+    static telemetry_record_t records[JOURNAL_DRAIN_BATCH];
+    static telemetry_record_t selected[JOURNAL_DRAIN_BATCH];
+    static uint8_t payload[SLOT_PAYLOAD_SIZE];
+    journal_position_t position = read_pos;
+    journal_slot_header_t header;
+    size_t length;
+    uint32_t count = 0;
+
+    while ((count < JOURNAL_DRAIN_BATCH) && !same_position(position, write_pos))
+    {
+        if (read_header(position, &header) && slot_is_record(&header) &&
+            (header.state == SLOT_PENDING) &&
+            (CY_RSLT_SUCCESS == flash_read(slot_address(position) + SLOT_HEADER_SIZE,
+                                           header.length, payload)) &&
+            (telemetry_codec_decode(payload, header.length, &records[count]) == header.length))
+        {
+            drain.positions[count] = position;
+            drain.sequences[count] = header.sequence;
+            drain.topics[count++] = header.topics;
+        }
+        position = next_position(position);
+    }
+
+    if (count == 0u)
+    {
+        /* Only unreadable or already consumed slots were left. */
+        read_pos = position;
+        return;
+    }
+
+    /* Drain the records up to the first one that does not fit in the
+     * payload of one of its topics.
+     */
+    for (uint32_t i = 0; i < telemetry_topic_count; i++)
+    {
+        uint32_t topic_count;
+        uint32_t fit;
+        uint32_t seen = 0;
+        uint32_t limit;
+
+        if (telemetry_topics[i].encoding == MQTT_ENCODING_NONE)
+        {
+            continue;
+        }
+
+        topic_count = drain_select(i, records, count, selected);
+        fit = drain_build(telemetry_topics[i].encoding, selected, topic_count,
+                          drain_payloads[i], &length);
+        if (fit == topic_count)
+        {
+            continue;
+        }
+
+        for (limit = 0; limit < count; limit++)
+        {
+            if ((drain.topics[limit] & (1u << i)) != 0u)
+            {
+                if (seen == fit)
+                {
+                    break;
+                }
+                seen++;
+            }
+        }
+        count = limit;
+    }
+
+    if (count == 0u)
+    {
+        /* The oldest record does not fit in a publish by itself, so it
+         * would block the journal forever. It is skipped and counted.
+         */
+        uint8_t state = SLOT_CONSUMED;
+
+        flash_write(slot_address(drain.positions[0]) + SLOT_STATE_OFFSET, 1u, &state);
+        read_pos = next_position(drain.positions[0]);
+        skipped_count++;
+        LOG_WARN("Journal: record %lu too large to publish, skipped (%lu times)\n",
+                 (unsigned long)drain.sequences[0], (unsigned long)skipped_count);
+        return;
+    }
+
+    drain.count = count;
+    drain.start = read_pos;
+    drain.published = 0;
+    drain.failed = false;
+
+    for (uint32_t i = 0; i < telemetry_topic_count; i++)
+    {
+        /* The records were captured long ago, so the drain carries no
+         * capture time for the latency probes.
+         */
+        publisher_data_t publisher_q_data =
+        {
+            .cmd = PUBLISH_MQTT_MSG,
+            .topic = telemetry_topics[i].topic,
+            .data = drain_payloads[i],
+            .timestamp_us = 0,
+            .complete = drain_complete
+        };
+        uint32_t topic_count;
+
+        if (telemetry_topics[i].encoding == MQTT_ENCODING_NONE)
+        {
+            continue;
+        }
+
+        topic_count = drain_select(i, records, count, selected);
+        if (topic_count == 0u)
+        {
+            continue;
+        }
+
+        drain_build(telemetry_topics[i].encoding, selected, topic_count, drain_payloads[i], &length);
+        publisher_q_data.length = (telemetry_topics[i].encoding == MQTT_ENCODING_TEXT) ? 0u : length;
+
+        taskENTER_CRITICAL();
+        drain.pending++;
+        taskEXIT_CRITICAL();
+
+        if (!publisher_send(&publisher_q_data, PUBLISHER_LANE_BULK, 0))
+        {
+            /* The records stay pending and are drained again later. */
+            taskENTER_CRITICAL();
+            drain.pending--;
+            drain.failed = true;
+            taskEXIT_CRITICAL();
+            break;
+        }
+    }
+}
+
+/******************************************************************************
+ * Function Name: drain_finish
+ ******************************************************************************
+ * Summary:
+ *  Function that ends the drain once the publisher has completed all of
+ *  its publishes. The topics that were published are cleared from the slot
+ *  of every record, unless the journal overwrote it in the meantime, so a
+ *  retry only publishes the records on the topics that failed. A record
+ *  left without topics is marked as consumed; if all publishes succeeded,
+ *  the read position moves past the drain.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  bool : false if a publish of the drain failed, else true
+ *
+ ******************************************************************************/
+static bool drain_finish(void)
+{
+    journal_slot_header_t header;
+    uint32_t count = drain.count;
+    uint32_t done = drain.published;
+
+    drain.count = 0;
+
+    /* Topics that are not published at all never hold a record back. */
+    for (uint32_t i = 0; i < telemetry_topic_count; i++)
+    {
+        if (telemetry_topics[i].encoding == MQTT_ENCODING_NONE)
+        {
+            done |= (1u << i);
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint8_t state = SLOT_CONSUMED;
+        uint8_t topics = (uint8_t)(drain.topics[i] & ~done);
+
+        /* A slot erased since the drain started may hold a newer record. */
+        if (!read_header(drain.positions[i], &header) || !slot_is_record(&header) ||
+            (header.sequence != drain.sequences[i]))
+        {
+            continue;
+        }
+
+        if (topics == 0u)
+        {
+            flash_write(slot_address(drain.positions[i]) + SLOT_STATE_OFFSET, 1u, &state);
+        }
+        else if (topics != header.topics)
+        {
+            /* The flash only clears bits, so the published topics are
+             * removed from the header in place.
+             */
+            flash_write(slot_address(drain.positions[i]) + SLOT_TOPICS_OFFSET, 1u, &topics);
+        }
+    }
+
+    if (drain.failed)
+    {
+        LOG_WARN("Journal: publish failed, retrying later\n");
+        return false;
+    }
+
+    if (same_position(read_pos, drain.start))
+    {
+        read_pos = next_position(drain.positions[count - 1u]);
+    }
+    drained_count += count;
+
+    LOG_INFO("Journal: published %lu journaled records (%lu stored, %lu overwritten)\n",
+             (unsigned long)drained_count, (unsigned long)stored_count,
+             (unsigned long)overwritten_count);
+
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: drain_complete
+ ******************************************************************************
+ * Summary:
+ *  Publisher completion callback for the drain publishes. It records the
+ *  topic of the payload as published or the drain as failed, counts the
+ *  publish as done and wakes the journal task.
+ *
+ * Parameters:
+ *  char *data : Drain payload of one topic
+ *  bool published : true if the broker acknowledged the publish
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void drain_complete(char *data, bool published)
+{
+    uint32_t topic = 0;
+
+    for (uint32_t i = 0; i < telemetry_topic_count; i++)
+    {
+        if (data == drain_payloads[i])
+        {
+            topic = (1u << i);
+        }
+    }
+
+    taskENTER_CRITICAL();
+    if (published)
+    {
+        drain.published |= topic;
+    }
+    drain.failed = drain.failed || !published;
+    drain.pending--;
+    taskEXIT_CRITICAL();
+
+    xTaskNotifyGive(journal_task_handle);
+}
+
+/******************************************************************************
+ * Function Name: drain_select
+ ******************************************************************************
+ * Summary:
+ *  Function that picks the records of the drain that are journaled for a
+ *  topic.
+ *
+ * Parameters:
+ *  uint32_t topic : Index of the topic in telemetry_topics[]
+ *  const telemetry_record_t *records : First records of the drain
+ *  uint32_t count : Number of records
+ *  telemetry_record_t *selected : Records for the topic, in order
+ *
+ * Return:
+ *  uint32_t : Number of records for the topic
+ *
+ ******************************************************************************/
+static uint32_t drain_select(uint32_t topic, const telemetry_record_t *records,
+                             uint32_t count, telemetry_record_t *selected)
+{
+    uint32_t selected_count = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((drain.topics[i] & (1u << topic)) != 0u)
+        {
+            selected[selected_count++] = records[i];
+        }
+    }
+
+    return selected_count;
+}
+
+/******************************************************************************
+ * Function Name: drain_build
+ ******************************************************************************
+ * Summary:
+ *  Function that encodes records into a drain payload, as many as fit.
+ *  Text records are separated by a newline; binary records are
+ *  self-delimiting and are concatenated, or delta encoded as one batch if
+ *  'MQTT_BINARY_DELTA_BATCHES' is set.
+ *
+ * Parameters:
+ *  uint32_t encoding : Encoding of the topic
+ *  const telemetry_record_t *records : Records to encode
+ *  uint32_t count : Number of records
+ *  char *payload : Drain payload of PUBLISHER_BATCH_MAX_SIZE + 1 bytes
+ *  size_t *length : Length of the payload
+ *
+ * Return:
+ *  uint32_t : Number of records in the payload
+ *
+ ******************************************************************************/
+static uint32_t drain_build(uint32_t encoding, const telemetry_record_t *records,
+                            uint32_t count, char *payload, size_t *length)
+{
+    static char encoded[TELEMETRY_MSG_MAX_LEN];
+    uint32_t built = 0;
+
+    *length = 0;
+#if MQTT_BINARY_DELTA_BATCHES
+    if (encoding == MQTT_ENCODING_BINARY)
+    {
+        static telemetry_delta_t state;
+        uint8_t *delta = (uint8_t *)payload;
+
+        *length = telemetry_delta_begin(&state, delta, PUBLISHER_BATCH_MAX_SIZE);
+        for (; built < count; built++)
+        {
+            size_t size = telemetry_delta_encode(&state, &records[built], &delta[*length],
+                                                 PUBLISHER_BATCH_MAX_SIZE - *length);
+            if (size == 0u)
+            {
+                break;
+            }
+            *length += size;
+        }
+        return built;
+    }
+#endif
+
+    for (; built < count; built++)
+    {
+        size_t size = telemetry_encode(&records[built], encoding, encoded, sizeof(encoded));
+        size_t separator = ((encoding == MQTT_ENCODING_TEXT) && (built > 0u)) ? 1u : 0u;
+
+        if ((size == 0u) || ((*length + separator + size) > PUBLISHER_BATCH_MAX_SIZE))
+        {
+            break;
+        }
+        if (separator != 0u)
+        {
+            payload[(*length)++] = '\n';
+        }
+        memcpy(&payload[*length], encoded, size);
+        *length += size;
+    }
+    payload[*length] = '\0';
+
+    return built;
+}
+
+/******************************************************************************
+ * Function Name: prepare_sector
+ ******************************************************************************
+ * Summary:
+ *  Function that erases a sector ahead of the write position unless it is
+ *  already erased. Records in it that were not published yet are lost; the
+ *  read position moves past them.
+ *
+ * Parameters:
+ *  uint32_t sector : Sector to erase
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void prepare_sector(uint32_t sector)
+{
+    journal_slot_header_t header;
+    journal_position_t first = { sector, 0 };
+
+    if (read_header(first, &header) && slot_is_free(&header))
+    {
+        return;
+    }
+
+    if ((read_pos.sector == sector) && !same_position(read_pos, write_pos))
+    {
+        overwritten_count += slots_per_sector - read_pos.slot;
+        read_pos = (journal_position_t){ (sector + 1u) % sector_count, 0 };
+        LOG_WARN("Journal: full, oldest records overwritten\n");
+    }
+
+    if (CY_RSLT_SUCCESS != flash_erase(journal_base + (sector * sector_size), sector_size))
+    {
+        LOG_ERROR("Journal: erase failed for sector %lu\n", (unsigned long)sector);
+    }
+}
+
+/******************************************************************************
+ * Function Name: flash_read
+ ******************************************************************************
+ * Summary:
+ *  Function that reads from the external flash. XIP is off for the access,
+ *  as the serial flash commands need the QSPI block in command mode.
+ *
+ * Parameters:
+ *  uint32_t address : Address in the external flash
+ *  size_t length : Number of bytes to read
+ *  uint8_t *data : Bytes read
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code
+ *
+ ******************************************************************************/
+static cy_rslt_t flash_read(uint32_t address, size_t length, uint8_t *data)
+{
+    cy_rslt_t result;
+
+    cy_serial_flash_qspi_enable_xip(false);
+    result = cy_serial_flash_qspi_read(address, length, data);
+    cy_serial_flash_qspi_enable_xip(true);
+
+    return result;
+}
+
+/******************************************************************************
+ * Function Name: flash_write
+ ******************************************************************************
+ * Summary:
+ *  Function that programs the external flash with XIP off.
+ *
+ * Parameters:
+ *  uint32_t address : Address in the external flash
+ *  size_t length : Number of bytes to program
+ *  const uint8_t *data : Bytes to program
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code
+ *
+ ******************************************************************************/
+static cy_rslt_t flash_write(uint32_t address, size_t length, const uint8_t *data)
+{
+    cy_rslt_t result;
+
+    cy_serial_flash_qspi_enable_xip(false);
+    result = cy_serial_flash_qspi_write(address, length, data);
+    cy_serial_flash_qspi_enable_xip(true);
+
+    return result;
+}
+
+/******************************************************************************
+ * Function Name: flash_erase
+ ******************************************************************************
+ * Summary:
+ *  Function that erases sectors of the external flash with XIP off.
+ *
+ * Parameters:
+ *  uint32_t address : Address of the first sector
+ *  size_t length : Number of bytes to erase, a multiple of the sector size
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code
+ *
+ ******************************************************************************/
+static cy_rslt_t flash_erase(uint32_t address, size_t length)
+{
+    cy_rslt_t result;
+
+    cy_serial_flash_qspi_enable_xip(false);
+    result = cy_serial_flash_qspi_erase(address, length);
+    cy_serial_flash_qspi_enable_xip(true);
+
+    return result;
+}
+
+/******************************************************************************
+ * Function Name: read_header
+ ******************************************************************************
+ * Summary:
+ *  Function that reads the header of a slot.
+ *
+ * Parameters:
+ *  journal_position_t position : Slot to read
+ *  journal_slot_header_t *header : Header read
+ *
+ * Return:
+ *  bool : true if the header was read, else false
+ *
+ ******************************************************************************/
+static bool read_header(journal_position_t position, journal_slot_header_t *header)
+{
+    return (CY_RSLT_SUCCESS == flash_read(slot_address(position), SLOT_HEADER_SIZE,
+                                                         (uint8_t *)header));
+}
+
+/******************************************************************************
+ * Function Name: slot_is_free
+ ******************************************************************************
+ * Summary:
+ *  Function that tells whether a slot is erased and can be written. A slot
+ *  whose write was interrupted has an erased magic byte but not an erased
+ *  length, and is not free.
+ *
+ * Parameters:
+ *  const journal_slot_header_t *header : Header of the slot
+ *
+ * Return:
+ *  bool : true if the slot is free
+ *
+ ******************************************************************************/
+static bool slot_is_free(const journal_slot_header_t *header)
+{
+    return ((header->magic == SLOT_ERASED) && (header->length == SLOT_LENGTH_ERASED));
+}
+
+/******************************************************************************
+ * Function Name: slot_is_record
+ ******************************************************************************
+ * Summary:
+ *  Function that tells whether a slot holds a committed record.
+ *
+ * Parameters:
+ *  const journal_slot_header_t *header : Header of the slot
+ *
+ * Return:
+ *  bool : true if the slot holds a record
+ *
+ ******************************************************************************/
+static bool slot_is_record(const journal_slot_header_t *header)
+{
+    return ((header->magic == SLOT_MAGIC) && (header->length <= SLOT_PAYLOAD_SIZE));
+}
+
+/******************************************************************************
+ * Function Name: slot_address
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the flash address of a slot.
+ *
+ * Parameters:
+ *  journal_position_t position : Slot
+ *
+ * Return:
+ *  uint32_t : Address in the external flash
+ *
+ ******************************************************************************/
+static uint32_t slot_address(journal_position_t position)
+{
+    return journal_base + (position.sector * sector_size) + (position.slot * JOURNAL_SLOT_SIZE);
+}
+
+/******************************************************************************
+ * Function Name: next_position
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the slot after a slot, wrapping around the ring.
+ *
+ * Parameters:
+ *  journal_position_t position : Slot
+ *
+ * Return:
+ *  journal_position_t : Next slot
+ *
+ ******************************************************************************/
+static journal_position_t next_position(journal_position_t position)
+{
+    if (++position.slot == slots_per_sector)
+    {
+        position.slot = 0;
+        position.sector = (position.sector + 1u) % sector_count;
+    }
+    return position;
+}
+
+/******************************************************************************
+ * Function Name: same_position
+ ******************************************************************************
+ * Summary:
+ *  Function that compares two slot positions.
+ *
+ * Parameters:
+ *  journal_position_t a : First slot
+ *  journal_position_t b : Second slot
+ *
+ * Return:
+ *  bool : true if both are the same slot
+ *
+ ******************************************************************************/
+static bool same_position(journal_position_t a, journal_position_t b)
+{
+    return ((a.sector == b.sector) && (a.slot == b.slot));
+}
+
+#else
+
+/******************************************************************************
+ * Function Name: journal_set_online
+ ******************************************************************************
+ * Summary:
+ *  Function that tells the journal whether the MQTT connection is up. There
+ *  is no journal on this kit, so it has no effect.
+ *
+ * Parameters:
+ *  bool online : true if the MQTT connection is up
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void journal_set_online(bool online)
+{
+    (void) online;
+}
+
+/******************************************************************************
+ * Function Name: journal_append
+ ******************************************************************************
+ * Summary:
+ *  Function that takes a telemetry record while the MQTT connection is down.
+ *  There is no journal on this kit, so records are always published
+ *  directly.
+ *
+ * Parameters:
+ *  const telemetry_record_t *record : Record to journal
+ *
+ * Return:
+ *  bool : false, the record must be published directly
+ *
+ ******************************************************************************/
+bool journal_append(const telemetry_record_t *record)
+{
+    (void) record;
+    return false;
+}
+
+/******************************************************************************
+ * Function Name: journal_store
+ ******************************************************************************
+ * Summary:
+ *  Function that takes a telemetry record whatever the connection state.
+ *  There is no journal on this kit, so it never takes the record.
+ *
+ * Parameters:
+ *  const telemetry_record_t *record : Record to journal
+ *  uint32_t topics : Topics to publish the record on (unused)
+ *
+ * Return:
+ *  bool : false, the record is not journaled
+ *
+ ******************************************************************************/
+bool journal_store(const telemetry_record_t *record, uint32_t topics)
+{
+    (void) record;
+    (void) topics;
+    return false;
+}
+
+#endif /* JOURNAL_ENABLE */
+
+/* [] END OF FILE */
@@ -0,0 +1,75 @@
+/******************************************************************************
+* File Name:   journal.h
+*
+* Description: This file is the public interface of journal.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "telemetry_codec.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* The journal is kept in the external QSPI NOR flash, which is only set up on
+ * the kits that load the Wi-Fi firmware from it. On the other kits records
+ * produced while disconnected are not journaled.
+ */
+#if defined(CY_DEVICE_PSOC6A512K)
+#define JOURNAL_ENABLE                      (1)
+#else
+#define JOURNAL_ENABLE                      (0)
+#endif
+
+/* Task parameters for the journal task. */
+#define JOURNAL_TASK_PRIORITY               (1)
+#define JOURNAL_TASK_STACK_SIZE             (1024 * 2)
+
+/* Size in bytes of the journal region at the end of the external flash. It
+ * must be a multiple of the erase sector, hold at least three sectors and
+ * stay clear of the XIP image, which journal.c checks at startup.
+ */
+#define JOURNAL_FLASH_SIZE                  (4lu * 1024lu * 1024lu)
+
+/* Size in bytes of one journal slot. Slots never cross a program page and
+ * hold one encoded telemetry record each.
+ */
+#define JOURNAL_SLOT_SIZE                   (128u)
+
+/* Number of records waiting to be written to the flash. */
+#define JOURNAL_QUEUE_LENGTH                (8u)
+
+/* Largest number of records published together when draining. */
+#define JOURNAL_DRAIN_BATCH                 (8u)
+
+/* Interval in milliseconds at which the journal task checks whether it can
+ * drain, and the time it waits after a failed drain publish.
+ */
+#define JOURNAL_POLL_INTERVAL_MS            (1000u)
+
+/*******************************************************************************
+* Extern Variables
+********************************************************************************/
+extern TaskHandle_t journal_task_handle;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void journal_task(void *pvParameters);
+void journal_set_online(bool online);
+bool journal_append(const telemetry_record_t *record);
+bool journal_store(const telemetry_record_t *record, uint32_t topics);
+
+#endif /* JOURNAL_H_ */
+
+/* [] END OF FILE */
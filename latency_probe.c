@@ -0,0 +1,255 @@
+/******************************************************************************
+* File Name:   latency_probe.c
+*
+* Description: This file contains the latency probes of the publish path.
+*              Every message is timestamped with the device clock when it
+*              is captured, enqueued for the publisher, taken by the
+*              publisher, published and acknowledged; the time spent in
+*              each stage is counted in a log2 histogram. The histograms
+*              are exported and cleared periodically on the diagnostics
+*              topic, one text message per stage:
+*
+*                stage=queue::n=120::max_us=5230::b=4::h=3,10,52,40,15
+*
+*              'b' is the bucket of the first count in 'h'; empty buckets
+*              before and after are left out.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cyhal.h"
+#include "cy_retarget_io.h"
+
+#include "latency_probe.h"
+#include "publisher_task.h"
+#include "message_pool.h"
+#include "mqtt_client_config.h"
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void export_histogram(latency_stage_t stage, const latency_histogram_t *histogram);
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* FreeRTOS task handle for this task. */
+TaskHandle_t latency_probe_task_handle;
+
+/* Histograms of the current export interval. */
+static latency_histogram_t histograms[LATENCY_STAGE_COUNT];
+
+/* Names of the stages in the exported messages. */
+static const char *const stage_names[LATENCY_STAGE_COUNT] =
+{
+    [LATENCY_STAGE_CAPTURE] = "capture",
+    [LATENCY_STAGE_QUEUE] = "queue",
+    [LATENCY_STAGE_DISPATCH] = "dispatch",
+    [LATENCY_STAGE_PUBLISH] = "publish",
+    [LATENCY_STAGE_END_TO_END] = "e2e"
+};
+
+/******************************************************************************
+ * Function Name: latency_probe_task
+ ******************************************************************************
+ * Summary:
+ *  Task that exports the histograms of every stage on the diagnostics topic
+ *  and clears them, every 'LATENCY_PROBE_EXPORT_INTERVAL_MS'.
+ *
+ * Parameters:
+ *  void *pvParameters : Task parameter defined during task creation (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void latency_probe_task(void *pvParameters)
+{
+    static latency_histogram_t snapshot[LATENCY_STAGE_COUNT];
+    TickType_t last_wake = xTaskGetTickCount();
+
+    (void) pvParameters;
+
+    while (true)
+    {
+        uint32_t saved_intr;
+
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(LATENCY_PROBE_EXPORT_INTERVAL_MS));
+
+        saved_intr = cyhal_system_critical_section_enter();
+        memcpy(snapshot, histograms, sizeof(snapshot));
+        memset(histograms, 0, sizeof(histograms));
+        cyhal_system_critical_section_exit(saved_intr);
+
+        for (uint32_t stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+        {
+            if (snapshot[stage].count > 0u)
+            {
+                export_histogram((latency_stage_t)stage, &snapshot[stage]);
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * Function Name: latency_probe_record
+ ******************************************************************************
+ * Summary:
+ *  Function that counts the time a message spent in a stage. Probes whose
+ *  start time is unknown (0) are ignored. It can be called from tasks and
+ *  interrupts.
+ *
+ * Parameters:
+ *  latency_stage_t stage : Stage
+ *  uint64_t start_us : Device clock time at which the stage started
+ *  uint64_t end_us : Device clock time at which the stage ended
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void latency_probe_record(latency_stage_t stage, uint64_t start_us, uint64_t end_us)
+{
+#if LATENCY_PROBE_ENABLE
+    uint64_t latency_us;
+    uint32_t saved_intr;
+
+    if ((stage >= LATENCY_STAGE_COUNT) || (start_us == 0u) || (end_us < start_us))
+    {
+        return;
+    }
+    latency_us = end_us - start_us;
+
+    saved_intr = cyhal_system_critical_section_enter();
+    latency_histogram_add(&histograms[stage],
+                          (latency_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency_us);
+    cyhal_system_critical_section_exit(saved_intr);
+#else
+    (void) stage;
+    (void) start_us;
+    (void) end_us;
+#endif /* LATENCY_PROBE_ENABLE */
+}
+
+/******************************************************************************
+ * Function Name: latency_histogram_add
+ ******************************************************************************
+ * Summary:
+ *  Function that counts one latency in a histogram.
+ *
+ * Parameters:
+ *  latency_histogram_t *histogram : Histogram
+ *  uint32_t latency_us : Latency in microseconds
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void latency_histogram_add(latency_histogram_t *histogram, uint32_t latency_us)
+{
+    histogram->bucket[latency_histogram_bucket(latency_us)]++;
+    histogram->count++;
+    if (latency_us > histogram->max_us)
+    {
+        histogram->max_us = latency_us;
+    }
+}
+
+/******************************************************************************
+ * Function Name: latency_histogram_bucket
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the histogram bucket of a latency, the number of
+ *  significant bits of the latency capped to the last bucket.
+ *
+ * Parameters:
+ *  uint32_t latency_us : Latency in microseconds
+ *
+ * Return:
+ *  uint32_t : Bucket index
+ *
+ ******************************************************************************/
+uint32_t latency_histogram_bucket(uint32_t latency_us)
+{
+    uint32_t bucket = 0;
+
+    while ((latency_us != 0u) && (bucket < (LATENCY_PROBE_BUCKETS - 1u)))
+    {
+        latency_us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/******************************************************************************
+ * Function Name: export_histogram
+ ******************************************************************************
+ * Summary:
+ *  Function that formats the histogram of a stage and hands it to the
+ *  publisher on the bulk lane. If the message buffer is too small for all
+ *  buckets, the longest latencies are left out of 'h' but still show in
+ *  'max_us'.
+ *
+ * Parameters:
+ *  latency_stage_t stage : Stage
+ *  const latency_histogram_t *histogram : Histogram of the stage
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void export_histogram(latency_stage_t stage, const latency_histogram_t *histogram)
+{
+    publisher_data_t publisher_q_data;
+    uint32_t first = 0;
+    uint32_t last = LATENCY_PROBE_BUCKETS - 1u;
+    char *msg;
+    int length;
+
+    while (histogram->bucket[first] == 0u)
+    {
+        first++;
+    }
+    while (histogram->bucket[last] == 0u)
+    {
+        last--;
+    }
+
+    msg = message_pool_acquire(0);
+    if (msg == NULL)
+    {
+        return;
+    }
+
+    length = snprintf(msg, MESSAGE_POOL_BUFFER_SIZE, "stage=%s::n=%lu::max_us=%lu::b=%lu::h=",
+                      stage_names[stage], (unsigned long)histogram->count,
+                      (unsigned long)histogram->max_us, (unsigned long)first);
+    for (uint32_t i = first; (i <= last) && (length > 0) && (length < (int)MESSAGE_POOL_BUFFER_SIZE); i++)
+    {
+        int added = snprintf(&msg[length], MESSAGE_POOL_BUFFER_SIZE - (size_t)length,
+                             (i == first) ? "%lu" : ",%lu", (unsigned long)histogram->bucket[i]);
+
+        if ((added < 0) || ((length + added) >= (int)MESSAGE_POOL_BUFFER_SIZE))
+        {
+            /* Keep the buckets that fitted completely. */
+            msg[length] = '\0';
+            break;
+        }
+        length += added;
+    }
+
+    publisher_q_data.cmd = PUBLISH_MQTT_MSG;
+    publisher_q_data.topic = MQTT_PUB_DIAG_TOPIC;
+    publisher_q_data.data = msg;
+    publisher_q_data.length = 0;
+    publisher_q_data.timestamp_us = 0;
+    publisher_q_data.complete = NULL;
+    publisher_enqueue(&publisher_q_data, PUBLISHER_LANE_BULK);
+}
+
+/* [] END OF FILE */
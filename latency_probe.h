@@ -0,0 +1,81 @@
+/******************************************************************************
+* File Name:   latency_probe.h
+*
+* Description: This file is the public interface of latency_probe.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef LATENCY_PROBE_H_
+#define LATENCY_PROBE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Set this macro to 1 to measure where the time goes between a sample and
+ * the acknowledgement of its publish, and to export the histograms on
+ * MQTT_PUB_DIAG_TOPIC.
+ */
+#define LATENCY_PROBE_ENABLE                (1)
+
+/* Task parameters for the latency probe task. */
+#define LATENCY_PROBE_TASK_PRIORITY         (1)
+#define LATENCY_PROBE_TASK_STACK_SIZE       (1024 * 1)
+
+/* Interval in milliseconds at which the histograms are exported and
+ * cleared.
+ */
+#define LATENCY_PROBE_EXPORT_INTERVAL_MS    (60u * 1000u)
+
+/* Number of histogram buckets. Bucket 0 counts latencies below 1 us,
+ * bucket n those from 2^(n-1) to 2^n - 1 us and the last bucket everything
+ * longer, here from about 4 s on.
+ */
+#define LATENCY_PROBE_BUCKETS               (24u)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Stages of a message on its way from the sample to the broker. */
+typedef enum
+{
+    LATENCY_STAGE_CAPTURE,      /* Sample captured to message enqueued. */
+    LATENCY_STAGE_QUEUE,        /* Enqueued to taken by the publisher. */
+    LATENCY_STAGE_DISPATCH,     /* Taken to publish start: batching, rate
+                                 * limit and earlier publishes. */
+    LATENCY_STAGE_PUBLISH,      /* Publish start to acknowledgement. */
+    LATENCY_STAGE_END_TO_END,   /* Sample captured to acknowledgement. */
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+/* Log2 histogram of the latencies of one stage. */
+typedef struct
+{
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t bucket[LATENCY_PROBE_BUCKETS];
+} latency_histogram_t;
+
+/*******************************************************************************
+* Extern Variables
+********************************************************************************/
+extern TaskHandle_t latency_probe_task_handle;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void latency_probe_task(void *pvParameters);
+void latency_probe_record(latency_stage_t stage, uint64_t start_us, uint64_t end_us);
+void latency_histogram_add(latency_histogram_t *histogram, uint32_t latency_us);
+uint32_t latency_histogram_bucket(uint32_t latency_us);
+
+#endif /* LATENCY_PROBE_H_ */
+
+/* [] END OF FILE */
@@ -44,6 +44,10 @@
 #include "cy_retarget_io.h"
 
 #include "mqtt_task.h"
+#include "device_clock.h"
+#include "message_pool.h"
+#include "deferred_log.h"
+#include "actuator.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -88,6 +92,16 @@ int main()
     cy_retarget_io_init(CYBSP_DEBUG_UART_TX, CYBSP_DEBUG_UART_RX,
                         CY_RETARGET_IO_BAUDRATE);
 
+    /* Start the monotonic clock used to timestamp the sensor samples. */
+    result = device_clock_init();
+    CY_ASSERT(CY_RSLT_SUCCESS == result);
+
+    /* Create the pool of message buffers handed to the publisher task. */
+    if (!message_pool_init())
+    {
+        CY_ASSERT(0);
+    }
+
 #if defined(CY_DEVICE_PSOC6A512K)
     /* Initialize the QSPI serial NOR flash with clock frequency of 50 MHz. */
     const uint32_t bus_frequency = 50000000lu;
@@ -111,6 +125,14 @@ int main()
 #endif
     printf("===============================================================\n\n");
 
+    /* Create the task that prints the log records of the other tasks. */
+    xTaskCreate(deferred_log_task, "Log task", DEFERRED_LOG_TASK_STACK_SIZE,
+                NULL, DEFERRED_LOG_TASK_PRIORITY, NULL);
+
+    /* Create the task that moves the servo on remote commands. */
+    xTaskCreate(actuator_task, "Actuator task", ACTUATOR_TASK_STACK_SIZE,
+                NULL, ACTUATOR_TASK_PRIORITY, &actuator_task_handle);
+
     /* Create the MQTT Client task. */
     xTaskCreate(mqtt_client_task, "MQTT Client task", MQTT_CLIENT_TASK_STACK_SIZE,
                 NULL, MQTT_CLIENT_TASK_PRIORITY, NULL);
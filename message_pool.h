@@ -0,0 +1,39 @@
+/******************************************************************************
+* File Name:   message_pool.h
+*
+* Description: This file is the public interface of message_pool.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef MESSAGE_POOL_H_
+#define MESSAGE_POOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of message buffers in the pool. It bounds the number of messages
+ * that can be in flight between the producers and the publisher task.
+ */
+#define MESSAGE_POOL_COUNT                  (6u)
+
+/* Size in bytes of one message buffer, including the terminating null. */
+#define MESSAGE_POOL_BUFFER_SIZE            (160u)
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+bool message_pool_init(void);
+char *message_pool_acquire(TickType_t timeout);
+bool message_pool_release(char *buffer);
+uint32_t message_pool_available(void);
+
+#endif /* MESSAGE_POOL_H_ */
+
+/* [] END OF FILE */
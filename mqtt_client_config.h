@@ -69,6 +69,50 @@
 #define MQTT_PUB_TOPIC                    "jonas_UHasselt_IoT"
 #define MQTT_SUB_TOPIC                    "jonas_UHasselt_IoT_py"
 
+/* Topic under which the commands addressed to this node alone are published,
+ * one sub-topic per command. The commands on MQTT_SUB_TOPIC itself are
+ * accepted as well.
+ */
+#define MQTT_SUB_NODE_TOPIC               MQTT_SUB_TOPIC "/node1"
+
+/* Payload encodings that can be selected for the telemetry topics. */
+#define MQTT_ENCODING_NONE                ( 0 )
+#define MQTT_ENCODING_TEXT                ( 1 )
+#define MQTT_ENCODING_BINARY              ( 2 )
+
+/* Encoding of the telemetry on each publish topic. MQTT_ENCODING_TEXT is the
+ * readable "t=...::pH=7.00::Tds=250.00" format, MQTT_ENCODING_BINARY the
+ * packed records described in telemetry_codec.c, and MQTT_ENCODING_NONE
+ * publishes no telemetry on that topic.
+ */
+#define MQTT_PUB_TOPIC_ENCODING           ( MQTT_ENCODING_TEXT )
+#define MQTT_PUB_BIN_TOPIC                MQTT_PUB_TOPIC "/bin"
+#define MQTT_PUB_BIN_TOPIC_ENCODING       ( MQTT_ENCODING_NONE )
+
+/* Set to 1 to send binary payloads that hold several records, batches and
+ * journal drains, as one delta encoded batch (see telemetry_delta.c). It is
+ * several times smaller than the packed records back to back; the first
+ * payload byte tells the two formats apart.
+ */
+#define MQTT_BINARY_DELTA_BATCHES         ( 1 )
+
+/* Topic on which the publish latency histograms are exported, see
+ * latency_probe.c.
+ */
+#define MQTT_PUB_DIAG_TOPIC               MQTT_PUB_TOPIC "/diag"
+
+/* Rate limit of each publish topic, so that many devices sharing a broker
+ * keep its load predictable. A topic may publish a burst of _BURST messages
+ * and then _RATE messages per minute. Telemetry above the rate is coalesced
+ * into larger batches instead of being sent; alarms and command responses
+ * are never held back but use up the tokens of their topic. Set the rate to
+ * 0 to disable the limit of a topic.
+ */
+#define MQTT_PUB_TOPIC_RATE_PER_MIN       ( 30 )
+#define MQTT_PUB_TOPIC_BURST              ( 5 )
+#define MQTT_PUB_BIN_TOPIC_RATE_PER_MIN   ( 30 )
+#define MQTT_PUB_BIN_TOPIC_BURST          ( 5 )
+
 /* Set the QoS that is associated with the MQTT publish, and subscribe messages.
  * Valid choices are 0, 1, and 2. Other values should not be used in this macro.
  */
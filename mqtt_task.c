@@ -70,7 +70,12 @@
 /* LwIP header files */
 #include "lwip/netif.h"
 
+#include "sensor_scheduler.h"
 #include "read_sensors.h"
+#include "ultrasound.h"
+#include "telemetry.h"
+#include "journal.h"
+#include "latency_probe.h"
 
 /******************************************************************************
 * Macros
@@ -198,6 +203,16 @@ void mqtt_client_task(void *pvParameters)
     status_flag |= WCM_INITIALIZED;
     printf("\nWi-Fi Connection Manager initialized.\n");
 
+#if JOURNAL_ENABLE
+    /* Create the task that journals the telemetry in the external flash
+     * while the MQTT broker is unreachable. The WLAN firmware has been read
+     * from the external flash at this point, so nothing uses XIP while the
+     * journal programs or erases it.
+     */
+    xTaskCreate(journal_task, "Journal task", JOURNAL_TASK_STACK_SIZE,
+                NULL, JOURNAL_TASK_PRIORITY, &journal_task_handle);
+#endif
+
     /* Initiate connection to the Wi-Fi AP and cleanup if the operation fails. */
     if (CY_RSLT_SUCCESS != wifi_connect())
     {
@@ -256,7 +271,7 @@ void mqtt_client_task(void *pvParameters)
                 {
                     /* Deinit the publisher before initiating reconnections. */
                     publisher_q_data.cmd = PUBLISHER_DEINIT;
-                    xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
+                    publisher_send(&publisher_q_data, PUBLISHER_LANE_CONTROL, portMAX_DELAY);
 
                     /* Although the connection with the MQTT Broker is lost, 
                      * call the MQTT disconnect API for cleanup of threads and 
@@ -289,7 +304,7 @@ void mqtt_client_task(void *pvParameters)
 
                     /* Initialize Publisher post the reconnection. */
                     publisher_q_data.cmd = PUBLISHER_INIT;
-                    xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
+                    publisher_send(&publisher_q_data, PUBLISHER_LANE_CONTROL, portMAX_DELAY);
                     break;
                 }
 
@@ -515,13 +530,48 @@ static cy_rslt_t mqtt_connect(void)
              * MQTT connection, and return the result to the calling function.
              */
             status_flag |= MQTT_CONNECTION_SUCCESS;
-            if (pdPASS != xTaskCreate(publisher_task, "Publisher task", PUBLISHER_TASK_STACK_SIZE,
-                                          NULL, PUBLISHER_TASK_PRIORITY, &publisher_task_handle))
+
+            /* Publish telemetry directly again and drain the journal. */
+            journal_set_online(true);
+
+            /* The publisher task also keeps running across reconnections;
+             * it is re-initialized with the PUBLISHER_INIT command.
+             */
+            if ((publisher_task_handle == NULL) &&
+                (pdPASS != xTaskCreate(publisher_task, "Publisher task", PUBLISHER_TASK_STACK_SIZE,
+                                       NULL, PUBLISHER_TASK_PRIORITY, &publisher_task_handle)))
+            {
+                printf("Failed to create Publisher task!\n");
+            }
+
+            /* Sampling keeps running across reconnections, so the sensor
+             * scheduler is only created on the first successful connection.
+             */
+            if (sensor_scheduler_task_handle == NULL)
+            {
+                sensor_set_sink(&telemetry_sink);
+                sensor_register(&water_quality_sensor);
+#if SENSOR_ENABLE_ULTRASOUND
+                sensor_register(&ultrasound_sensor);
+#endif
+                if (pdPASS != xTaskCreate(sensor_scheduler_task, "Sensor scheduler task",
+                                          SENSOR_SCHEDULER_TASK_STACK_SIZE, NULL,
+                                          SENSOR_SCHEDULER_TASK_PRIORITY,
+                                          &sensor_scheduler_task_handle))
                 {
-                    printf("Failed to create Publisher task!\n");
+                    printf("Failed to create the Sensor scheduler task!\n");
                 }
-            xTaskCreate(read_sensors_task, "Sensor reading task", READ_SENSORS_TASK_STACK_SIZE,
-            NULL, READ_SENSORS_TASK_PRIORITY, NULL);
+            }
+
+#if LATENCY_PROBE_ENABLE
+            if ((latency_probe_task_handle == NULL) &&
+                (pdPASS != xTaskCreate(latency_probe_task, "Latency probe task",
+                                       LATENCY_PROBE_TASK_STACK_SIZE, NULL,
+                                       LATENCY_PROBE_TASK_PRIORITY, &latency_probe_task_handle)))
+            {
+                printf("Failed to create the Latency probe task!\n");
+            }
+#endif
             return result;
         }
 
@@ -572,6 +622,9 @@ static void mqtt_event_callback(cy_mqtt_t mqtt_handle, cy_mqtt_event_t event, vo
             /* Clear the status flag bit to indicate MQTT disconnection. */
             status_flag &= ~(MQTT_CONNECTION_SUCCESS);
 
+            /* Journal the telemetry until the connection is restored. */
+            journal_set_online(false);
+
             /* MQTT connection with the MQTT broker is broken as the client
              * is unable to communicate with the broker. Set the appropriate
              * command to be sent to the MQTT task.
@@ -43,6 +43,8 @@
 * so agrees to indemnify Cypress against all liability.
 *******************************************************************************/
 
+#include <string.h>
+
 #include "cyhal.h"
 #include "cybsp.h"
 #include "FreeRTOS.h"
@@ -51,6 +53,13 @@
 #include "publisher_task.h"
 #include "mqtt_task.h"
 #include "subscriber_task.h"
+#include "device_clock.h"
+#include "message_pool.h"
+#include "token_bucket.h"
+#include "latency_probe.h"
+#include "telemetry.h"
+#include "deferred_log.h"
+#include "telemetry_delta.h"
 
 /* Configuration file for MQTT client */
 #include "mqtt_client_config.h"
@@ -73,18 +82,47 @@
  */
 #define PUBLISH_RETRY_MS                (1000)
 
-/* Queue length of a message queue that is used to communicate with the 
- * publisher task.
- */
-#define PUBLISHER_TASK_QUEUE_LENGTH     (3u)
+/* Queue length of each priority lane of the publisher queue. */
+#define PUBLISHER_CONTROL_LANE_LENGTH   (2u)
+#define PUBLISHER_ALARM_LANE_LENGTH     (2u)
+#define PUBLISHER_RESPONSE_LANE_LENGTH  (2u)
+#define PUBLISHER_TELEMETRY_LANE_LENGTH (3u)
+#define PUBLISHER_BULK_LANE_LENGTH      (3u)
+
+#if (PUBLISHER_INFLIGHT_WINDOW != 1u)
+#error "cy_mqtt_publish() is synchronous, PUBLISHER_INFLIGHT_WINDOW must be 1"
+#endif
 
 /******************************************************************************
 * Function Prototypes
 *******************************************************************************/
 static void publisher_init(void);
 static void publisher_deinit(void);
+static bool publisher_lanes_create(void);
+static bool lane_coalesce(QueueHandle_t queue, const publisher_data_t *msg,
+                          publisher_data_t *replaced);
+static void count_outcome(publisher_lane_t lane, publisher_outcome_t outcome);
+static bool publisher_receive(publisher_data_t *msg, publisher_lane_t *lane,
+                              publisher_lane_t lane_limit, TickType_t ticks_to_wait);
+static TickType_t shape_telemetry(void);
+static TickType_t publisher_rate_delay(const char *topic);
+static void publisher_rate_take(const char *topic);
+static void rate_limits_init(void);
+static token_bucket_t *rate_bucket(const char *topic);
+static bool publish_payload(const char *topic, char *payload, size_t length,
+                            uint64_t timestamp_us, uint64_t dequeued_us,
+                            publisher_complete_t complete);
+static bool publish_message(const char *topic, const char *payload, size_t length);
+static publisher_complete_t message_complete(const publisher_data_t *msg);
+static void release_message(char *payload, bool published);
+#if PUBLISHER_ENABLE_BATCHING
+static bool batch_fits(const publisher_data_t *msg);
+static void batch_add(const publisher_data_t *msg);
+#endif /* PUBLISHER_ENABLE_BATCHING */
+static void batch_flush(void);
+static TickType_t batch_wait(void);
+static TickType_t button_debounce(void);
 static void isr_button_press(void *callback_arg, cyhal_gpio_event_t event);
-void print_heap_usage(char *msg);
 
 /******************************************************************************
 * Global Variables
@@ -92,8 +130,34 @@ void print_heap_usage(char *msg);
 /* FreeRTOS task handle for this task. */
 TaskHandle_t publisher_task_handle;
 
-/* Handle of the queue holding the commands for the publisher task */
-QueueHandle_t publisher_task_q;
+/* Queues of the priority lanes. Every message sent notifies the publisher
+ * task, which then looks at the lanes it is ready to take from.
+ */
+static QueueHandle_t publisher_lane_q[PUBLISHER_LANE_COUNT];
+static volatile bool publisher_lanes_ready;
+
+/* Queue length of each priority lane. */
+static const UBaseType_t publisher_lane_length[PUBLISHER_LANE_COUNT] =
+{
+    [PUBLISHER_LANE_CONTROL] = PUBLISHER_CONTROL_LANE_LENGTH,
+    [PUBLISHER_LANE_ALARM] = PUBLISHER_ALARM_LANE_LENGTH,
+    [PUBLISHER_LANE_RESPONSE] = PUBLISHER_RESPONSE_LANE_LENGTH,
+    [PUBLISHER_LANE_TELEMETRY] = PUBLISHER_TELEMETRY_LANE_LENGTH,
+    [PUBLISHER_LANE_BULK] = PUBLISHER_BULK_LANE_LENGTH
+};
+
+/* Overflow policy of each priority lane. */
+static const publisher_overflow_t publisher_lane_overflow[PUBLISHER_LANE_COUNT] =
+{
+    [PUBLISHER_LANE_CONTROL] = PUBLISHER_CONTROL_OVERFLOW,
+    [PUBLISHER_LANE_ALARM] = PUBLISHER_ALARM_OVERFLOW,
+    [PUBLISHER_LANE_RESPONSE] = PUBLISHER_RESPONSE_OVERFLOW,
+    [PUBLISHER_LANE_TELEMETRY] = PUBLISHER_TELEMETRY_OVERFLOW,
+    [PUBLISHER_LANE_BULK] = PUBLISHER_BULK_OVERFLOW
+};
+
+/* Number of publisher_enqueue() outcomes of each lane. */
+static uint32_t publisher_outcomes[PUBLISHER_LANE_COUNT][PUBLISHER_OUTCOME_COUNT];
 
 /* Structure to store publish message information. */
 cy_mqtt_publish_info_t publish_info =
@@ -105,6 +169,48 @@ cy_mqtt_publish_info_t publish_info =
     .dup = false
 };
 
+#if PUBLISHER_ENABLE_BATCHING && MQTT_BINARY_DELTA_BATCHES
+/* Delta encoded copy of a binary batch, see batch_flush(). */
+static uint8_t delta_buffer[PUBLISHER_BATCH_MAX_SIZE];
+#endif
+
+/* Messages coalesced into one payload, waiting to be published. */
+static struct
+{
+    const char *topic;
+    bool binary;
+    uint32_t count;
+    size_t length;
+    uint64_t timestamp_us;
+    uint64_t newest_us;
+    uint64_t dequeued_us;
+    TickType_t deadline;
+    char payload[PUBLISHER_BATCH_MAX_SIZE + 1u];
+} batch;
+
+/* Telemetry message taken from its lane but not accepted yet, because it
+ * does not fit in the batch and the batch topic is out of tokens, or because
+ * its own topic is. The telemetry lanes are not read while it is held, so
+ * their overflow policies coalesce or spill the excess.
+ */
+static publisher_data_t held_msg;
+static bool held_valid;
+
+/* Token bucket of each rate limited publish topic. */
+static struct
+{
+    const char *topic;
+    uint32_t rate_per_min;
+    uint32_t burst;
+    token_bucket_t bucket;
+} rate_limits[] =
+{
+    { .topic = MQTT_PUB_TOPIC, .rate_per_min = MQTT_PUB_TOPIC_RATE_PER_MIN,
+      .burst = MQTT_PUB_TOPIC_BURST },
+    { .topic = MQTT_PUB_BIN_TOPIC, .rate_per_min = MQTT_PUB_BIN_TOPIC_RATE_PER_MIN,
+      .burst = MQTT_PUB_BIN_TOPIC_BURST }
+};
+
 /* Structure that stores the callback data for the GPIO interrupt event. */
 cyhal_gpio_callback_data_t cb_data =
 {
@@ -112,7 +218,22 @@ cyhal_gpio_callback_data_t cb_data =
     .callback_arg = NULL
 };
 
-int number = 0;
+/* Falling edges of the user button counted by the ISR and the tick count
+ * of the last one. While the button is armed, the ISR latches the device
+ * clock time of the next edge as the time of a press.
+ */
+static volatile uint32_t button_edges;
+static volatile TickType_t button_edge_tick;
+static volatile bool button_armed = true;
+static volatile uint64_t button_press_us;
+
+/* Edges already seen by the publisher task, and the press whose bounce is
+ * still being merged into it until the end of its settle time.
+ */
+static uint32_t button_seen;
+static bool button_pending;
+static TickType_t button_deadline;
+
 /******************************************************************************
  * Function Name: publisher_task
  ******************************************************************************
@@ -120,7 +241,10 @@ int number = 0;
  *  Task that sets up the user button GPIO for the publisher and publishes 
  *  MQTT messages to the broker. The user button init and deinit operations,
  *  and the MQTT publish operation is performed based on commands sent by other
- *  tasks and callbacks over a message queue.
+ *  tasks and callbacks over the priority lanes of the publisher queue.
+ *  Telemetry and bulk messages are batched here and shaped by the token
+ *  bucket of their topic; alarms and responses are published at once. Each
+ *  publish waits for its acknowledgement, see 'PUBLISHER_INFLIGHT_WINDOW'.
  *
  * Parameters:
  *  void *pvParameters : Task parameter defined during task creation (unused)
@@ -131,13 +255,8 @@ int number = 0;
  ******************************************************************************/
 void publisher_task(void *pvParameters)
 {
-    /* Status variable */
-    cy_rslt_t result;
-
     publisher_data_t publisher_q_data;
-
-    /* Command to the MQTT client task */
-    mqtt_task_cmd_t mqtt_task_cmd;
+    publisher_lane_t lane;
 
     /* To avoid compiler warnings */
     (void) pvParameters;
@@ -145,57 +264,937 @@ void publisher_task(void *pvParameters)
     /* Initialize and set-up the user button GPIO. */
     publisher_init();
 
-    /* Create a message queue to communicate with other tasks and callbacks. */
-    publisher_task_q = xQueueCreate(PUBLISHER_TASK_QUEUE_LENGTH, sizeof(publisher_data_t));
+    /* Create the message queues to communicate with other tasks and callbacks. */
+    if (!publisher_lanes_create())
+    {
+        printf("Publisher queue creation failed!\n");
+        vTaskDelete(NULL);
+    }
     while (true)
     {
-        /* Wait for commands from other tasks and callbacks. */
-        if (pdTRUE == xQueueReceive(publisher_task_q, &publisher_q_data, portMAX_DELAY))
+        /* Publish the telemetry that is due and has tokens, then wait for
+         * commands from other tasks and callbacks, but no longer than until
+         * the next telemetry publish.
+         */
+        TickType_t wait = shape_telemetry();
+        TickType_t debounce = button_debounce();
+
+        if (debounce < wait)
+        {
+            wait = debounce;
+        }
+
+        if (!publisher_receive(&publisher_q_data, &lane,
+                               held_valid ? PUBLISHER_LANE_TELEMETRY : PUBLISHER_LANE_COUNT, wait))
         {
-            switch(publisher_q_data.cmd)
+            continue;
+        }
+
+        switch(publisher_q_data.cmd)
+        {
+            case PUBLISHER_INIT:
+            {
+                /* Initialize and set-up the user button GPIO. */
+                publisher_init();
+                break;
+            }
+
+            case PUBLISHER_DEINIT:
             {
-                case PUBLISHER_INIT:
+                /* The connection to the broker is lost, so the telemetry of
+                 * the batch and of the held message goes to the journal.
+                 */
+                if (batch.count > 0u)
                 {
-                    /* Initialize and set-up the user button GPIO. */
-                    publisher_init();
-                    break;
+                    telemetry_completed(batch.topic, batch.timestamp_us, batch.newest_us, false);
+                    batch.count = 0;
+                    batch.length = 0;
+                }
+                if (held_valid)
+                {
+                    if (held_msg.complete == NULL)
+                    {
+                        telemetry_completed(held_msg.topic, held_msg.timestamp_us,
+                                            held_msg.timestamp_us, false);
+                    }
+                    message_complete(&held_msg)(held_msg.data, false);
+                    held_valid = false;
                 }
 
-                case PUBLISHER_DEINIT:
+                /* Deinit the user button GPIO and corresponding interrupt. */
+                publisher_deinit();
+                break;
+            }
+
+            case PUBLISH_MQTT_MSG:
+            {
+                /* Telemetry is shaped before it is published. */
+                if (lane >= PUBLISHER_LANE_TELEMETRY)
                 {
-                    /* Deinit the user button GPIO and corresponding interrupt. */
-                    publisher_deinit();
+                    held_msg = publisher_q_data;
+                    held_valid = true;
                     break;
                 }
 
-                case PUBLISH_MQTT_MSG:
+                /* Alarms and responses are never held back, but they use up
+                 * the tokens of their topic.
+                 */
+                if (publisher_q_data.topic == NULL)
                 {
-                    /* Publish the data received over the message queue. */
-                    publish_info.payload = publisher_q_data.data;
-                    publish_info.payload_len = strlen(publish_info.payload);
+                    publisher_q_data.topic = MQTT_PUB_TOPIC;
+                }
+                publisher_rate_take(publisher_q_data.topic);
+                publish_payload(publisher_q_data.topic, publisher_q_data.data,
+                                publisher_q_data.length, publisher_q_data.timestamp_us,
+                                publisher_q_data.dequeued_us, message_complete(&publisher_q_data));
+                break;
+            }
+        }
+    }
+}
 
-                    printf("\nPublisher: Publishing '%s' on the topic '%s'\n",
-                           (char *) publish_info.payload, publish_info.topic);
+/******************************************************************************
+ * Function Name: publisher_send
+ ******************************************************************************
+ * Summary:
+ *  Function that queues a command or a message for the publisher task on a
+ *  priority lane.
+ *
+ * Parameters:
+ *  const publisher_data_t *msg : Command or message to queue
+ *  publisher_lane_t lane : Priority lane
+ *  TickType_t ticks_to_wait : Time to wait while the lane is full
+ *
+ * Return:
+ *  bool : true if the message was queued, else false. The caller keeps the
+ *         ownership of a message that was not queued.
+ *
+ ******************************************************************************/
+bool publisher_send(const publisher_data_t *msg, publisher_lane_t lane, TickType_t ticks_to_wait)
+{
+    publisher_data_t item = *msg;
 
-                    result = cy_mqtt_publish(mqtt_connection, &publish_info);
+    item.enqueued_us = device_clock_now_us();
+    if (!publisher_lanes_ready || (lane >= PUBLISHER_LANE_COUNT) ||
+        (pdTRUE != xQueueSend(publisher_lane_q[lane], &item, ticks_to_wait)))
+    {
+        return false;
+    }
 
-                    if (result != CY_RSLT_SUCCESS)
-                    {
-                        printf("  Publisher: MQTT Publish failed with error 0x%0X.\n\n", (int)result);
+    xTaskNotifyGive(publisher_task_handle);
+    latency_probe_record(LATENCY_STAGE_CAPTURE, item.timestamp_us, item.enqueued_us);
+    return true;
+}
 
-                        /* Communicate the publish failure with the the MQTT 
-                         * client task.
-                         */
-                        mqtt_task_cmd = HANDLE_MQTT_PUBLISH_FAILURE;
-                        xQueueSend(mqtt_task_q, &mqtt_task_cmd, portMAX_DELAY);
-                    }
+/******************************************************************************
+ * Function Name: publisher_send_from_isr
+ ******************************************************************************
+ * Summary:
+ *  Interrupt safe version of publisher_send(). It does not wait; a message
+ *  that does not fit is counted as dropped.
+ *
+ * Parameters:
+ *  const publisher_data_t *msg : Command or message to queue
+ *  publisher_lane_t lane : Priority lane
+ *  BaseType_t *higher_priority_task_woken : Set to pdTRUE if a context
+ *                                           switch is needed on exit
+ *
+ * Return:
+ *  bool : true if the message was queued, else false
+ *
+ ******************************************************************************/
+bool publisher_send_from_isr(const publisher_data_t *msg, publisher_lane_t lane,
+                             BaseType_t *higher_priority_task_woken)
+{
+    publisher_data_t item = *msg;
 
-                    print_heap_usage("publisher_task: After publishing an MQTT message");
+    item.enqueued_us = device_clock_now_us();
+    if (!publisher_lanes_ready || (lane >= PUBLISHER_LANE_COUNT) ||
+        (pdTRUE != xQueueSendFromISR(publisher_lane_q[lane], &item, higher_priority_task_woken)))
+    {
+        if (lane < PUBLISHER_LANE_COUNT)
+        {
+            count_outcome(lane, PUBLISHER_DROPPED_NEWEST);
+        }
+        return false;
+    }
+
+    vTaskNotifyGiveFromISR(publisher_task_handle, higher_priority_task_woken);
+    latency_probe_record(LATENCY_STAGE_CAPTURE, item.timestamp_us, item.enqueued_us);
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: publisher_enqueue
+ ******************************************************************************
+ * Summary:
+ *  Function that queues a message for the publisher task on a priority lane
+ *  without waiting. If the lane is full, the overflow policy of the lane
+ *  decides which message is dropped. The lane is rearranged with the
+ *  scheduler suspended, so the publisher never sees it half done.
+ *
+ * Parameters:
+ *  const publisher_data_t *msg : Message to queue. The publisher takes over
+ *                                its buffer whatever the outcome, and
+ *                                completes it if it is dropped.
+ *  publisher_lane_t lane : Priority lane
+ *
+ * Return:
+ *  publisher_outcome_t : What happened to the message
+ *
+ ******************************************************************************/
+publisher_outcome_t publisher_enqueue(const publisher_data_t *msg, publisher_lane_t lane)
+{
+    publisher_outcome_t outcome = PUBLISHER_DROPPED_NEWEST;
+    publisher_data_t item = *msg;
+    publisher_data_t dropped;
+    bool release_dropped = false;
+
+    if (!publisher_lanes_ready || (lane >= PUBLISHER_LANE_COUNT))
+    {
+        message_complete(msg)(msg->data, false);
+        return PUBLISHER_DROPPED_NEWEST;
+    }
+
+    if (publisher_send(msg, lane, 0))
+    {
+        outcome = PUBLISHER_ENQUEUED;
+    }
+    else
+    {
+        item.enqueued_us = device_clock_now_us();
+        vTaskSuspendAll();
+        switch (publisher_lane_overflow[lane])
+        {
+            case PUBLISHER_OVERFLOW_COALESCE_LATEST:
+            {
+                if (lane_coalesce(publisher_lane_q[lane], &item, &dropped))
+                {
+                    outcome = PUBLISHER_COALESCED;
+                    release_dropped = true;
                     break;
                 }
+                /* No message for the same topic, drop the oldest. */
+            }
+            /* fall through */
+            case PUBLISHER_OVERFLOW_DROP_OLDEST:
+            {
+                /* The publisher was notified of the dropped message. */
+                if (pdTRUE == xQueueReceive(publisher_lane_q[lane], &dropped, 0))
+                {
+                    release_dropped = true;
+                    if (pdTRUE == xQueueSend(publisher_lane_q[lane], &item, 0))
+                    {
+                        outcome = PUBLISHER_DROPPED_OLDEST;
+                    }
+                }
+                break;
+            }
+
+            case PUBLISHER_OVERFLOW_SPILL:
+            {
+                outcome = PUBLISHER_SPILLED;
+                break;
+            }
+
+            default:
+                break;
+        }
+        xTaskResumeAll();
+
+        if ((outcome == PUBLISHER_COALESCED) || (outcome == PUBLISHER_DROPPED_OLDEST))
+        {
+            latency_probe_record(LATENCY_STAGE_CAPTURE, item.timestamp_us, item.enqueued_us);
+        }
+    }
+
+    if (release_dropped)
+    {
+        message_complete(&dropped)(dropped.data, false);
+    }
+    if ((outcome == PUBLISHER_DROPPED_NEWEST) || (outcome == PUBLISHER_SPILLED))
+    {
+        message_complete(msg)(msg->data, false);
+    }
+    count_outcome(lane, outcome);
+
+    if (outcome != PUBLISHER_ENQUEUED)
+    {
+        LOG_WARN("Publisher: lane %u full, outcome %u (%lu times)\n", (unsigned int)lane,
+                 (unsigned int)outcome, (unsigned long)publisher_outcome_count(lane, outcome));
+    }
+
+    return outcome;
+}
+
+/******************************************************************************
+ * Function Name: publisher_outcome_count
+ ******************************************************************************
+ * Summary:
+ *  Function that returns how often publisher_enqueue() had an outcome on a
+ *  lane. Failed publisher_send_from_isr() calls count as dropped newest.
+ *
+ * Parameters:
+ *  publisher_lane_t lane : Priority lane
+ *  publisher_outcome_t outcome : Outcome
+ *
+ * Return:
+ *  uint32_t : Number of messages with this outcome
+ *
+ ******************************************************************************/
+uint32_t publisher_outcome_count(publisher_lane_t lane, publisher_outcome_t outcome)
+{
+    if ((lane >= PUBLISHER_LANE_COUNT) || (outcome >= PUBLISHER_OUTCOME_COUNT))
+    {
+        return 0;
+    }
+    return publisher_outcomes[lane][outcome];
+}
+
+/******************************************************************************
+ * Function Name: count_outcome
+ ******************************************************************************
+ * Summary:
+ *  Function that counts an enqueue outcome. It can be called from tasks and
+ *  interrupts.
+ *
+ * Parameters:
+ *  publisher_lane_t lane : Priority lane
+ *  publisher_outcome_t outcome : Outcome
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void count_outcome(publisher_lane_t lane, publisher_outcome_t outcome)
+{
+    UBaseType_t interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+    publisher_outcomes[lane][outcome]++;
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_status);
+}
+
+/******************************************************************************
+ * Function Name: lane_coalesce
+ ******************************************************************************
+ * Summary:
+ *  Function that replaces the oldest queued message for the topic of a new
+ *  message by the new message, keeping the order of the lane. It must be
+ *  called with the scheduler suspended.
+ *
+ * Parameters:
+ *  QueueHandle_t queue : Queue of the lane
+ *  const publisher_data_t *msg : New message
+ *  publisher_data_t *replaced : Message that was replaced
+ *
+ * Return:
+ *  bool : true if a message was replaced, else false
+ *
+ ******************************************************************************/
+static bool lane_coalesce(QueueHandle_t queue, const publisher_data_t *msg,
+                          publisher_data_t *replaced)
+{
+    const char *topic = (msg->topic != NULL) ? msg->topic : MQTT_PUB_TOPIC;
+    UBaseType_t waiting = uxQueueMessagesWaiting(queue);
+    publisher_data_t item;
+    bool found = false;
+
+    /* Rotate the whole lane once, swapping in the new message. */
+    for (UBaseType_t i = 0; i < waiting; i++)
+    {
+        xQueueReceive(queue, &item, 0);
+        if (!found && (item.cmd == PUBLISH_MQTT_MSG) &&
+            (strcmp((item.topic != NULL) ? item.topic : MQTT_PUB_TOPIC, topic) == 0))
+        {
+            *replaced = item;
+            item = *msg;
+            found = true;
+        }
+        xQueueSend(queue, &item, 0);
+    }
+
+    return found;
+}
+
+/******************************************************************************
+ * Function Name: publisher_lanes_create
+ ******************************************************************************
+ * Summary:
+ *  Function that creates the queues of the priority lanes and the token
+ *  buckets of the publish topics, unless they exist from a previous
+ *  connection.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  bool : true if the lanes exist, else false
+ *
+ ******************************************************************************/
+static bool publisher_lanes_create(void)
+{
+    if (publisher_lanes_ready)
+    {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < PUBLISHER_LANE_COUNT; i++)
+    {
+        publisher_lane_q[i] = xQueueCreate(publisher_lane_length[i], sizeof(publisher_data_t));
+        if (publisher_lane_q[i] == NULL)
+        {
+            return false;
+        }
+    }
+    rate_limits_init();
+
+    /* Set last, as the senders check it to know the lanes exist. */
+    publisher_lanes_ready = true;
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: publisher_receive
+ ******************************************************************************
+ * Summary:
+ *  Function that takes the next message from the highest priority lane that
+ *  is not empty, among the lanes above 'lane_limit'. If they are all empty,
+ *  it waits for a message to be sent and looks once more, so it may return
+ *  early without a message.
+ *
+ * Parameters:
+ *  publisher_data_t *msg : Message received
+ *  publisher_lane_t *lane : Lane the message was received on
+ *  publisher_lane_t lane_limit : First lane not to take from
+ *  TickType_t ticks_to_wait : Time to wait for a message
+ *
+ * Return:
+ *  bool : true if a message was received, else false
+ *
+ ******************************************************************************/
+static bool publisher_receive(publisher_data_t *msg, publisher_lane_t *lane,
+                              publisher_lane_t lane_limit, TickType_t ticks_to_wait)
+{
+    for (uint32_t attempt = 0; attempt < 2u; attempt++)
+    {
+        for (uint32_t i = 0; i < (uint32_t)lane_limit; i++)
+        {
+            if (pdTRUE == xQueueReceive(publisher_lane_q[i], msg, 0))
+            {
+                *lane = (publisher_lane_t)i;
+                msg->dequeued_us = device_clock_now_us();
+                if (msg->cmd == PUBLISH_MQTT_MSG)
+                {
+                    latency_probe_record(LATENCY_STAGE_QUEUE, msg->enqueued_us, msg->dequeued_us);
+                }
+                return true;
             }
         }
+
+        if (attempt == 0u)
+        {
+            ulTaskNotifyTake(pdTRUE, ticks_to_wait);
+        }
+    }
+
+    return false;
+}
+
+/******************************************************************************
+ * Function Name: shape_telemetry
+ ******************************************************************************
+ * Summary:
+ *  Function that publishes the telemetry that is due, as far as the token
+ *  buckets allow. A batch is published when its deadline has passed or the
+ *  held message does not fit in it, once its topic has a token; until then
+ *  it keeps coalescing the telemetry that fits. The held message then joins
+ *  the batch, or is published on its own if batching is disabled or it is
+ *  too large for a batch.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  TickType_t : Time the publisher can wait for messages before the
+ *               telemetry needs attention again
+ *
+ ******************************************************************************/
+static TickType_t shape_telemetry(void)
+{
+    TickType_t delay = 0;
+
+#if PUBLISHER_ENABLE_BATCHING
+    if ((batch.count > 0u) && ((batch_wait() == 0u) || (held_valid && !batch_fits(&held_msg))))
+    {
+        delay = publisher_rate_delay(batch.topic);
+        if (delay == 0u)
+        {
+            publisher_rate_take(batch.topic);
+            batch_flush();
+        }
+    }
+
+    if (held_valid && batch_fits(&held_msg))
+    {
+        batch_add(&held_msg);
+        held_valid = false;
+    }
+
+    /* The batch waits for a token, and so does a held message behind it. */
+    if (delay != 0u)
+    {
+        return delay;
+    }
+#endif /* PUBLISHER_ENABLE_BATCHING */
+
+    if (held_valid)
+    {
+        bool published;
+
+        if (held_msg.topic == NULL)
+        {
+            held_msg.topic = MQTT_PUB_TOPIC;
+        }
+
+        delay = publisher_rate_delay(held_msg.topic);
+        if (delay != 0u)
+        {
+            return delay;
+        }
+        publisher_rate_take(held_msg.topic);
+        published = publish_payload(held_msg.topic, held_msg.data, held_msg.length,
+                                    held_msg.timestamp_us, held_msg.dequeued_us,
+                                    message_complete(&held_msg));
+        if (held_msg.complete == NULL)
+        {
+            telemetry_completed(held_msg.topic, held_msg.timestamp_us,
+                                held_msg.timestamp_us, published);
+        }
+        held_valid = false;
     }
+
+    return batch_wait();
+}
+
+/******************************************************************************
+ * Function Name: publisher_rate_delay
+ ******************************************************************************
+ * Summary:
+ *  Function that returns how long a publish on a topic has to wait for a
+ *  token of the topic's rate limit.
+ *
+ * Parameters:
+ *  const char *topic : Publish topic
+ *
+ * Return:
+ *  TickType_t : Ticks until a token is available, 0 if one is available now
+ *               or the topic is not rate limited
+ *
+ ******************************************************************************/
+static TickType_t publisher_rate_delay(const char *topic)
+{
+    token_bucket_t *bucket = rate_bucket(topic);
+    TickType_t delay = 0;
+
+    if (bucket != NULL)
+    {
+        taskENTER_CRITICAL();
+        delay = token_bucket_delay(bucket, xTaskGetTickCount());
+        taskEXIT_CRITICAL();
+    }
+
+    return delay;
+}
+
+/******************************************************************************
+ * Function Name: publisher_rate_take
+ ******************************************************************************
+ * Summary:
+ *  Function that uses up a token of a topic's rate limit for a publish. A
+ *  publish without a token empties the bucket, delaying what follows.
+ *
+ * Parameters:
+ *  const char *topic : Publish topic
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void publisher_rate_take(const char *topic)
+{
+    token_bucket_t *bucket = rate_bucket(topic);
+
+    if (bucket != NULL)
+    {
+        taskENTER_CRITICAL();
+        token_bucket_take(bucket, xTaskGetTickCount());
+        taskEXIT_CRITICAL();
+    }
+}
+
+/******************************************************************************
+ * Function Name: rate_limits_init
+ ******************************************************************************
+ * Summary:
+ *  Function that fills the token bucket of every rate limited topic.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void rate_limits_init(void)
+{
+    for (uint32_t i = 0; i < (sizeof(rate_limits) / sizeof(rate_limits[0])); i++)
+    {
+        uint32_t interval = (rate_limits[i].rate_per_min == 0u) ? 0u :
+                            pdMS_TO_TICKS(60u * 1000u / rate_limits[i].rate_per_min);
+
+        token_bucket_init(&rate_limits[i].bucket, interval, rate_limits[i].burst,
+                          xTaskGetTickCount());
+    }
+}
+
+/******************************************************************************
+ * Function Name: rate_bucket
+ ******************************************************************************
+ * Summary:
+ *  Function that finds the token bucket of a topic.
+ *
+ * Parameters:
+ *  const char *topic : Publish topic
+ *
+ * Return:
+ *  token_bucket_t * : Token bucket, or NULL if the topic is not rate limited
+ *                     or the buckets are not set up yet
+ *
+ ******************************************************************************/
+static token_bucket_t *rate_bucket(const char *topic)
+{
+    if (!publisher_lanes_ready)
+    {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < (sizeof(rate_limits) / sizeof(rate_limits[0])); i++)
+    {
+        if (strcmp(topic, rate_limits[i].topic) == 0)
+        {
+            return &rate_limits[i].bucket;
+        }
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+ * Function Name: publish_payload
+ ******************************************************************************
+ * Summary:
+ *  Function that publishes a payload, waits for its acknowledgement and
+ *  hands the payload back through its completion callback.
+ *
+ * Parameters:
+ *  const char *topic : Topic to publish on
+ *  char *payload : Payload to publish
+ *  size_t length : Length of a binary payload, or 0 if 'payload' is a
+ *                  null-terminated string
+ *  uint64_t timestamp_us : Capture time of the oldest data in the payload,
+ *                          or 0 if it carries no sensor data
+ *  uint64_t dequeued_us : Time the publisher took the first message of the
+ *                         payload from its lane
+ *  publisher_complete_t complete : Called when the publish has finished, or
+ *                                  NULL if the payload needs no release
+ *
+ * Return:
+ *  bool : true if the publish was acknowledged, else false
+ *
+ ******************************************************************************/
+static bool publish_payload(const char *topic, char *payload, size_t length,
+                            uint64_t timestamp_us, uint64_t dequeued_us,
+                            publisher_complete_t complete)
+{
+    uint64_t start_us = device_clock_now_us();
+    bool published = publish_message(topic, payload, length);
+
+    if (published)
+    {
+        uint64_t complete_us = device_clock_now_us();
+
+        latency_probe_record(LATENCY_STAGE_DISPATCH, dequeued_us, start_us);
+        latency_probe_record(LATENCY_STAGE_PUBLISH, start_us, complete_us);
+        latency_probe_record(LATENCY_STAGE_END_TO_END, timestamp_us, complete_us);
+    }
+    if (complete != NULL)
+    {
+        complete(payload, published);
+    }
+
+    return published;
+}
+
+/******************************************************************************
+ * Function Name: publish_message
+ ******************************************************************************
+ * Summary:
+ *  Function that publishes one payload and reports a failure to the MQTT
+ *  client task.
+ *
+ * Parameters:
+ *  const char *topic : Topic to publish on
+ *  const char *payload : Payload to publish
+ *  size_t length : Length of a binary payload, or 0 if 'payload' is a
+ *                  null-terminated string
+ *
+ * Return:
+ *  bool : true if the publish was acknowledged, else false
+ *
+ ******************************************************************************/
+static bool publish_message(const char *topic, const char *payload, size_t length)
+{
+    /* Status variable */
+    cy_rslt_t result;
+
+    /* Command to the MQTT client task */
+    mqtt_task_cmd_t mqtt_task_cmd;
+
+    cy_mqtt_publish_info_t info = publish_info;
+
+    info.topic = topic;
+    info.topic_len = strlen(topic);
+    info.payload = payload;
+    info.payload_len = (length != 0u) ? length : strlen(payload);
+
+    /* The topic names are static, but the payload buffer is released once
+     * the publish completes, so only its length is logged.
+     */
+    LOG_INFO("Publisher: Publishing %u bytes on the topic '%s'\n",
+             (unsigned int) info.payload_len, info.topic);
+
+    result = cy_mqtt_publish(mqtt_connection, &info);
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        LOG_ERROR("Publisher: MQTT Publish failed with error 0x%0X.\n", (int)result);
+
+        /* Communicate the publish failure with the the MQTT
+         * client task.
+         */
+        mqtt_task_cmd = HANDLE_MQTT_PUBLISH_FAILURE;
+        xQueueSend(mqtt_task_q, &mqtt_task_cmd, portMAX_DELAY);
+    }
+
+    return (result == CY_RSLT_SUCCESS);
+}
+
+#if PUBLISHER_ENABLE_BATCHING
+/******************************************************************************
+ * Function Name: batch_fits
+ ******************************************************************************
+ * Summary:
+ *  Function that tells whether a message can join the pending batch: it is
+ *  for the same topic, has the same encoding and fits in the remaining
+ *  space. Any pooled message that is not too large fits in an empty batch;
+ *  a message with its own completion is never batched.
+ *
+ * Parameters:
+ *  const publisher_data_t *msg : Message received on the publisher queue
+ *
+ * Return:
+ *  bool : true if batch_add() can take the message
+ *
+ ******************************************************************************/
+static bool batch_fits(const publisher_data_t *msg)
+{
+    const char *topic = (msg->topic != NULL) ? msg->topic : MQTT_PUB_TOPIC;
+    bool binary = (msg->length != 0u);
+    size_t length = binary ? msg->length : strlen(msg->data);
+    size_t separator = (!binary && (batch.count > 0u)) ? 1u : 0u;
+
+    if ((msg->complete != NULL) || (length > PUBLISHER_BATCH_MAX_SIZE))
+    {
+        return false;
+    }
+
+    return ((batch.count == 0u) ||
+            ((strcmp(topic, batch.topic) == 0) && (binary == batch.binary) &&
+             ((batch.length + separator + length) <= PUBLISHER_BATCH_MAX_SIZE)));
+}
+
+/******************************************************************************
+ * Function Name: batch_add
+ ******************************************************************************
+ * Summary:
+ *  Function that appends a message to the pending batch and releases its
+ *  buffer. The message must fit, see batch_fits(). Text messages are
+ *  separated by a newline; binary records are self-delimiting and are
+ *  concatenated.
+ *
+ * Parameters:
+ *  const publisher_data_t *msg : Message received on the publisher queue
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void batch_add(const publisher_data_t *msg)
+{
+    const char *topic = (msg->topic != NULL) ? msg->topic : MQTT_PUB_TOPIC;
+    bool binary = (msg->length != 0u);
+    size_t length = binary ? msg->length : strlen(msg->data);
+    size_t separator = (!binary && (batch.count > 0u)) ? 1u : 0u;
+
+    if (batch.count == 0u)
+    {
+        batch.topic = topic;
+        batch.binary = binary;
+        batch.timestamp_us = 0;
+        batch.newest_us = 0;
+        batch.dequeued_us = msg->dequeued_us;
+        batch.deadline = xTaskGetTickCount() + pdMS_TO_TICKS(PUBLISHER_BATCH_MAX_LATENCY_MS);
+    }
+    if (separator != 0u)
+    {
+        batch.payload[batch.length++] = '\n';
+    }
+    memcpy(&batch.payload[batch.length], msg->data, length);
+    batch.length += length;
+    batch.payload[batch.length] = '\0';
+    batch.count++;
+
+    if ((msg->timestamp_us != 0u) &&
+        ((batch.timestamp_us == 0u) || (msg->timestamp_us < batch.timestamp_us)))
+    {
+        batch.timestamp_us = msg->timestamp_us;
+    }
+    if (msg->timestamp_us > batch.newest_us)
+    {
+        batch.newest_us = msg->timestamp_us;
+    }
+
+    /* The data has been copied, so the producer can reuse the buffer. */
+    message_pool_release(msg->data);
+}
+#endif /* PUBLISHER_ENABLE_BATCHING */
+
+/******************************************************************************
+ * Function Name: batch_flush
+ ******************************************************************************
+ * Summary:
+ *  Function that publishes the pending batch, if any, as one message, and
+ *  tells the telemetry whether its records were published.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void batch_flush(void)
+{
+    bool published;
+
+    if (batch.count == 0u)
+    {
+        return;
+    }
+
+#if PUBLISHER_ENABLE_BATCHING && MQTT_BINARY_DELTA_BATCHES
+    /* Binary records of a batch are sent as the differences between them.
+     * The packed records are kept if that does not make the batch smaller.
+     */
+    if (batch.binary && (batch.count > 1u))
+    {
+        size_t length = telemetry_delta_compress((const uint8_t *)batch.payload, batch.length,
+                                                 delta_buffer, sizeof(delta_buffer));
+
+        if ((length != 0u) && (length < batch.length))
+        {
+            memcpy(batch.payload, delta_buffer, length);
+            batch.length = length;
+        }
+    }
+#endif
+
+    published = publish_payload(batch.topic, batch.payload, batch.binary ? batch.length : 0u,
+                                batch.timestamp_us, batch.dequeued_us, NULL);
+    telemetry_completed(batch.topic, batch.timestamp_us, batch.newest_us, published);
+    batch.count = 0;
+    batch.length = 0;
+}
+
+/******************************************************************************
+ * Function Name: message_complete
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the completion of a queued message: its own, or
+ *  release_message() for pooled messages.
+ *
+ * Parameters:
+ *  const publisher_data_t *msg : Queued message
+ *
+ * Return:
+ *  publisher_complete_t : Completion to call once the publisher is done
+ *                         with the data
+ *
+ ******************************************************************************/
+static publisher_complete_t message_complete(const publisher_data_t *msg)
+{
+    return (msg->complete != NULL) ? msg->complete : release_message;
+}
+
+/******************************************************************************
+ * Function Name: release_message
+ ******************************************************************************
+ * Summary:
+ *  Publish completion callback for messages published as they were queued.
+ *  The publisher owns pooled messages once they are queued, so the buffer
+ *  is returned to the message pool.
+ *
+ * Parameters:
+ *  char *payload : Published message
+ *  bool published : true if the publish succeeded (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void release_message(char *payload, bool published)
+{
+    (void) published;
+
+    message_pool_release(payload);
+}
+
+/******************************************************************************
+ * Function Name: batch_wait
+ ******************************************************************************
+ * Summary:
+ *  Function that returns how long the publisher can wait for the next
+ *  message before the pending batch must be published.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  TickType_t : Ticks until the batch deadline, or portMAX_DELAY if no batch
+ *               is pending
+ *
+ ******************************************************************************/
+static TickType_t batch_wait(void)
+{
+    TickType_t remaining;
+
+    if (batch.count == 0u)
+    {
+        return portMAX_DELAY;
+    }
+
+    /* The deadline has passed if the difference has wrapped around. */
+    remaining = batch.deadline - xTaskGetTickCount();
+    return (remaining < (portMAX_DELAY / 2u)) ? remaining : 0u;
 }
 
 /******************************************************************************
@@ -243,16 +1242,91 @@ static void publisher_deinit(void)
     cyhal_gpio_enable_event(CYBSP_USER_BTN, CYHAL_GPIO_IRQ_FALL,
                             USER_BTN_INTR_PRIORITY, false);
     cyhal_gpio_free(CYBSP_USER_BTN);
+
+    /* Forget a press that was still settling. */
+    button_pending = false;
+    button_seen = button_edges;
+    button_armed = true;
+}
+
+/******************************************************************************
+ * Function Name: button_debounce
+ ******************************************************************************
+ * Summary:
+ *  Function that turns the user button edges counted by the ISR into
+ *  alarms. The first edge while the button is idle is the press: its alarm
+ *  is sent at once, stamped with the time the ISR latched. The bounce that
+ *  follows only restarts the settle time and is merged into that press; the
+ *  button is armed again once it has been quiet for the settle time.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  TickType_t : Time until the settle time of the last press ends, or
+ *               portMAX_DELAY if the button is idle
+ *
+ ******************************************************************************/
+static TickType_t button_debounce(void)
+{
+    uint32_t saved_intr = cyhal_system_critical_section_enter();
+    uint32_t edges = button_edges;
+    TickType_t edge_tick = button_edge_tick;
+    uint64_t press_us = button_press_us;
+    TickType_t remaining;
+
+    cyhal_system_critical_section_exit(saved_intr);
+
+    if (edges != button_seen)
+    {
+        if (!button_pending)
+        {
+            publisher_data_t publisher_q_data =
+            {
+                .cmd = PUBLISH_MQTT_MSG,
+                .topic = NULL,
+                .data = (char *)"test",
+                .length = 0,
+                .timestamp_us = press_us
+            };
+
+            /* The button press is the operator alarm of this node, so it is
+             * sent on the alarm lane and never waits behind telemetry.
+             */
+            publisher_send(&publisher_q_data, PUBLISHER_LANE_ALARM, 0);
+        }
+        button_seen = edges;
+        button_pending = true;
+        button_deadline = edge_tick + pdMS_TO_TICKS(PUBLISHER_BUTTON_DEBOUNCE_MS);
+    }
+    if (!button_pending)
+    {
+        return portMAX_DELAY;
+    }
+
+    remaining = button_deadline - xTaskGetTickCount();
+    if ((remaining != 0u) && (remaining <= pdMS_TO_TICKS(PUBLISHER_BUTTON_DEBOUNCE_MS)))
+    {
+        return remaining;
+    }
+
+    /* The button has settled; its next edge is a new press. */
+    saved_intr = cyhal_system_critical_section_enter();
+    button_pending = (button_edges != button_seen);
+    button_armed = !button_pending;
+    cyhal_system_critical_section_exit(saved_intr);
+
+    return button_pending ? 0u : portMAX_DELAY;
 }
 
 /******************************************************************************
  * Function Name: isr_button_press
  ******************************************************************************
  * Summary:
- *  GPIO interrupt service routine. This function detects button
- *  presses and sends the publish command along with the data to be published 
- *  to the publisher task over a message queue. Based on the current device 
- *  state, the publish data is set so that the device state gets toggled.
+ *  GPIO interrupt service routine of the user button. It counts the edge,
+ *  latches the time of a press on the first edge while the button is armed
+ *  and notifies the publisher task, which debounces the button, see
+ *  button_debounce().
  *
  * Parameters:
  *  void *callback_arg : pointer to variable passed to the ISR (unused)
@@ -265,20 +1339,20 @@ static void publisher_deinit(void)
 static void isr_button_press(void *callback_arg, cyhal_gpio_event_t event)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    publisher_data_t publisher_q_data;
 
     /* To avoid compiler warnings */
     (void) callback_arg;
     (void) event;
 
-    /* Assign the publish command to be sent to the publisher task. */
-    publisher_q_data.cmd = PUBLISH_MQTT_MSG;
+    if (button_armed)
+    {
+        button_press_us = device_clock_now_us();
+        button_armed = false;
+    }
+    button_edge_tick = xTaskGetTickCountFromISR();
+    button_edges++;
 
-    /* Assign the publish message*/
-    publisher_q_data.data = (char *)"test";
-            number = number + 1;
-    /* Send the command and data to publisher task over the queue */
-    xQueueSendFromISR(publisher_task_q, &publisher_q_data, &xHigherPriorityTaskWoken);
+    vTaskNotifyGiveFromISR(publisher_task_handle, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
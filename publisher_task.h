@@ -42,10 +42,14 @@
 #ifndef PUBLISHER_TASK_H_
 #define PUBLISHER_TASK_H_
 
+#include <stdbool.h>
+
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
 
+#include "mqtt_client_config.h"
+
 /*******************************************************************************
 * Macros
 ********************************************************************************/
@@ -53,6 +57,51 @@
 #define PUBLISHER_TASK_PRIORITY               (2)
 #define PUBLISHER_TASK_STACK_SIZE             (1024 * 1)
 
+/* Settle time in milliseconds of the user button. The first edge sends the
+ * alarm at once; contact bounce and presses until the button has been left
+ * alone for this time are merged into it.
+ */
+#define PUBLISHER_BUTTON_DEBOUNCE_MS          (50u)
+
+/* Set this macro to 1 to coalesce consecutive messages for the same topic
+ * into one PUBLISH. A batch is sent when the next message does not fit in
+ * the MQTT network buffer or 'PUBLISHER_BATCH_MAX_LATENCY_MS' after its
+ * first message was received.
+ */
+#define PUBLISHER_ENABLE_BATCHING             (1)
+#define PUBLISHER_BATCH_MAX_LATENCY_MS        (1000u)
+
+/* Bytes of a PUBLISH packet besides the payload: the fixed header, the topic
+ * length, the longest publish topic and the packet identifier.
+ */
+#define PUBLISH_TOPIC_MAX_LEN                 ((sizeof(MQTT_PUB_DIAG_TOPIC) > sizeof(MQTT_PUB_BIN_TOPIC)) ? \
+                                               (sizeof(MQTT_PUB_DIAG_TOPIC) - 1u) : (sizeof(MQTT_PUB_BIN_TOPIC) - 1u))
+#define PUBLISH_PACKET_OVERHEAD               (5u + 2u + PUBLISH_TOPIC_MAX_LEN + 2u)
+
+/* Largest batched payload, so that the whole PUBLISH packet fits in the MQTT
+ * network buffer.
+ */
+#define PUBLISHER_BATCH_MAX_SIZE              (MQTT_NETWORK_BUFFER_SIZE - PUBLISH_PACKET_OVERHEAD)
+
+/* Number of publishes waiting for their acknowledgement at the same time.
+ * cy_mqtt_publish() blocks until the PUBACK of a QoS 1 message and shares
+ * one coreMQTT context between all callers, so the publisher publishes one
+ * message at a time and only a window of 1 is supported. A larger window
+ * needs an asynchronous publish that completes on the PUBACKs handled by
+ * the MQTT receive loop, which the MQTT library does not offer.
+ */
+#define PUBLISHER_INFLIGHT_WINDOW             (1u)
+
+/* What publisher_enqueue() does when a lane is full. Producers that must
+ * never wait, such as the sampling, enqueue with these policies; the MQTT
+ * task still waits on the control lane with publisher_send().
+ */
+#define PUBLISHER_CONTROL_OVERFLOW            (PUBLISHER_OVERFLOW_DROP_NEWEST)
+#define PUBLISHER_ALARM_OVERFLOW              (PUBLISHER_OVERFLOW_DROP_OLDEST)
+#define PUBLISHER_RESPONSE_OVERFLOW           (PUBLISHER_OVERFLOW_DROP_OLDEST)
+#define PUBLISHER_TELEMETRY_OVERFLOW          (PUBLISHER_OVERFLOW_SPILL)
+#define PUBLISHER_BULK_OVERFLOW               (PUBLISHER_OVERFLOW_DROP_NEWEST)
+
 /*******************************************************************************
 * Global Variables
 ********************************************************************************/
@@ -64,22 +113,89 @@ typedef enum
     PUBLISH_MQTT_MSG
 } publisher_cmd_t;
 
-/* Struct to be passed via the publisher task queue */
+/* Priority lanes of the publisher queue, highest priority first. The
+ * publisher always takes the next message from the highest non-empty lane,
+ * so an alarm never waits behind queued telemetry or a backlog drain.
+ * Commands for the publisher itself travel on the control lane.
+ */
+typedef enum
+{
+    PUBLISHER_LANE_CONTROL,
+    PUBLISHER_LANE_ALARM,
+    PUBLISHER_LANE_RESPONSE,
+    PUBLISHER_LANE_TELEMETRY,
+    PUBLISHER_LANE_BULK,
+    PUBLISHER_LANE_COUNT
+} publisher_lane_t;
+
+/* Overflow policies of a lane.
+ * DROP_NEWEST: the new message is dropped.
+ * DROP_OLDEST: the oldest queued message is dropped to make room.
+ * COALESCE_LATEST: the new message replaces the oldest queued message for
+ *                  the same topic, or the oldest message if there is none.
+ * SPILL: the new message is dropped and the producer is told to keep the
+ *        data elsewhere, the telemetry spills the record to the journal.
+ */
+typedef enum
+{
+    PUBLISHER_OVERFLOW_DROP_NEWEST,
+    PUBLISHER_OVERFLOW_DROP_OLDEST,
+    PUBLISHER_OVERFLOW_COALESCE_LATEST,
+    PUBLISHER_OVERFLOW_SPILL
+} publisher_overflow_t;
+
+/* Outcome of publisher_enqueue(), counted for every lane. */
+typedef enum
+{
+    PUBLISHER_ENQUEUED,
+    PUBLISHER_COALESCED,
+    PUBLISHER_DROPPED_OLDEST,
+    PUBLISHER_DROPPED_NEWEST,
+    PUBLISHER_SPILLED,
+    PUBLISHER_OUTCOME_COUNT
+} publisher_outcome_t;
+
+/* Called once the publisher is done with the data of a message: 'published'
+ * is true if the broker acknowledged it, false if it was dropped or the
+ * publish failed.
+ */
+typedef void (*publisher_complete_t)(char *data, bool published);
+
+/* Struct to be passed via the publisher task queue. 'topic' selects the
+ * topic to publish on, or MQTT_PUB_TOPIC if NULL. 'length' is the length of
+ * a binary payload, or 0 if 'data' is a null-terminated string.
+ * 'timestamp_us' is the device clock time at which the published data was
+ * captured, or 0 if the message does not carry sensor data. The publisher
+ * sets 'enqueued_us' and 'dequeued_us' for the latency probes.
+ * 'complete' hands the data back to a producer that owns it, and such a
+ * message is published on its own, never batched; if it is NULL the data is
+ * returned to the message pool.
+ */
 typedef struct{
     publisher_cmd_t cmd;
+    const char *topic;
     char *data;
+    size_t length;
+    uint64_t timestamp_us;
+    uint64_t enqueued_us;
+    uint64_t dequeued_us;
+    publisher_complete_t complete;
 } publisher_data_t;
 
 /*******************************************************************************
 * Extern Variables
 ********************************************************************************/
 extern TaskHandle_t publisher_task_handle;
-extern QueueHandle_t publisher_task_q;
 
 /*******************************************************************************
 * Function Prototypes
 ********************************************************************************/
 void publisher_task(void *pvParameters);
+bool publisher_send(const publisher_data_t *msg, publisher_lane_t lane, TickType_t ticks_to_wait);
+bool publisher_send_from_isr(const publisher_data_t *msg, publisher_lane_t lane,
+                             BaseType_t *higher_priority_task_woken);
+publisher_outcome_t publisher_enqueue(const publisher_data_t *msg, publisher_lane_t lane);
+uint32_t publisher_outcome_count(publisher_lane_t lane, publisher_outcome_t outcome);
 
 #endif /* PUBLISHER_TASK_H_ */
 
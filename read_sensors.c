@@ -1,90 +1,449 @@
-// analog_reader_task.c
-
-#include "FreeRTOS.h"
-#include "task.h"
-#include "queue.h"
-#include "cyhal.h"
-#include "cy_retarget_io.h"
-#include<stdlib.h>
-
-#include "publisher_task.h"  // Include the header file of the publisher task
-#include "read_sensors.h"
-
-// Function prototype
-void read_sensors_task(void *pvParameters);
-
-// FreeRTOS task handle for this task
-TaskHandle_t read_sensors_task_handle;
-
-// Handle of the queue holding the analog values for the publisher task
-QueueHandle_t read_sensors_task_q;
-
-// Structure to store analog value information
-typedef struct
-{
-    int turbidity_value;
-} analog_reader_data_t;
-bool timer_interrupt_flag = false;
-bool led_blink_active_flag = true;
-
-/* Variable for storing character read from terminal */
-uint8_t uart_read_value;
-/* Set the direction of the GPIO pin to output */
-
-
-void read_sensors_task(void *pvParameters)
-{
-	cy_rslt_t rslt;
-	cyhal_adc_t adc_obj;
-	cyhal_adc_channel_t adc_chan_1_ph;
-	cyhal_adc_channel_t adc_chan_2_tds;
-	/* 32-bit ADC conversion result */
-	float adc_out_1;
-	float adc_out_2;
-
-	cyhal_gpio_init(P9_1, CYHAL_GPIO_DIR_OUTPUT, CYHAL_GPIO_DRIVE_STRONG, 0);
-
-	/* Use the same configuration for both channels */
-	const cyhal_adc_channel_config_t channel_config = { .enable_averaging = false, .min_acquisition_ns = 220, .enabled = true };
-	/* Initialize ADC. The ADC block which can connect to pin 10[0] is selected */
-	/* Initialize ADC for turbidity channel */
-		rslt = cyhal_adc_init(&adc_obj, P10_0, NULL);
-		    if(rslt != CY_RSLT_SUCCESS)
-		    {
-		        printf("ADC initialization failed. Error: %ld\n", (long unsigned int)rslt);
-		        CY_ASSERT(0);
-		    }
-	rslt = cyhal_adc_channel_init_diff(&adc_chan_1_ph, &adc_obj, P10_5, CYHAL_ADC_VNEG, &channel_config);
-	if(rslt != CY_RSLT_SUCCESS)
-	    {
-	        printf("ADC ph channel initialization failed. Error: %ld\n", (long unsigned int)rslt);
-	        CY_ASSERT(0);
-	    }
-	rslt = cyhal_adc_channel_init_diff(&adc_chan_2_tds, &adc_obj, P10_0, P10_2, &channel_config);
-	if(rslt != CY_RSLT_SUCCESS)
-		    {
-		        printf("ADC TDS+ channel initialization failed. Error: %ld\n", (long unsigned int)rslt);
-		        CY_ASSERT(0);
-		    }
-	/* Read the ADC conversion results for both channels. Repeat as necessary. */
-	while(1){
-	vTaskDelay(pdMS_TO_TICKS(1000));  // Add a delay between readings
-	adc_out_1 = (cyhal_adc_read(&adc_chan_1_ph)-2701.1)/-342.0;
-	vTaskDelay(pdMS_TO_TICKS(1000));  // Add a delay between readings
-	adc_out_2 = ((cyhal_adc_read(&adc_chan_2_tds)-817)/2)+200;
-	/* Release ADC and channel objects when no longer needed */
-	 // Send the ADC value to the publisher task queue
-	publisher_data_t publisher_q_data;
-	publisher_q_data.cmd = PUBLISH_MQTT_MSG;
-	publisher_q_data.data = (char *)malloc(sizeof(char) * 10);  // Adjust the size as needed
-	snprintf(publisher_q_data.data, 30, "pH=%.2f::Tds=%.2f", adc_out_1, adc_out_2);
-	xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
-	cyhal_gpio_toggle(P9_1);
-	vTaskDelay(pdMS_TO_TICKS(50));
-	cyhal_gpio_toggle(P9_1);
-	free(publisher_q_data.data);
-	}
-	cyhal_adc_channel_free(&adc_chan_1_ph);
-	cyhal_adc_channel_free(&adc_chan_2_tds);
-	cyhal_adc_free(&adc_obj);
-}
+/******************************************************************************
+* File Name:   read_sensors.c
+*
+* Description: This file contains the sensor driver for the pH and TDS probes
+*              sampled by the SAR ADC. The ADC runs in continuous scanning
+*              mode and DMA moves every scan into one half of a double buffer.
+*              Every completed block wakes the sensor scheduler, which reads
+*              the driver: the block is oversampled and decimated per
+*              channel and then converted with the fixed-point calibration
+*              tables.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cyhal.h"
+#include "cy_retarget_io.h"
+
+#include "read_sensors.h"
+#include "sensor_scheduler.h"
+#include "device_clock.h"
+#include "adc_filter.h"
+#include "calibration.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Interrupt priority of the ADC async read complete event. */
+#define ADC_INTR_PRIORITY               (4u)
+
+/* Number of samples held in one half of the DMA double buffer. */
+#define ADC_BLOCK_SAMPLES               (READ_SENSORS_BLOCK_SCANS * READ_SENSORS_CHANNEL_COUNT)
+
+/* Bits in 'adc_ready_bits' telling which half of the double buffer is ready. */
+#define ADC_BLOCK_READY_BIT(index)      (1lu << (index))
+
+/* Time in microseconds between two scans. */
+#define ADC_SCAN_PERIOD_US              (DEVICE_CLOCK_US_PER_SEC / READ_SENSORS_SAMPLE_RATE_HZ)
+
+/* Maximum number of decimated samples one block can produce per channel. */
+#define FILTER_OUTPUT_MAX               ((READ_SENSORS_BLOCK_SCANS / READ_SENSORS_DECIMATION) + 1u)
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static cy_rslt_t read_sensors_init(void);
+static cy_rslt_t read_sensors_start(void);
+static uint32_t read_sensors_read(sensor_sample_t *samples, uint32_t max_samples);
+static void read_sensors_deinit(void);
+static void adc_event_handler(void *callback_arg, cyhal_adc_event_t event);
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Driver operations table registered with the sensor scheduler. */
+const sensor_driver_t water_quality_sensor =
+{
+	.name = "pH/TDS",
+	.period_ms = 0,
+	.init = read_sensors_init,
+	.start = read_sensors_start,
+	.read = read_sensors_read,
+	.deinit = read_sensors_deinit
+};
+
+/* ADC and channel objects for the pH and TDS probes. The channels are
+ * scanned in the order in which they are initialized, which matches the
+ * order of the sensor channels.
+ */
+static cyhal_adc_t adc_obj;
+static cyhal_adc_channel_t adc_chan_1_ph;
+static cyhal_adc_channel_t adc_chan_2_tds;
+
+/* DMA double buffer. While the driver processes one half, the DMA fills the
+ * other one. Each half holds READ_SENSORS_BLOCK_SCANS interleaved scans.
+ */
+static int32_t adc_block[2][ADC_BLOCK_SAMPLES];
+
+/* Index of the half currently being filled by the DMA. */
+static volatile uint32_t adc_fill_index;
+
+/* Halves of the double buffer that are complete and not yet processed. The
+ * interrupt drops a half when it re-arms the DMA into it, so at most one
+ * half is ready at a time.
+ */
+static volatile uint32_t adc_ready_bits;
+
+/* Device clock time at which each half of the double buffer was completed,
+ * i.e. the capture time of its last scan.
+ */
+static volatile uint64_t adc_block_end_us[2];
+
+/* Number of blocks that were overwritten before the driver consumed them,
+ * and the count the filters were last reset for.
+ */
+static volatile uint32_t adc_overrun_count;
+static uint32_t filter_overrun_count;
+
+/* Oversample-and-decimate filters, indexed by sensor channel. */
+static adc_filter_t filter[READ_SENSORS_CHANNEL_COUNT];
+
+/* Default calibration of the pH probe: pH = (counts - 2701.1) / -342. */
+static const calibration_point_t default_calibration_ph[] =
+{
+	{ CALIBRATION_RAW(0),    CALIBRATION_VALUE(2701.1 / 342.0) },
+	{ CALIBRATION_RAW(4095), CALIBRATION_VALUE((2701.1 - 4095.0) / 342.0) }
+};
+
+/* Default calibration of the TDS probe: TDS = ((counts - 817) / 2) + 200. */
+static const calibration_point_t default_calibration_tds[] =
+{
+	{ CALIBRATION_RAW(0),    CALIBRATION_VALUE(200.0 - (817.0 / 2.0)) },
+	{ CALIBRATION_RAW(4095), CALIBRATION_VALUE(200.0 + ((4095.0 - 817.0) / 2.0)) }
+};
+
+/* Active calibration tables, indexed by sensor channel. */
+static calibration_table_t calibration[READ_SENSORS_CHANNEL_COUNT];
+
+/******************************************************************************
+ * Function Name: read_sensors_init
+ ******************************************************************************
+ * Summary:
+ *  Function that sets up the decimation filters, the default calibration and
+ *  the ADC with both probe channels in continuous DMA mode.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code
+ *
+ ******************************************************************************/
+static cy_rslt_t read_sensors_init(void)
+{
+	cy_rslt_t rslt;
+
+	/* Use the same configuration for both channels */
+	const cyhal_adc_channel_config_t channel_config = { .enable_averaging = (READ_SENSORS_HW_AVERAGE_COUNT > 1u), .min_acquisition_ns = 220, .enabled = true };
+
+	/* Keep the reference and resolution of the driver defaults so the probe
+	 * calibration stays valid, but let the ADC scan continuously.
+	 */
+	const cyhal_adc_config_t adc_config =
+	{
+		.resolution = 12,
+		.average_count = READ_SENSORS_HW_AVERAGE_COUNT,
+		.average_mode_flags = CYHAL_ADC_AVG_MODE_AVERAGE,
+		.continuous_scanning = true,
+		.vneg = CYHAL_ADC_VNEG_VREF,
+		.vref = CYHAL_ADC_REF_INTERNAL,
+		.ext_vref = NC,
+		.ext_vref_mv = 0,
+		.is_bypassed = false,
+		.bypass_pin = NC,
+		.sampling_rate = READ_SENSORS_SAMPLE_RATE_HZ
+	};
+
+	for (uint32_t channel = 0; channel < READ_SENSORS_CHANNEL_COUNT; channel++)
+	{
+		if (!adc_filter_init(&filter[channel], READ_SENSORS_DECIMATION, READ_SENSORS_CIC_ORDER))
+		{
+			printf("Unsupported ADC filter configuration\n");
+			return ~CY_RSLT_SUCCESS;
+		}
+	}
+	calibration_load(&calibration[SENSOR_CHANNEL_PH], default_calibration_ph,
+					 sizeof(default_calibration_ph) / sizeof(default_calibration_ph[0]));
+	calibration_load(&calibration[SENSOR_CHANNEL_TDS], default_calibration_tds,
+					 sizeof(default_calibration_tds) / sizeof(default_calibration_tds[0]));
+
+	/* Initialize ADC. The ADC block which can connect to pin 10[0] is selected */
+	rslt = cyhal_adc_init(&adc_obj, P10_0, NULL);
+	if(rslt != CY_RSLT_SUCCESS)
+	{
+		printf("ADC initialization failed. Error: %ld\n", (long unsigned int)rslt);
+		return rslt;
+	}
+	rslt = cyhal_adc_channel_init_diff(&adc_chan_1_ph, &adc_obj, P10_5, CYHAL_ADC_VNEG, &channel_config);
+	if(rslt != CY_RSLT_SUCCESS)
+	{
+		printf("ADC ph channel initialization failed. Error: %ld\n", (long unsigned int)rslt);
+		return rslt;
+	}
+	rslt = cyhal_adc_channel_init_diff(&adc_chan_2_tds, &adc_obj, P10_0, P10_2, &channel_config);
+	if(rslt != CY_RSLT_SUCCESS)
+	{
+		printf("ADC TDS+ channel initialization failed. Error: %ld\n", (long unsigned int)rslt);
+		return rslt;
+	}
+	rslt = cyhal_adc_configure(&adc_obj, &adc_config);
+	if(rslt != CY_RSLT_SUCCESS)
+	{
+		printf("ADC configuration failed. Error: %ld\n", (long unsigned int)rslt);
+		return rslt;
+	}
+
+	/* Let DMA move the scan results and raise an event per completed block. */
+	rslt = cyhal_adc_set_async_mode(&adc_obj, CYHAL_ASYNC_DMA, CYHAL_DMA_PRIORITY_DEFAULT);
+	if(rslt != CY_RSLT_SUCCESS)
+	{
+		printf("ADC DMA mode setup failed. Error: %ld\n", (long unsigned int)rslt);
+		return rslt;
+	}
+	cyhal_adc_register_callback(&adc_obj, adc_event_handler, NULL);
+	cyhal_adc_enable_event(&adc_obj, CYHAL_ADC_ASYNC_READ_COMPLETE, ADC_INTR_PRIORITY, true);
+
+	return CY_RSLT_SUCCESS;
+}
+
+/******************************************************************************
+ * Function Name: read_sensors_start
+ ******************************************************************************
+ * Summary:
+ *  Function that starts filling the first half of the DMA double buffer.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code
+ *
+ ******************************************************************************/
+static cy_rslt_t read_sensors_start(void)
+{
+	cy_rslt_t rslt;
+
+	adc_fill_index = 0;
+	adc_ready_bits = 0;
+	filter_overrun_count = adc_overrun_count;
+	for (uint32_t channel = 0; channel < READ_SENSORS_CHANNEL_COUNT; channel++)
+	{
+		adc_filter_reset(&filter[channel]);
+	}
+	rslt = cyhal_adc_read_async(&adc_obj, READ_SENSORS_BLOCK_SCANS, adc_block[0]);
+	if(rslt != CY_RSLT_SUCCESS)
+	{
+		printf("ADC async read failed. Error: %ld\n", (long unsigned int)rslt);
+	}
+	return rslt;
+}
+
+/******************************************************************************
+ * Function Name: read_sensors_read
+ ******************************************************************************
+ * Summary:
+ *  Function that runs the completed DMA block through the decimation filters
+ *  and the calibration tables and returns the resulting samples. Samples of
+ *  both channels are interleaved in chronological order. Each sample is
+ *  stamped with the capture time of the last scan that went into it, derived
+ *  from the completion time of its block and the scan period.
+ *
+ *  If blocks were lost to an overrun since the last read, the filters are
+ *  reset first, as their state no longer continues into the next block. A
+ *  block that is overwritten while it is processed is discarded.
+ *
+ * Parameters:
+ *  sensor_sample_t *samples : Buffer receiving the samples
+ *  uint32_t max_samples : Capacity of the buffer
+ *
+ * Return:
+ *  uint32_t : Number of samples stored
+ *
+ ******************************************************************************/
+static uint32_t read_sensors_read(sensor_sample_t *samples, uint32_t max_samples)
+{
+	int32_t filtered[READ_SENSORS_CHANNEL_COUNT][FILTER_OUTPUT_MAX];
+	uint32_t stored = 0;
+	uint32_t produced = 0;
+	uint32_t ready;
+	uint32_t overruns;
+	uint32_t index;
+	uint64_t last_scan_us;
+	bool intact;
+
+	taskENTER_CRITICAL();
+	ready = adc_ready_bits;
+	overruns = adc_overrun_count;
+	taskEXIT_CRITICAL();
+
+	if (ready == 0u)
+	{
+		return 0;
+	}
+	index = ((ready & ADC_BLOCK_READY_BIT(0u)) != 0u) ? 0u : 1u;
+
+	if (overruns != filter_overrun_count)
+	{
+		for (uint32_t channel = 0; channel < READ_SENSORS_CHANNEL_COUNT; channel++)
+		{
+			adc_filter_reset(&filter[channel]);
+		}
+		filter_overrun_count = overruns;
+	}
+
+	/* Both channels are scanned together, so they always produce the
+	 * same number of decimated samples.
+	 */
+	for (uint32_t channel = 0; channel < READ_SENSORS_CHANNEL_COUNT; channel++)
+	{
+		produced = adc_filter_process(&filter[channel], &adc_block[index][channel],
+									  READ_SENSORS_BLOCK_SCANS, READ_SENSORS_CHANNEL_COUNT,
+									  filtered[channel], FILTER_OUTPUT_MAX);
+	}
+
+	/* The block stays marked ready until it is processed, so an interrupt
+	 * that re-armed the DMA into it meanwhile has counted an overrun.
+	 */
+	taskENTER_CRITICAL();
+	intact = (adc_overrun_count == overruns);
+	adc_ready_bits &= ~ADC_BLOCK_READY_BIT(index);
+	last_scan_us = adc_block_end_us[index];
+	taskEXIT_CRITICAL();
+
+	if (!intact)
+	{
+		return 0;
+	}
+
+	/* The filters carry 'phase' scans over to the next block, so the
+	 * last decimated sample ends that many scans before the block end.
+	 */
+	last_scan_us -= (uint64_t)filter[0].phase * ADC_SCAN_PERIOD_US;
+
+	/* The tables may be replaced at runtime by another task. */
+	taskENTER_CRITICAL();
+	for (uint32_t channel = 0; channel < READ_SENSORS_CHANNEL_COUNT; channel++)
+	{
+		calibration_apply(&calibration[channel], filtered[channel], filtered[channel], produced);
+	}
+	taskEXIT_CRITICAL();
+
+	for (uint32_t i = 0; (i < produced) && ((stored + READ_SENSORS_CHANNEL_COUNT) <= max_samples); i++)
+	{
+		for (uint32_t channel = 0; channel < READ_SENSORS_CHANNEL_COUNT; channel++)
+		{
+			samples[stored].channel = (sensor_channel_t)channel;
+			samples[stored].value = filtered[channel][i];
+			samples[stored].timestamp_us = last_scan_us -
+				((uint64_t)(produced - 1u - i) * READ_SENSORS_DECIMATION * ADC_SCAN_PERIOD_US);
+			stored++;
+		}
+	}
+
+	return stored;
+}
+
+/******************************************************************************
+ * Function Name: read_sensors_deinit
+ ******************************************************************************
+ * Summary:
+ *  Function that stops the acquisition and releases the ADC and its channels.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void read_sensors_deinit(void)
+{
+	cyhal_adc_enable_event(&adc_obj, CYHAL_ADC_ASYNC_READ_COMPLETE, ADC_INTR_PRIORITY, false);
+	cyhal_adc_channel_free(&adc_chan_1_ph);
+	cyhal_adc_channel_free(&adc_chan_2_tds);
+	cyhal_adc_free(&adc_obj);
+}
+
+/******************************************************************************
+ * Function Name: adc_event_handler
+ ******************************************************************************
+ * Summary:
+ *  ADC interrupt callback invoked when the DMA has filled one half of the
+ *  double buffer. It immediately re-arms the transfer into the other half,
+ *  stamps the completed half with the device clock, marks it as ready and
+ *  wakes the sensor scheduler to read it. If the other half was still waiting for the driver,
+ *  it is stale and is being overwritten, so it is dropped and counted.
+ *
+ * Parameters:
+ *  void *callback_arg : pointer to variable passed to the ISR (unused)
+ *  cyhal_adc_event_t event : ADC event type
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void adc_event_handler(void *callback_arg, cyhal_adc_event_t event)
+{
+	uint32_t done_index = adc_fill_index;
+
+	(void) callback_arg;
+
+	if ((event & CYHAL_ADC_ASYNC_READ_COMPLETE) == 0u)
+	{
+		return;
+	}
+
+	adc_block_end_us[done_index] = device_clock_now_us();
+	adc_fill_index = done_index ^ 1u;
+	cyhal_adc_read_async(&adc_obj, READ_SENSORS_BLOCK_SCANS, adc_block[adc_fill_index]);
+
+	/* The other half is still pending, so the driver fell a full block behind. */
+	if ((adc_ready_bits & ADC_BLOCK_READY_BIT(adc_fill_index)) != 0u)
+	{
+		adc_ready_bits &= ~ADC_BLOCK_READY_BIT(adc_fill_index);
+		adc_overrun_count++;
+	}
+	adc_ready_bits |= ADC_BLOCK_READY_BIT(done_index);
+
+	sensor_notify_from_isr();
+}
+
+/******************************************************************************
+ * Function Name: read_sensors_load_calibration
+ ******************************************************************************
+ * Summary:
+ *  Function that replaces the calibration table of a probe at runtime, e.g.
+ *  after the probe has been recalibrated, without reflashing the device.
+ *
+ * Parameters:
+ *  sensor_channel_t channel : Probe to recalibrate, SENSOR_CHANNEL_PH or
+ *                            SENSOR_CHANNEL_TDS
+ *  const calibration_point_t *points : Calibration points sorted by strictly
+ *                                      increasing raw reading
+ *  uint32_t count : Number of points
+ *
+ * Return:
+ *  bool : true if the table was accepted, else false
+ *
+ ******************************************************************************/
+bool read_sensors_load_calibration(sensor_channel_t channel,
+								   const calibration_point_t *points, uint32_t count)
+{
+	calibration_table_t table;
+
+	if ((channel >= READ_SENSORS_CHANNEL_COUNT) || !calibration_load(&table, points, count))
+	{
+		return false;
+	}
+
+	taskENTER_CRITICAL();
+	calibration[channel] = table;
+	taskEXIT_CRITICAL();
+
+	return true;
+}
+
+/* [] END OF FILE */
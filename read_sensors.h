@@ -1,18 +1,64 @@
-#ifndef READ_SENSORS_H
-#define READ_SENSORS_TASK_H
-
-#include "FreeRTOS.h"
-#include "queue.h"
-
-#define READ_SENSORS_TASK_PRIORITY (3)
-#define READ_SENSORS_TASK_QUEUE_LENGTH  (3u)
-#define READ_SENSORS_TASK_STACK_SIZE    (1024*8)
-
-extern TaskHandle_t read_sensors_task_handle;
-
-extern QueueHandle_t read_sensors_task_q;
-
-// Function to create and initialize the analog reader task
-void read_sensors_task(void *pvParameters);
-
-#endif /* READ_SENSORS_TASK_H */
+/******************************************************************************
+* File Name:   read_sensors.h
+*
+* Description: This file is the public interface of read_sensors.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef READ_SENSORS_H_
+#define READ_SENSORS_H_
+
+#include <stdbool.h>
+
+#include "sensor.h"
+#include "calibration.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of ADC channels in one scan (pH and TDS). They are scanned in the
+ * order SENSOR_CHANNEL_PH, SENSOR_CHANNEL_TDS.
+ */
+#define READ_SENSORS_CHANNEL_COUNT          (2u)
+
+/* Rate in Hz at which the SAR ADC scans all enabled channels while running
+ * in continuous scanning mode.
+ */
+#define READ_SENSORS_SAMPLE_RATE_HZ         (4000u)
+
+/* Number of scans in one DMA block. */
+#define READ_SENSORS_BLOCK_SCANS            (200u)
+
+/* Time in milliseconds to fill one DMA block. The driver is event driven:
+ * the sensor scheduler reads it each time a block completes.
+ */
+#define READ_SENSORS_BLOCK_PERIOD_MS        ((READ_SENSORS_BLOCK_SCANS * 1000u) / READ_SENSORS_SAMPLE_RATE_HZ)
+
+/* Number of hardware averaged conversions per scan result. Set to 1 to
+ * disable the SAR ADC hardware averaging.
+ */
+#define READ_SENSORS_HW_AVERAGE_COUNT       (1u)
+
+/* Oversample-and-decimate stage applied to each channel before calibration.
+ * The decimation factor must be a power of two; the order selects a boxcar
+ * average (1) or a higher order CIC response (2 or 3).
+ */
+#define READ_SENSORS_DECIMATION             (256u)
+#define READ_SENSORS_CIC_ORDER              (2u)
+
+/*******************************************************************************
+* Extern Variables
+********************************************************************************/
+extern const sensor_driver_t water_quality_sensor;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+bool read_sensors_load_calibration(sensor_channel_t channel,
+                                   const calibration_point_t *points, uint32_t count);
+
+#endif /* READ_SENSORS_H_ */
+
+/* [] END OF FILE */
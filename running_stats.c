@@ -0,0 +1,129 @@
+/******************************************************************************
+* File Name:   running_stats.c
+*
+* Description: This file contains O(1) per-sample running statistics (count,
+*              minimum, maximum, mean and variance) based on Welford's
+*              algorithm, implemented with integer arithmetic on Q16.16
+*              values.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include "running_stats.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Extra fractional bits of the running mean. */
+#define MEAN_EXTRA_BITS                 (16u)
+
+/* Number of fractional bits of a value. */
+#define VALUE_FRAC_BITS                 (16u)
+
+/* Arithmetic right shift rounding to nearest. */
+#define ROUND_SHIFT(value, bits)        (((value) + (1ll << ((bits) - 1u))) >> (bits))
+
+/******************************************************************************
+ * Function Name: running_stats_reset
+ ******************************************************************************
+ * Summary:
+ *  Function that clears the statistics to start a new series.
+ *
+ * Parameters:
+ *  running_stats_t *stats : Statistics to clear
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void running_stats_reset(running_stats_t *stats)
+{
+    stats->count = 0;
+    stats->min = INT32_MAX;
+    stats->max = INT32_MIN;
+    stats->mean = 0;
+    stats->m2 = 0;
+}
+
+/******************************************************************************
+ * Function Name: running_stats_add
+ ******************************************************************************
+ * Summary:
+ *  Function that adds one value to the statistics using Welford's update:
+ *    delta = x - mean; mean += delta / n; m2 += delta * (x - mean)
+ *
+ * Parameters:
+ *  running_stats_t *stats : Statistics to update
+ *  int32_t value : Value in Q16.16
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void running_stats_add(running_stats_t *stats, int32_t value)
+{
+    int64_t scaled = (int64_t)value * (1ll << MEAN_EXTRA_BITS);
+    int64_t delta;
+    int64_t delta_after;
+
+    stats->count++;
+    if (value < stats->min)
+    {
+        stats->min = value;
+    }
+    if (value > stats->max)
+    {
+        stats->max = value;
+    }
+
+    delta = scaled - stats->mean;
+    stats->mean += delta / (int64_t)stats->count;
+    delta_after = scaled - stats->mean;
+
+    /* Both deltas are brought back to Q16.16 so that m2 holds the sum of
+     * squared deviations in Q16.16 as well.
+     */
+    stats->m2 += (ROUND_SHIFT(delta, MEAN_EXTRA_BITS) * ROUND_SHIFT(delta_after, MEAN_EXTRA_BITS)) >>
+                 VALUE_FRAC_BITS;
+}
+
+/******************************************************************************
+ * Function Name: running_stats_summary
+ ******************************************************************************
+ * Summary:
+ *  Function that computes the summary of the values added so far. The
+ *  variance is the sample variance (divided by n - 1).
+ *
+ * Parameters:
+ *  const running_stats_t *stats : Statistics to summarize
+ *  running_stats_summary_t *summary : Summary in Q16.16
+ *
+ * Return:
+ *  bool : true if at least one value was added, else false
+ *
+ ******************************************************************************/
+bool running_stats_summary(const running_stats_t *stats, running_stats_summary_t *summary)
+{
+    int64_t variance = 0;
+
+    if (stats->count == 0u)
+    {
+        return false;
+    }
+
+    if (stats->count > 1u)
+    {
+        variance = stats->m2 / (int64_t)(stats->count - 1u);
+    }
+
+    summary->count = stats->count;
+    summary->min = stats->min;
+    summary->max = stats->max;
+    summary->mean = (int32_t)ROUND_SHIFT(stats->mean, MEAN_EXTRA_BITS);
+    summary->variance = (variance > INT32_MAX) ? INT32_MAX : (int32_t)variance;
+
+    return true;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,50 @@
+/******************************************************************************
+* File Name:   running_stats.h
+*
+* Description: This file is the public interface of running_stats.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef RUNNING_STATS_H_
+#define RUNNING_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Incremental statistics of a series of Q16.16 values. The mean is kept with
+ * 16 extra fractional bits so that rounding does not accumulate.
+ */
+typedef struct
+{
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int64_t mean;
+    int64_t m2;
+} running_stats_t;
+
+/* Summary of a series, all values in Q16.16. */
+typedef struct
+{
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int32_t mean;
+    int32_t variance;
+} running_stats_summary_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void running_stats_reset(running_stats_t *stats);
+void running_stats_add(running_stats_t *stats, int32_t value);
+bool running_stats_summary(const running_stats_t *stats, running_stats_summary_t *summary);
+
+#endif /* RUNNING_STATS_H_ */
+
+/* [] END OF FILE */
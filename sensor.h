@@ -0,0 +1,90 @@
+/******************************************************************************
+* File Name:   sensor.h
+*
+* Description: This file defines the interface between the sensor drivers and
+*              the sensor scheduler. Every sensor is described by a driver
+*              operations table and a sampling period; the scheduler calls
+*              the driver on its own timeline and forwards the samples.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef SENSOR_H_
+#define SENSOR_H_
+
+#include <stdint.h>
+
+#include "cyhal.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of fractional bits of a sample value (Q16.16). */
+#define SENSOR_VALUE_FRAC_BITS          (16u)
+
+/* Converts an integer in engineering units to a sample value. */
+#define SENSOR_VALUE_FROM_INT(value)    ((int32_t)((value) * (1l << SENSOR_VALUE_FRAC_BITS)))
+
+/* Converts a constant in engineering units to a sample value at compile
+ * time, rounding to the nearest step.
+ */
+#define SENSOR_VALUE(value)             ((int32_t)(((value) * (1l << SENSOR_VALUE_FRAC_BITS)) + \
+                                                   (((value) < 0) ? -0.5 : 0.5)))
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Physical quantities reported by the sensors. */
+typedef enum
+{
+    SENSOR_CHANNEL_PH,
+    SENSOR_CHANNEL_TDS,
+    SENSOR_CHANNEL_LEVEL,
+    SENSOR_CHANNEL_COUNT
+} sensor_channel_t;
+
+/* One calibrated reading of a channel, stamped with the device clock time
+ * in microseconds at which it was captured.
+ */
+typedef struct
+{
+    sensor_channel_t channel;
+    int32_t value;
+    uint64_t timestamp_us;
+} sensor_sample_t;
+
+/* Operations implemented by a sensor driver.
+ *  init   : claim and configure the hardware
+ *  start  : start the acquisition
+ *  read   : non-blocking; store up to 'max_samples' new samples and return
+ *           how many were stored
+ *  deinit : stop the acquisition and release the hardware
+ * The scheduler calls 'read' every 'period_ms' milliseconds. A driver with
+ * a 'period_ms' of 0 is event driven: the scheduler calls 'read' each time
+ * the driver signals new data with sensor_notify_from_isr().
+ */
+typedef struct
+{
+    const char *name;
+    uint32_t period_ms;
+    cy_rslt_t (*init)(void);
+    cy_rslt_t (*start)(void);
+    uint32_t (*read)(sensor_sample_t *samples, uint32_t max_samples);
+    void (*deinit)(void);
+} sensor_driver_t;
+
+/* Consumer of the samples read by the sensor scheduler.
+ *  init    : optional; called once by the scheduler task before the
+ *            drivers are started
+ *  process : called with the samples of every read that returned some
+ */
+typedef struct
+{
+    void (*init)(void);
+    void (*process)(const sensor_sample_t *samples, uint32_t count);
+} sensor_sink_t;
+
+#endif /* SENSOR_H_ */
+
+/* [] END OF FILE */
@@ -0,0 +1,230 @@
+/******************************************************************************
+* File Name:   sensor_scheduler.c
+*
+* Description: This file contains the sensor registry and the single task
+*              that samples all registered sensors. Each sensor is read on a
+*              fixed cadence given by its driver period, or whenever an
+*              event driven sensor signals new data; the task sleeps until
+*              the earliest deadline of all sensors or the next signal and
+*              forwards the samples to the sink set by the application: the
+*              telemetry on node 1, the level readings of the subscriber on
+*              node 2, which builds this file and the sensor drivers from
+*              the top-level directory.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include "cyhal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cy_retarget_io.h"
+
+#include "sensor_scheduler.h"
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static bool deadline_reached(TickType_t deadline, TickType_t now);
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* FreeRTOS task handle for this task. */
+TaskHandle_t sensor_scheduler_task_handle;
+
+/* Registered drivers and the tick at which each one is read next. */
+static const sensor_driver_t *sensor_drivers[SENSOR_MAX_DRIVERS];
+static TickType_t sensor_next_read[SENSOR_MAX_DRIVERS];
+static bool sensor_active[SENSOR_MAX_DRIVERS];
+static uint32_t sensor_count;
+
+/* Consumer of the samples. */
+static const sensor_sink_t *sensor_sink;
+
+/******************************************************************************
+ * Function Name: sensor_register
+ ******************************************************************************
+ * Summary:
+ *  Function that adds a sensor driver to the registry. Drivers must be
+ *  registered before the sensor scheduler task is started.
+ *
+ * Parameters:
+ *  const sensor_driver_t *driver : Driver operations table
+ *
+ * Return:
+ *  bool : true if the driver was registered, else false
+ *
+ ******************************************************************************/
+bool sensor_register(const sensor_driver_t *driver)
+{
+    if ((driver == NULL) || (driver->read == NULL) || (sensor_count >= SENSOR_MAX_DRIVERS))
+    {
+        return false;
+    }
+
+    sensor_drivers[sensor_count++] = driver;
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: sensor_set_sink
+ ******************************************************************************
+ * Summary:
+ *  Function that sets the consumer of the samples. It must be called before
+ *  the sensor scheduler task is started; without a sink the samples are
+ *  discarded.
+ *
+ * Parameters:
+ *  const sensor_sink_t *sink : Sink operations table
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void sensor_set_sink(const sensor_sink_t *sink)
+{
+    sensor_sink = sink;
+}
+
+/******************************************************************************
+ * Function Name: sensor_notify_from_isr
+ ******************************************************************************
+ * Summary:
+ *  Function that an event driven sensor calls from its interrupt when it
+ *  has new data. It wakes the sensor scheduler task, which then reads every
+ *  event driven sensor.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void sensor_notify_from_isr(void)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(sensor_scheduler_task_handle, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/******************************************************************************
+ * Function Name: sensor_scheduler_task
+ ******************************************************************************
+ * Summary:
+ *  Task that initializes and starts every registered sensor and then reads
+ *  each of them on its own period, or as soon as an event driven sensor has
+ *  signalled new data. Deadlines advance by whole periods, so the sampling
+ *  cadence does not drift with the time spent in the drivers.
+ *
+ * Parameters:
+ *  void *pvParameters : Task parameter defined during task creation (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void sensor_scheduler_task(void *pvParameters)
+{
+    sensor_sample_t samples[SENSOR_MAX_SAMPLES_PER_READ];
+    TickType_t now;
+
+    (void) pvParameters;
+
+    if ((sensor_sink != NULL) && (sensor_sink->init != NULL))
+    {
+        sensor_sink->init();
+    }
+
+    now = xTaskGetTickCount();
+    for (uint32_t i = 0; i < sensor_count; i++)
+    {
+        const sensor_driver_t *driver = sensor_drivers[i];
+
+        if (((driver->init != NULL) && (CY_RSLT_SUCCESS != driver->init())) ||
+            ((driver->start != NULL) && (CY_RSLT_SUCCESS != driver->start())))
+        {
+            printf("Sensor '%s' could not be started!\n", driver->name);
+            if (driver->deinit != NULL)
+            {
+                driver->deinit();
+            }
+            continue;
+        }
+
+        sensor_active[i] = true;
+        sensor_next_read[i] = now + pdMS_TO_TICKS(driver->period_ms);
+    }
+
+    while (true)
+    {
+        TickType_t wait = portMAX_DELAY;
+
+        /* Sleep until the earliest deadline of all active sensors, or until
+         * an event driven sensor signals new data.
+         */
+        now = xTaskGetTickCount();
+        for (uint32_t i = 0; i < sensor_count; i++)
+        {
+            if (sensor_active[i] && (sensor_drivers[i]->period_ms != 0u))
+            {
+                TickType_t remaining = deadline_reached(sensor_next_read[i], now) ?
+                                       0 : (sensor_next_read[i] - now);
+                if (remaining < wait)
+                {
+                    wait = remaining;
+                }
+            }
+        }
+        (void) ulTaskNotifyTake(pdTRUE, wait);
+
+        now = xTaskGetTickCount();
+        for (uint32_t i = 0; i < sensor_count; i++)
+        {
+            const sensor_driver_t *driver = sensor_drivers[i];
+            TickType_t period = pdMS_TO_TICKS(driver->period_ms);
+
+            if (!sensor_active[i] ||
+                ((period != 0u) && !deadline_reached(sensor_next_read[i], now)))
+            {
+                continue;
+            }
+
+            uint32_t count = driver->read(samples, SENSOR_MAX_SAMPLES_PER_READ);
+            if ((count > 0u) && (sensor_sink != NULL))
+            {
+                sensor_sink->process(samples, count);
+            }
+
+            /* Advance by whole periods; skip the periods that were missed. */
+            while ((period != 0u) && deadline_reached(sensor_next_read[i], now))
+            {
+                sensor_next_read[i] += period;
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * Function Name: deadline_reached
+ ******************************************************************************
+ * Summary:
+ *  Function that tells whether a deadline has been reached, taking the
+ *  wrap-around of the tick counter into account.
+ *
+ * Parameters:
+ *  TickType_t deadline : Tick count of the deadline
+ *  TickType_t now : Current tick count
+ *
+ * Return:
+ *  bool : true if 'now' is at or past 'deadline'
+ *
+ ******************************************************************************/
+static bool deadline_reached(TickType_t deadline, TickType_t now)
+{
+    return ((TickType_t)(now - deadline) < (portMAX_DELAY / 2u));
+}
+
+/* [] END OF FILE */
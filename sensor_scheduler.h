@@ -0,0 +1,53 @@
+/******************************************************************************
+* File Name:   sensor_scheduler.h
+*
+* Description: This file is the public interface of sensor_scheduler.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef SENSOR_SCHEDULER_H_
+#define SENSOR_SCHEDULER_H_
+
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "sensor.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Task parameters for the sensor scheduler task. */
+#define SENSOR_SCHEDULER_TASK_PRIORITY      (3)
+#define SENSOR_SCHEDULER_TASK_STACK_SIZE    (1024 * 2)
+
+/* Maximum number of sensor drivers that can be registered. */
+#define SENSOR_MAX_DRIVERS                  (4u)
+
+/* Maximum number of samples a driver may return from one read. */
+#define SENSOR_MAX_SAMPLES_PER_READ         (16u)
+
+/* Set this macro to 1 to register the ultrasonic level sensor with the
+ * telemetry, see ultrasound.h for its pins.
+ */
+#define SENSOR_ENABLE_ULTRASOUND            (1)
+
+/*******************************************************************************
+* Extern Variables
+********************************************************************************/
+extern TaskHandle_t sensor_scheduler_task_handle;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+bool sensor_register(const sensor_driver_t *driver);
+void sensor_set_sink(const sensor_sink_t *sink);
+void sensor_notify_from_isr(void);
+void sensor_scheduler_task(void *pvParameters);
+
+#endif /* SENSOR_SCHEDULER_H_ */
+
+/* [] END OF FILE */
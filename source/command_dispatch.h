@@ -0,0 +1,84 @@
+/******************************************************************************
+* File Name:   command_dispatch.h
+*
+* Description: This file is the public interface of command_dispatch.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef COMMAND_DISPATCH_H_
+#define COMMAND_DISPATCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of slots of the command hash index. Must be a power of two and at
+ * least twice the number of commands of a table, and at most 256.
+ */
+#define COMMAND_TABLE_SLOTS                 (64u)
+
+/* Entry of a command table. */
+#define COMMAND(name, arg_type, min, max, handler) \
+    { (name), sizeof(name) - 1u, (arg_type), (min), (max), (handler) }
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Argument parsers. A command name is made of letters and underscores and
+ * its argument, if any, follows it directly, as in "move_servo_90".
+ */
+typedef enum
+{
+    COMMAND_ARG_NONE,       /* Nothing may follow the name. */
+    COMMAND_ARG_INT         /* A decimal integer from 'min' to 'max'. */
+} command_arg_type_t;
+
+/* Outcome of command_dispatch(). */
+typedef enum
+{
+    COMMAND_OK,
+    COMMAND_UNKNOWN,
+    COMMAND_BAD_ARGUMENT
+} command_result_t;
+
+/* Handler of a command. It receives the parsed argument, or 0 for commands
+ * without argument.
+ */
+typedef void (*command_handler_t)(int32_t argument);
+
+/* One command, see the COMMAND() macro. */
+typedef struct
+{
+    const char *name;
+    size_t name_len;
+    command_arg_type_t arg_type;
+    int32_t min;
+    int32_t max;
+    command_handler_t handler;
+} command_t;
+
+/* Hash index of a command table, built once by command_table_init(). Every
+ * slot holds the command index + 1, or 0 if it is free.
+ */
+typedef struct
+{
+    const command_t *commands;
+    uint32_t count;
+    uint8_t slot[COMMAND_TABLE_SLOTS];
+} command_table_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+bool command_table_init(command_table_t *table, const command_t *commands, uint32_t count);
+command_result_t command_dispatch(const command_table_t *table, const char *payload, size_t length);
+bool command_parse_int(const char *text, size_t length, int32_t min, int32_t max, int32_t *value);
+
+#endif /* COMMAND_DISPATCH_H_ */
+
+/* [] END OF FILE */
@@ -0,0 +1,145 @@
+/******************************************************************************
+* File Name:   message_pool.c
+*
+* Description: This file contains a fixed pool of preallocated message
+*              buffers for the path from the message producers to the
+*              publisher task. A producer acquires a buffer, fills it and
+*              hands it over with the publisher queue; from then on the
+*              publisher owns it and releases it once cy_mqtt_publish() has
+*              returned. The free buffers are kept in a FreeRTOS queue, so no
+*              heap is used after initialization and a producer can wait for
+*              a buffer to become free.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "cy_retarget_io.h"
+
+#include "message_pool.h"
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Storage of all message buffers. */
+static char message_buffers[MESSAGE_POOL_COUNT][MESSAGE_POOL_BUFFER_SIZE];
+
+/* Queue holding pointers to the buffers that are currently free. */
+static QueueHandle_t message_free_q;
+
+/******************************************************************************
+ * Function Name: message_pool_init
+ ******************************************************************************
+ * Summary:
+ *  Function that creates the free list and puts every buffer in it. Calling
+ *  it again has no effect.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  bool : true if the pool is ready, else false
+ *
+ ******************************************************************************/
+bool message_pool_init(void)
+{
+    if (message_free_q != NULL)
+    {
+        return true;
+    }
+
+    message_free_q = xQueueCreate(MESSAGE_POOL_COUNT, sizeof(char *));
+    if (message_free_q == NULL)
+    {
+        printf("Message pool creation failed!\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < MESSAGE_POOL_COUNT; i++)
+    {
+        char *buffer = message_buffers[i];
+        xQueueSend(message_free_q, &buffer, 0);
+    }
+
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: message_pool_acquire
+ ******************************************************************************
+ * Summary:
+ *  Function that takes a free buffer from the pool. The caller owns the
+ *  buffer until it passes it on or releases it.
+ *
+ * Parameters:
+ *  TickType_t timeout : Ticks to wait for a buffer to become free, 0 to
+ *                       return immediately
+ *
+ * Return:
+ *  char * : Buffer of MESSAGE_POOL_BUFFER_SIZE bytes, or NULL if none became
+ *           free in time
+ *
+ ******************************************************************************/
+char *message_pool_acquire(TickType_t timeout)
+{
+    char *buffer = NULL;
+
+    if ((message_free_q == NULL) ||
+        (pdTRUE != xQueueReceive(message_free_q, &buffer, timeout)))
+    {
+        return NULL;
+    }
+
+    buffer[0] = '\0';
+    return buffer;
+}
+
+/******************************************************************************
+ * Function Name: message_pool_release
+ ******************************************************************************
+ * Summary:
+ *  Function that returns a buffer to the pool. Pointers that do not belong
+ *  to the pool, such as constant strings, are ignored, so the publisher can
+ *  release every message it has published.
+ *
+ * Parameters:
+ *  char *buffer : Buffer obtained from message_pool_acquire()
+ *
+ * Return:
+ *  bool : true if the buffer was returned to the pool, else false
+ *
+ ******************************************************************************/
+bool message_pool_release(char *buffer)
+{
+    uintptr_t offset = (uintptr_t)buffer - (uintptr_t)message_buffers;
+
+    if ((message_free_q == NULL) || ((uintptr_t)buffer < (uintptr_t)message_buffers) ||
+        (offset >= sizeof(message_buffers)) || ((offset % MESSAGE_POOL_BUFFER_SIZE) != 0u))
+    {
+        return false;
+    }
+
+    return (pdTRUE == xQueueSend(message_free_q, &buffer, 0));
+}
+
+/******************************************************************************
+ * Function Name: message_pool_available
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the number of free buffers in the pool.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  uint32_t : Number of free buffers
+ *
+ ******************************************************************************/
+uint32_t message_pool_available(void)
+{
+    return (message_free_q == NULL) ? 0u : (uint32_t)uxQueueMessagesWaiting(message_free_q);
+}
+
+/* [] END OF FILE */
@@ -70,6 +70,9 @@
 /* LwIP header files */
 #include "lwip/netif.h"
 
+#include "sensor_scheduler.h"
+#include "ultrasound.h"
+
 /******************************************************************************
 * Macros
 ******************************************************************************/
@@ -254,7 +257,7 @@ void mqtt_client_task(void *pvParameters)
                 {
                     /* Deinit the publisher before initiating reconnections. */
                     publisher_q_data.cmd = PUBLISHER_DEINIT;
-                    xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
+                    publisher_send(&publisher_q_data, PUBLISHER_LANE_CONTROL, portMAX_DELAY);
 
                     /* Although the connection with the MQTT Broker is lost, 
                      * call the MQTT disconnect API for cleanup of threads and 
@@ -287,7 +290,7 @@ void mqtt_client_task(void *pvParameters)
 
                     /* Initialize Publisher post the reconnection. */
                     publisher_q_data.cmd = PUBLISHER_INIT;
-                    xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
+                    publisher_send(&publisher_q_data, PUBLISHER_LANE_CONTROL, portMAX_DELAY);
                     break;
                 }
 
@@ -518,6 +521,24 @@ static cy_rslt_t mqtt_connect(void)
                 {
                     printf("Failed to create Publisher task!\n");
                 }
+
+            /* The ultrasonic sensor is sampled by the same scheduler and
+             * driver as on node 1; the subscriber answers the distance
+             * requests with the latest reading. Sampling keeps running
+             * across reconnections, so the scheduler is only created once.
+             */
+            if (sensor_scheduler_task_handle == NULL)
+            {
+                sensor_set_sink(&subscriber_level_sink);
+                sensor_register(&ultrasound_sensor);
+                if (pdPASS != xTaskCreate(sensor_scheduler_task, "Sensor scheduler task",
+                                          SENSOR_SCHEDULER_TASK_STACK_SIZE, NULL,
+                                          SENSOR_SCHEDULER_TASK_PRIORITY,
+                                          &sensor_scheduler_task_handle))
+                {
+                    printf("Failed to create the Sensor scheduler task!\n");
+                }
+            }
             return result;
         }
 
@@ -43,6 +43,8 @@
 * so agrees to indemnify Cypress against all liability.
 *******************************************************************************/
 
+#include <string.h>
+
 #include "cyhal.h"
 #include "cybsp.h"
 #include "FreeRTOS.h"
@@ -51,6 +53,8 @@
 #include "publisher_task.h"
 #include "mqtt_task.h"
 #include "subscriber_task.h"
+#include "message_pool.h"
+#include "deferred_log.h"
 
 /* Configuration file for MQTT client */
 #include "mqtt_client_config.h"
@@ -73,18 +77,26 @@
  */
 #define PUBLISH_RETRY_MS                (1000)
 
-/* Queue length of a message queue that is used to communicate with the 
- * publisher task.
- */
-#define PUBLISHER_TASK_QUEUE_LENGTH     (3u)
+/* Queue length of each priority lane of the publisher queue. */
+#define PUBLISHER_CONTROL_LANE_LENGTH   (2u)
+#define PUBLISHER_ALARM_LANE_LENGTH     (2u)
+#define PUBLISHER_RESPONSE_LANE_LENGTH  (2u)
+#define PUBLISHER_TELEMETRY_LANE_LENGTH (3u)
+#define PUBLISHER_BULK_LANE_LENGTH      (3u)
 
 /******************************************************************************
 * Function Prototypes
 *******************************************************************************/
 static void publisher_init(void);
 static void publisher_deinit(void);
+static bool publisher_lanes_create(void);
+static bool lane_coalesce(QueueHandle_t queue, const publisher_data_t *msg,
+                          publisher_data_t *replaced);
+static void count_outcome(publisher_lane_t lane, publisher_outcome_t outcome);
+static bool publisher_receive(publisher_data_t *msg, publisher_lane_t *lane,
+                              TickType_t ticks_to_wait);
+static TickType_t button_debounce(void);
 static void isr_button_press(void *callback_arg, cyhal_gpio_event_t event);
-void print_heap_usage(char *msg);
 
 /******************************************************************************
 * Global Variables
@@ -92,8 +104,34 @@ void print_heap_usage(char *msg);
 /* FreeRTOS task handle for this task. */
 TaskHandle_t publisher_task_handle;
 
-/* Handle of the queue holding the commands for the publisher task */
-QueueHandle_t publisher_task_q;
+/* Queues of the priority lanes. Every message sent notifies the publisher
+ * task, which then looks at the lanes.
+ */
+static QueueHandle_t publisher_lane_q[PUBLISHER_LANE_COUNT];
+static volatile bool publisher_lanes_ready;
+
+/* Queue length of each priority lane. */
+static const UBaseType_t publisher_lane_length[PUBLISHER_LANE_COUNT] =
+{
+    [PUBLISHER_LANE_CONTROL] = PUBLISHER_CONTROL_LANE_LENGTH,
+    [PUBLISHER_LANE_ALARM] = PUBLISHER_ALARM_LANE_LENGTH,
+    [PUBLISHER_LANE_RESPONSE] = PUBLISHER_RESPONSE_LANE_LENGTH,
+    [PUBLISHER_LANE_TELEMETRY] = PUBLISHER_TELEMETRY_LANE_LENGTH,
+    [PUBLISHER_LANE_BULK] = PUBLISHER_BULK_LANE_LENGTH
+};
+
+/* Overflow policy of each priority lane. */
+static const publisher_overflow_t publisher_lane_overflow[PUBLISHER_LANE_COUNT] =
+{
+    [PUBLISHER_LANE_CONTROL] = PUBLISHER_CONTROL_OVERFLOW,
+    [PUBLISHER_LANE_ALARM] = PUBLISHER_ALARM_OVERFLOW,
+    [PUBLISHER_LANE_RESPONSE] = PUBLISHER_RESPONSE_OVERFLOW,
+    [PUBLISHER_LANE_TELEMETRY] = PUBLISHER_TELEMETRY_OVERFLOW,
+    [PUBLISHER_LANE_BULK] = PUBLISHER_BULK_OVERFLOW
+};
+
+/* Number of publisher_enqueue() outcomes of each lane. */
+static uint32_t publisher_outcomes[PUBLISHER_LANE_COUNT][PUBLISHER_OUTCOME_COUNT];
 
 /* Structure to store publish message information. */
 cy_mqtt_publish_info_t publish_info =
@@ -112,7 +150,19 @@ cyhal_gpio_callback_data_t cb_data =
     .callback_arg = NULL
 };
 
-int number = 0;
+/* Falling edges of the user button counted by the ISR, and the tick count
+ * of the last one.
+ */
+static volatile uint32_t button_edges;
+static volatile TickType_t button_edge_tick;
+
+/* Edges already seen by the publisher task, and the end of the settle time
+ * of the last press, until which its bounce is merged into it.
+ */
+static uint32_t button_seen;
+static bool button_pending;
+static TickType_t button_deadline;
+
 /******************************************************************************
  * Function Name: publisher_task
  ******************************************************************************
@@ -120,7 +170,8 @@ int number = 0;
  *  Task that sets up the user button GPIO for the publisher and publishes 
  *  MQTT messages to the broker. The user button init and deinit operations,
  *  and the MQTT publish operation is performed based on commands sent by other
- *  tasks and callbacks over a message queue.
+ *  tasks and callbacks over the priority lanes of the publisher queue, highest
+ *  priority first.
  *
  * Parameters:
  *  void *pvParameters : Task parameter defined during task creation (unused)
@@ -135,6 +186,7 @@ void publisher_task(void *pvParameters)
     cy_rslt_t result;
 
     publisher_data_t publisher_q_data;
+    publisher_lane_t lane;
 
     /* Command to the MQTT client task */
     mqtt_task_cmd_t mqtt_task_cmd;
@@ -145,12 +197,18 @@ void publisher_task(void *pvParameters)
     /* Initialize and set-up the user button GPIO. */
     publisher_init();
 
-    /* Create a message queue to communicate with other tasks and callbacks. */
-    publisher_task_q = xQueueCreate(PUBLISHER_TASK_QUEUE_LENGTH, sizeof(publisher_data_t));
+    /* Create the message queues to communicate with other tasks and callbacks. */
+    if (!publisher_lanes_create())
+    {
+        printf("Publisher queue creation failed!\n");
+        vTaskDelete(NULL);
+    }
     while (true)
     {
-        /* Wait for commands from other tasks and callbacks. */
-        if (pdTRUE == xQueueReceive(publisher_task_q, &publisher_q_data, portMAX_DELAY))
+        /* Wait for commands from other tasks and callbacks, but no longer
+         * than until a button press has settled.
+         */
+        if (publisher_receive(&publisher_q_data, &lane, button_debounce()))
         {
             switch(publisher_q_data.cmd)
             {
@@ -174,14 +232,14 @@ void publisher_task(void *pvParameters)
                     publish_info.payload = publisher_q_data.data;
                     publish_info.payload_len = strlen(publish_info.payload);
 
-                    printf("\nPublisher: Publishing '%s' on the topic '%s'\n",
-                           (char *) publish_info.payload, publish_info.topic);
+                    LOG_INFO("Publisher: Publishing %u bytes on the topic '%s'\n",
+                             (unsigned int) publish_info.payload_len, publish_info.topic);
 
                     result = cy_mqtt_publish(mqtt_connection, &publish_info);
 
                     if (result != CY_RSLT_SUCCESS)
                     {
-                        printf("  Publisher: MQTT Publish failed with error 0x%0X.\n\n", (int)result);
+                        LOG_ERROR("Publisher: MQTT Publish failed with error 0x%0X.\n", (int)result);
 
                         /* Communicate the publish failure with the the MQTT 
                          * client task.
@@ -190,7 +248,11 @@ void publisher_task(void *pvParameters)
                         xQueueSend(mqtt_task_q, &mqtt_task_cmd, portMAX_DELAY);
                     }
 
-                    print_heap_usage("publisher_task: After publishing an MQTT message");
+                    /* The publisher owns pooled messages once they are
+                     * queued, so return the buffer now that the publish
+                     * has completed.
+                     */
+                    message_pool_release(publisher_q_data.data);
                     break;
                 }
             }
@@ -198,6 +260,325 @@ void publisher_task(void *pvParameters)
     }
 }
 
+/******************************************************************************
+ * Function Name: publisher_send
+ ******************************************************************************
+ * Summary:
+ *  Function that queues a command or a message for the publisher task on a
+ *  priority lane.
+ *
+ * Parameters:
+ *  const publisher_data_t *msg : Command or message to queue
+ *  publisher_lane_t lane : Priority lane
+ *  TickType_t ticks_to_wait : Time to wait while the lane is full
+ *
+ * Return:
+ *  bool : true if the message was queued, else false. The caller keeps the
+ *         ownership of a message that was not queued.
+ *
+ ******************************************************************************/
+bool publisher_send(const publisher_data_t *msg, publisher_lane_t lane, TickType_t ticks_to_wait)
+{
+    if (!publisher_lanes_ready || (lane >= PUBLISHER_LANE_COUNT) ||
+        (pdTRUE != xQueueSend(publisher_lane_q[lane], msg, ticks_to_wait)))
+    {
+        return false;
+    }
+
+    xTaskNotifyGive(publisher_task_handle);
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: publisher_send_from_isr
+ ******************************************************************************
+ * Summary:
+ *  Interrupt safe version of publisher_send(). It does not wait; a message
+ *  that does not fit is counted as dropped.
+ *
+ * Parameters:
+ *  const publisher_data_t *msg : Command or message to queue
+ *  publisher_lane_t lane : Priority lane
+ *  BaseType_t *higher_priority_task_woken : Set to pdTRUE if a context
+ *                                           switch is needed on exit
+ *
+ * Return:
+ *  bool : true if the message was queued, else false
+ *
+ ******************************************************************************/
+bool publisher_send_from_isr(const publisher_data_t *msg, publisher_lane_t lane,
+                             BaseType_t *higher_priority_task_woken)
+{
+    if (!publisher_lanes_ready || (lane >= PUBLISHER_LANE_COUNT) ||
+        (pdTRUE != xQueueSendFromISR(publisher_lane_q[lane], msg, higher_priority_task_woken)))
+    {
+        if (lane < PUBLISHER_LANE_COUNT)
+        {
+            count_outcome(lane, PUBLISHER_DROPPED_NEWEST);
+        }
+        return false;
+    }
+
+    vTaskNotifyGiveFromISR(publisher_task_handle, higher_priority_task_woken);
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: publisher_enqueue
+ ******************************************************************************
+ * Summary:
+ *  Function that queues a message for the publisher task on a priority lane
+ *  without waiting. If the lane is full, the overflow policy of the lane
+ *  decides which message is dropped. The lane is rearranged with the
+ *  scheduler suspended, so the publisher never sees it half done.
+ *
+ * Parameters:
+ *  const publisher_data_t *msg : Message to queue. The publisher takes over
+ *                                its buffer whatever the outcome.
+ *  publisher_lane_t lane : Priority lane
+ *
+ * Return:
+ *  publisher_outcome_t : What happened to the message
+ *
+ ******************************************************************************/
+publisher_outcome_t publisher_enqueue(const publisher_data_t *msg, publisher_lane_t lane)
+{
+    publisher_outcome_t outcome = PUBLISHER_DROPPED_NEWEST;
+    publisher_data_t dropped;
+    bool release_dropped = false;
+
+    if (!publisher_lanes_ready || (lane >= PUBLISHER_LANE_COUNT))
+    {
+        message_pool_release(msg->data);
+        return PUBLISHER_DROPPED_NEWEST;
+    }
+
+    if (publisher_send(msg, lane, 0))
+    {
+        outcome = PUBLISHER_ENQUEUED;
+    }
+    else
+    {
+        vTaskSuspendAll();
+        switch (publisher_lane_overflow[lane])
+        {
+            case PUBLISHER_OVERFLOW_COALESCE_LATEST:
+            {
+                if (lane_coalesce(publisher_lane_q[lane], msg, &dropped))
+                {
+                    outcome = PUBLISHER_COALESCED;
+                    release_dropped = true;
+                    break;
+                }
+                /* No message for the same topic, drop the oldest. */
+            }
+            /* fall through */
+            case PUBLISHER_OVERFLOW_DROP_OLDEST:
+            {
+                /* The publisher was notified of the dropped message. */
+                if (pdTRUE == xQueueReceive(publisher_lane_q[lane], &dropped, 0))
+                {
+                    release_dropped = true;
+                    if (pdTRUE == xQueueSend(publisher_lane_q[lane], msg, 0))
+                    {
+                        outcome = PUBLISHER_DROPPED_OLDEST;
+                    }
+                }
+                break;
+            }
+
+            case PUBLISHER_OVERFLOW_SPILL:
+            {
+                outcome = PUBLISHER_SPILLED;
+                break;
+            }
+
+            default:
+                break;
+        }
+        xTaskResumeAll();
+    }
+
+    if (release_dropped)
+    {
+        message_pool_release(dropped.data);
+    }
+    if ((outcome == PUBLISHER_DROPPED_NEWEST) || (outcome == PUBLISHER_SPILLED))
+    {
+        message_pool_release(msg->data);
+    }
+    count_outcome(lane, outcome);
+
+    if (outcome != PUBLISHER_ENQUEUED)
+    {
+        LOG_WARN("Publisher: lane %u full, outcome %u (%lu times)\n", (unsigned int)lane,
+                 (unsigned int)outcome, (unsigned long)publisher_outcome_count(lane, outcome));
+    }
+
+    return outcome;
+}
+
+/******************************************************************************
+ * Function Name: publisher_outcome_count
+ ******************************************************************************
+ * Summary:
+ *  Function that returns how often publisher_enqueue() had an outcome on a
+ *  lane. Failed publisher_send_from_isr() calls count as dropped newest.
+ *
+ * Parameters:
+ *  publisher_lane_t lane : Priority lane
+ *  publisher_outcome_t outcome : Outcome
+ *
+ * Return:
+ *  uint32_t : Number of messages with this outcome
+ *
+ ******************************************************************************/
+uint32_t publisher_outcome_count(publisher_lane_t lane, publisher_outcome_t outcome)
+{
+    if ((lane >= PUBLISHER_LANE_COUNT) || (outcome >= PUBLISHER_OUTCOME_COUNT))
+    {
+        return 0;
+    }
+    return publisher_outcomes[lane][outcome];
+}
+
+/******************************************************************************
+ * Function Name: count_outcome
+ ******************************************************************************
+ * Summary:
+ *  Function that counts an enqueue outcome. It can be called from tasks and
+ *  interrupts.
+ *
+ * Parameters:
+ *  publisher_lane_t lane : Priority lane
+ *  publisher_outcome_t outcome : Outcome
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void count_outcome(publisher_lane_t lane, publisher_outcome_t outcome)
+{
+    UBaseType_t interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+    publisher_outcomes[lane][outcome]++;
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_status);
+}
+
+/******************************************************************************
+ * Function Name: lane_coalesce
+ ******************************************************************************
+ * Summary:
+ *  Function that replaces the oldest queued message for the topic of a new
+ *  message by the new message, keeping the order of the lane. All messages
+ *  of this node are published on MQTT_PUB_TOPIC. It must be called with the
+ *  scheduler suspended.
+ *
+ * Parameters:
+ *  QueueHandle_t queue : Queue of the lane
+ *  const publisher_data_t *msg : New message
+ *  publisher_data_t *replaced : Message that was replaced
+ *
+ * Return:
+ *  bool : true if a message was replaced, else false
+ *
+ ******************************************************************************/
+static bool lane_coalesce(QueueHandle_t queue, const publisher_data_t *msg,
+                          publisher_data_t *replaced)
+{
+    UBaseType_t waiting = uxQueueMessagesWaiting(queue);
+    publisher_data_t item;
+    bool found = false;
+
+    /* Rotate the whole lane once, swapping in the new message. */
+    for (UBaseType_t i = 0; i < waiting; i++)
+    {
+        xQueueReceive(queue, &item, 0);
+        if (!found && (item.cmd == PUBLISH_MQTT_MSG))
+        {
+            *replaced = item;
+            item = *msg;
+            found = true;
+        }
+        xQueueSend(queue, &item, 0);
+    }
+
+    return found;
+}
+
+/******************************************************************************
+ * Function Name: publisher_lanes_create
+ ******************************************************************************
+ * Summary:
+ *  Function that creates the queues of the priority lanes, unless they
+ *  exist from a previous connection.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  bool : true if the lanes exist, else false
+ *
+ ******************************************************************************/
+static bool publisher_lanes_create(void)
+{
+    if (publisher_lanes_ready)
+    {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < PUBLISHER_LANE_COUNT; i++)
+    {
+        publisher_lane_q[i] = xQueueCreate(publisher_lane_length[i], sizeof(publisher_data_t));
+        if (publisher_lane_q[i] == NULL)
+        {
+            return false;
+        }
+    }
+
+    /* Set last, as the senders check it to know the lanes exist. */
+    publisher_lanes_ready = true;
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: publisher_receive
+ ******************************************************************************
+ * Summary:
+ *  Function that waits for the next message and takes it from the highest
+ *  priority lane that is not empty.
+ *
+ * Parameters:
+ *  publisher_data_t *msg : Message received
+ *  publisher_lane_t *lane : Lane the message was received on
+ *  TickType_t ticks_to_wait : Time to wait for a message
+ *
+ * Return:
+ *  bool : true if a message was received, else false
+ *
+ ******************************************************************************/
+static bool publisher_receive(publisher_data_t *msg, publisher_lane_t *lane,
+                              TickType_t ticks_to_wait)
+{
+    for (uint32_t attempt = 0; attempt < 2u; attempt++)
+    {
+        for (uint32_t i = 0; i < PUBLISHER_LANE_COUNT; i++)
+        {
+            if (pdTRUE == xQueueReceive(publisher_lane_q[i], msg, 0))
+            {
+                *lane = (publisher_lane_t)i;
+                return true;
+            }
+        }
+
+        if (attempt == 0u)
+        {
+            ulTaskNotifyTake(pdTRUE, ticks_to_wait);
+        }
+    }
+
+    return false;
+}
+
 /******************************************************************************
  * Function Name: publisher_init
  ******************************************************************************
@@ -243,16 +624,80 @@ static void publisher_deinit(void)
     cyhal_gpio_enable_event(CYBSP_USER_BTN, CYHAL_GPIO_IRQ_FALL,
                             USER_BTN_INTR_PRIORITY, false);
     cyhal_gpio_free(CYBSP_USER_BTN);
+
+    /* Forget a press that was still settling. */
+    button_pending = false;
+    button_seen = button_edges;
+}
+
+/******************************************************************************
+ * Function Name: button_debounce
+ ******************************************************************************
+ * Summary:
+ *  Function that turns the user button edges counted by the ISR into
+ *  alarms. The first edge while the button is idle is the press, and its
+ *  alarm is sent at once. The bounce that follows only restarts the settle
+ *  time and is merged into that press; once the button has been quiet for
+ *  the settle time, its next edge is a new press.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  TickType_t : Time until the settle time of the last press ends, or
+ *               portMAX_DELAY if the button is idle
+ *
+ ******************************************************************************/
+static TickType_t button_debounce(void)
+{
+    uint32_t saved_intr = cyhal_system_critical_section_enter();
+    uint32_t edges = button_edges;
+    TickType_t edge_tick = button_edge_tick;
+    TickType_t remaining;
+
+    cyhal_system_critical_section_exit(saved_intr);
+
+    if (edges != button_seen)
+    {
+        if (!button_pending)
+        {
+            publisher_data_t publisher_q_data =
+            {
+                .cmd = PUBLISH_MQTT_MSG,
+                .data = (char *)"test"
+            };
+
+            /* The button press is the operator alarm of this node, so it is
+             * sent on the alarm lane and never waits behind other messages.
+             */
+            publisher_send(&publisher_q_data, PUBLISHER_LANE_ALARM, 0);
+        }
+        button_seen = edges;
+        button_pending = true;
+        button_deadline = edge_tick + pdMS_TO_TICKS(PUBLISHER_BUTTON_DEBOUNCE_MS);
+    }
+    if (!button_pending)
+    {
+        return portMAX_DELAY;
+    }
+
+    remaining = button_deadline - xTaskGetTickCount();
+    if ((remaining != 0u) && (remaining <= pdMS_TO_TICKS(PUBLISHER_BUTTON_DEBOUNCE_MS)))
+    {
+        return remaining;
+    }
+
+    button_pending = false;
+    return portMAX_DELAY;
 }
 
 /******************************************************************************
  * Function Name: isr_button_press
  ******************************************************************************
  * Summary:
- *  GPIO interrupt service routine. This function detects button
- *  presses and sends the publish command along with the data to be published 
- *  to the publisher task over a message queue. Based on the current device 
- *  state, the publish data is set so that the device state gets toggled.
+ *  GPIO interrupt service routine of the user button. It only counts the
+ *  edge, records when it happened and notifies the publisher task, which
+ *  sends the alarm and debounces the button, see button_debounce().
  *
  * Parameters:
  *  void *callback_arg : pointer to variable passed to the ISR (unused)
@@ -265,20 +710,15 @@ static void publisher_deinit(void)
 static void isr_button_press(void *callback_arg, cyhal_gpio_event_t event)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    publisher_data_t publisher_q_data;
 
     /* To avoid compiler warnings */
     (void) callback_arg;
     (void) event;
 
-    /* Assign the publish command to be sent to the publisher task. */
-    publisher_q_data.cmd = PUBLISH_MQTT_MSG;
+    button_edge_tick = xTaskGetTickCountFromISR();
+    button_edges++;
 
-    /* Assign the publish message*/
-    publisher_q_data.data = (char *)"test";
-            number = number + 1;
-    /* Send the command and data to publisher task over the queue */
-    xQueueSendFromISR(publisher_task_q, &publisher_q_data, &xHigherPriorityTaskWoken);
+    vTaskNotifyGiveFromISR(publisher_task_handle, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
@@ -42,6 +42,8 @@
 #ifndef PUBLISHER_TASK_H_
 #define PUBLISHER_TASK_H_
 
+#include <stdbool.h>
+
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
@@ -53,6 +55,22 @@
 #define PUBLISHER_TASK_PRIORITY               (2)
 #define PUBLISHER_TASK_STACK_SIZE             (1024 * 1)
 
+/* Settle time in milliseconds of the user button. The first edge sends the
+ * alarm at once; contact bounce and presses until the button has been left
+ * alone for this time are merged into it.
+ */
+#define PUBLISHER_BUTTON_DEBOUNCE_MS          (50u)
+
+/* What publisher_enqueue() does when a lane is full. Producers that must
+ * never wait, such as the sampling, enqueue with these policies; the MQTT
+ * task still waits on the control lane with publisher_send().
+ */
+#define PUBLISHER_CONTROL_OVERFLOW            (PUBLISHER_OVERFLOW_DROP_NEWEST)
+#define PUBLISHER_ALARM_OVERFLOW              (PUBLISHER_OVERFLOW_DROP_OLDEST)
+#define PUBLISHER_RESPONSE_OVERFLOW           (PUBLISHER_OVERFLOW_DROP_OLDEST)
+#define PUBLISHER_TELEMETRY_OVERFLOW          (PUBLISHER_OVERFLOW_COALESCE_LATEST)
+#define PUBLISHER_BULK_OVERFLOW               (PUBLISHER_OVERFLOW_DROP_NEWEST)
+
 /*******************************************************************************
 * Global Variables
 ********************************************************************************/
@@ -64,6 +82,48 @@ typedef enum
     PUBLISH_MQTT_MSG
 } publisher_cmd_t;
 
+/* Priority lanes of the publisher queue, highest priority first. The
+ * publisher always takes the next message from the highest non-empty lane,
+ * so an alarm never waits behind queued telemetry or a backlog drain.
+ * Commands for the publisher itself travel on the control lane.
+ */
+typedef enum
+{
+    PUBLISHER_LANE_CONTROL,
+    PUBLISHER_LANE_ALARM,
+    PUBLISHER_LANE_RESPONSE,
+    PUBLISHER_LANE_TELEMETRY,
+    PUBLISHER_LANE_BULK,
+    PUBLISHER_LANE_COUNT
+} publisher_lane_t;
+
+/* Overflow policies of a lane.
+ * DROP_NEWEST: the new message is dropped.
+ * DROP_OLDEST: the oldest queued message is dropped to make room.
+ * COALESCE_LATEST: the new message replaces the oldest queued message for
+ *                  the same topic, or the oldest message if there is none.
+ * SPILL: the new message is dropped and the producer is told to keep the
+ *        data elsewhere, the telemetry spills the record to the journal.
+ */
+typedef enum
+{
+    PUBLISHER_OVERFLOW_DROP_NEWEST,
+    PUBLISHER_OVERFLOW_DROP_OLDEST,
+    PUBLISHER_OVERFLOW_COALESCE_LATEST,
+    PUBLISHER_OVERFLOW_SPILL
+} publisher_overflow_t;
+
+/* Outcome of publisher_enqueue(), counted for every lane. */
+typedef enum
+{
+    PUBLISHER_ENQUEUED,
+    PUBLISHER_COALESCED,
+    PUBLISHER_DROPPED_OLDEST,
+    PUBLISHER_DROPPED_NEWEST,
+    PUBLISHER_SPILLED,
+    PUBLISHER_OUTCOME_COUNT
+} publisher_outcome_t;
+
 /* Struct to be passed via the publisher task queue */
 typedef struct{
     publisher_cmd_t cmd;
@@ -74,12 +134,16 @@ typedef struct{
 * Extern Variables
 ********************************************************************************/
 extern TaskHandle_t publisher_task_handle;
-extern QueueHandle_t publisher_task_q;
 
 /*******************************************************************************
 * Function Prototypes
 ********************************************************************************/
 void publisher_task(void *pvParameters);
+bool publisher_send(const publisher_data_t *msg, publisher_lane_t lane, TickType_t ticks_to_wait);
+bool publisher_send_from_isr(const publisher_data_t *msg, publisher_lane_t lane,
+                             BaseType_t *higher_priority_task_woken);
+publisher_outcome_t publisher_enqueue(const publisher_data_t *msg, publisher_lane_t lane);
+uint32_t publisher_outcome_count(publisher_lane_t lane, publisher_outcome_t outcome);
 
 #endif /* PUBLISHER_TASK_H_ */
 
@@ -2,9 +2,9 @@
 * File Name:   subscriber_task.c
 *
 * Description: This file contains the task that initializes the user LED GPIO,
-*              subscribes to the topic 'MQTT_SUB_TOPIC', and actuates the user LED
-*              based on the notifications received from the MQTT subscriber
-*              callback.
+*              subscribes to the MQTT topics of its routes, and routes each
+*              message that the MQTT subscriber callback hands over to the
+*              handlers of its topic.
 *
 * Related Document: See README.md
 *
@@ -60,7 +60,11 @@
 
 
 #include "publisher_task.h"  // Include the header file of the publisher task
-#include <stdlib.h>
+#include "ultrasound.h"
+#include "message_pool.h"
+#include "deferred_log.h"
+#include "command_dispatch.h"
+#include "topic_router.h"
 
 /******************************************************************************
 * Macros
@@ -71,13 +75,14 @@
 /* Time interval in milliseconds between MQTT subscribe retries. */
 #define MQTT_SUBSCRIBE_RETRY_INTERVAL_MS        (1000)
 
-/* The number of MQTT topics to be subscribed to. */
-#define SUBSCRIPTION_COUNT                      (1)
+/* The number of MQTT topics to be subscribed to, one per route. */
+#define SUBSCRIPTION_COUNT                      (sizeof(routes) / sizeof(routes[0]))
 
 /* Queue length of a message queue that is used to communicate with the 
- * subscriber task.
+ * subscriber task: one entry per inbound message buffer, so the MQTT
+ * callback never has to wait, and one for the commands of the MQTT task.
  */
-#define SUBSCRIBER_TASK_QUEUE_LENGTH            (1u)
+#define SUBSCRIBER_TASK_QUEUE_LENGTH            (SUBSCRIBER_MESSAGE_COUNT + 1u)
 
 /******************************************************************************
 * Global Variables
@@ -93,21 +98,54 @@ QueueHandle_t subscriber_task_q;
  */
 uint32_t current_device_state = DEVICE_OFF_STATE;
 
-/* Configure the subscription information structure. */
-static cy_mqtt_subscribe_info_t subscribe_info =
-{
-    .qos = (cy_mqtt_qos_t) MQTT_MESSAGES_QOS,
-    .topic = MQTT_SUB_TOPIC,
-    .topic_len = (sizeof(MQTT_SUB_TOPIC) - 1)
-};
+/* Latest distance in centimeters read by the sensor scheduler and the tick
+ * count at which it was received.
+ */
+static int latest_distance = ULTRASOUND_INVALID_DISTANCE;
+static TickType_t latest_distance_tick;
+
+/* Inbound message buffers, and the queue holding the free ones. */
+static subscriber_message_t subscriber_messages[SUBSCRIBER_MESSAGE_COUNT];
+static QueueHandle_t subscriber_free_q;
 
 /******************************************************************************
 * Function Prototypes
 *******************************************************************************/
 static void subscribe_to_topic(void);
 static void unsubscribe_from_topic(void);
-void print_heap_usage(char *msg);
-int read_ultasound(void);
+static void handle_message(subscriber_message_t *message);
+static void process_level(const sensor_sample_t *samples, uint32_t count);
+int read_ultrasound(void);
+static void command_read_ultrasound(int32_t argument);
+static void route_commands(const char *topic, size_t topic_len, const char *payload, size_t payload_len);
+static void route_read_ultrasound(const char *topic, size_t topic_len, const char *payload, size_t payload_len);
+
+/* Subscribed topics and their handlers, and their topic tree. All topics are
+ * subscribed to in one SUBSCRIBE packet.
+ */
+static const topic_route_t routes[] =
+{
+    TOPIC_ROUTE(MQTT_SUB_TOPIC, route_commands),
+    TOPIC_ROUTE(MQTT_SUB_NODE_TOPIC "/ultrasound", route_read_ultrasound)
+};
+static topic_router_t topic_router;
+
+/* Commands accepted on 'MQTT_SUB_TOPIC', and their hash index. */
+static const command_t commands[] =
+{
+    COMMAND("read_ultr", COMMAND_ARG_NONE, 0, 0, command_read_ultrasound)
+};
+static command_table_t command_table;
+
+/* Sink through which the sensor scheduler hands over the level samples. */
+const sensor_sink_t subscriber_level_sink =
+{
+    .init = NULL,
+    .process = process_level
+};
+
+/* Subscription information, filled in from the routes. */
+static cy_mqtt_subscribe_info_t subscribe_info[SUBSCRIPTION_COUNT];
 
 /******************************************************************************
  * Function Name: subscriber_task
@@ -139,11 +177,40 @@ void subscriber_task(void *pvParameters)
     cyhal_gpio_init(CYBSP_USER_LED, CYHAL_GPIO_DIR_OUTPUT, CYHAL_GPIO_DRIVE_PULLUP,
                     CYBSP_LED_STATE_OFF);
 
-    /* Subscribe to the specified MQTT topic. */
-    subscribe_to_topic();
+    /* Index the commands before any message can arrive. */
+    if (!command_table_init(&command_table, commands, sizeof(commands) / sizeof(commands[0])))
+    {
+        printf("Command table is invalid!\n");
+    }
+    if (!topic_router_init(&topic_router, routes, SUBSCRIPTION_COUNT))
+    {
+        printf("Topic routes are invalid!\n");
+    }
+    for (uint32_t i = 0; i < SUBSCRIPTION_COUNT; i++)
+    {
+        subscribe_info[i].qos = (cy_mqtt_qos_t) MQTT_MESSAGES_QOS;
+        subscribe_info[i].topic = routes[i].filter;
+        subscribe_info[i].topic_len = (uint16_t) routes[i].filter_len;
+    }
 
-    /* Create a message queue to communicate with other tasks and callbacks. */
+    /* Create a message queue to communicate with other tasks and callbacks,
+     * and the pool of inbound message buffers, before any message can arrive.
+     */
     subscriber_task_q = xQueueCreate(SUBSCRIBER_TASK_QUEUE_LENGTH, sizeof(subscriber_data_t));
+    subscriber_free_q = xQueueCreate(SUBSCRIBER_MESSAGE_COUNT, sizeof(subscriber_message_t *));
+    if ((subscriber_task_q == NULL) || (subscriber_free_q == NULL))
+    {
+        printf("Subscriber queue creation failed!\n");
+        vTaskDelete(NULL);
+    }
+    for (uint32_t i = 0; i < SUBSCRIBER_MESSAGE_COUNT; i++)
+    {
+        subscriber_message_t *message = &subscriber_messages[i];
+        xQueueSend(subscriber_free_q, &message, 0);
+    }
+
+    /* Subscribe to the MQTT topics of the routes. */
+    subscribe_to_topic();
 
     while (true)
     {
@@ -164,9 +231,9 @@ void subscriber_task(void *pvParameters)
                     break;
                 }
 
-                case 2:
+                case GET_PUSHED_DATA:
                 {
-
+                    handle_message(subscriber_q_data.message);
                     break;
                 }
             }
@@ -178,8 +245,8 @@ void subscriber_task(void *pvParameters)
  * Function Name: subscribe_to_topic
  ******************************************************************************
  * Summary:
- *  Function that subscribes to the MQTT topic specified by the macro 
- *  'MQTT_SUB_TOPIC'. This operation is retried a maximum of 
+ *  Function that subscribes to the MQTT topics of all routes in one
+ *  SUBSCRIBE packet. This operation is retried a maximum of 
  *  'MAX_SUBSCRIBE_RETRIES' times with interval of 
  *  'MQTT_SUBSCRIBE_RETRY_INTERVAL_MS' milliseconds.
  *
@@ -201,11 +268,14 @@ static void subscribe_to_topic(void)
     /* Subscribe with the configured parameters. */
     for (uint32_t retry_count = 0; retry_count < MAX_SUBSCRIBE_RETRIES; retry_count++)
     {
-        result = cy_mqtt_subscribe(mqtt_connection, &subscribe_info, SUBSCRIPTION_COUNT);
+        result = cy_mqtt_subscribe(mqtt_connection, subscribe_info, SUBSCRIPTION_COUNT);
         if (result == CY_RSLT_SUCCESS)
         {
-            printf("\nMQTT client subscribed to the topic '%.*s' successfully.\n", 
-                    subscribe_info.topic_len, subscribe_info.topic);
+            for (uint32_t i = 0; i < SUBSCRIPTION_COUNT; i++)
+            {
+                printf("\nMQTT client subscribed to the topic '%.*s' successfully.\n",
+                        subscribe_info[i].topic_len, subscribe_info[i].topic);
+            }
             break;
         }
 
@@ -227,10 +297,9 @@ static void subscribe_to_topic(void)
  * Function Name: mqtt_subscription_callback
  ******************************************************************************
  * Summary:
- *  Callback to handle incoming MQTT messages. This callback prints the 
- *  contents of the incoming message and informs the subscriber task, via a 
- *  message queue, to turn on / turn off the device based on the received 
- *  message.
+ *  Callback to handle incoming MQTT messages. This callback copies the
+ *  topic and payload into an inbound message buffer and hands it to the
+ *  subscriber task, via a message queue, which handles the message.
  *
  * Parameters:
  *  cy_mqtt_publish_info_t *received_msg_info : Information structure of the 
@@ -244,93 +313,238 @@ void mqtt_subscription_callback(cy_mqtt_publish_info_t *received_msg_info)
 {
     /* Data to be sent to the subscriber task queue. */
     subscriber_data_t subscriber_q_data;
+    size_t topic_len = received_msg_info->topic_len;
+    size_t payload_len = received_msg_info->payload_len;
+
+    /* The topic and payload live in the MQTT receive buffer, which is reused
+     * once this callback returns, so only their lengths are logged.
+     */
+    LOG_INFO("Subscriber: Incoming MQTT message, topic %u bytes, QoS %d, payload %u bytes\n",
+             (unsigned int) topic_len, (int) received_msg_info->qos, (unsigned int) payload_len);
+
+    if ((topic_len + payload_len) > SUBSCRIBER_MESSAGE_SIZE)
+    {
+        LOG_WARN("Subscriber: message too large, dropped\n");
+        return;
+    }
+
+    /* Never wait here: the MQTT client handles nothing else, not even its
+     * keep-alive, until this callback returns.
+     */
+    if (pdTRUE != xQueueReceive(subscriber_free_q, &subscriber_q_data.message, 0))
+    {
+        LOG_WARN("Subscriber: no free message buffer, message dropped\n");
+        return;
+    }
 
-    printf("  \nSubsciber: Incoming MQTT message received:\n"
-           "    Publish topic name: %.*s\n"
-           "    Publish QoS: %d\n"
-           "    Publish payload: %.*s\n",
-           received_msg_info->topic_len, received_msg_info->topic,
-           (int) received_msg_info->qos,
-           (int) received_msg_info->payload_len, (const char *)received_msg_info->payload);
+    subscriber_q_data.message->topic_len = (uint16_t) topic_len;
+    subscriber_q_data.message->payload_len = (uint16_t) payload_len;
+    memcpy(subscriber_q_data.message->data, received_msg_info->topic, topic_len);
+    memcpy(&subscriber_q_data.message->data[topic_len], received_msg_info->payload, payload_len);
 
     /* Assign the command to be sent to the subscriber task. */
-    subscriber_q_data.cmd = 2;
-
-    print_heap_usage("MQTT subscription callback");
-
-    const char expectedPayload[] = "read_ultr";
-    if (received_msg_info->payload_len == sizeof(expectedPayload) - 1 &&
-        memcmp(received_msg_info->payload, expectedPayload, sizeof(expectedPayload) - 1) == 0) {
-        int distance = read_ultrasound();
-        publisher_data_t publisher_q_data;
-        publisher_q_data.cmd = PUBLISH_MQTT_MSG;
-        publisher_q_data.data = (char *)malloc(sizeof(char) * 20);
-        snprintf(publisher_q_data.data, 20, "height = %d", distance);
-        printf("Sending message from subscriber task: %s\n", publisher_q_data.data);
-
-        BaseType_t sendResult = xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
-        if (sendResult != pdPASS) {
-            printf("Failed to send message to publisher task queue.\n");
-            free(publisher_q_data.data);
-        }
+    subscriber_q_data.cmd = GET_PUSHED_DATA;
+
+    /* Send the command and data to subscriber task queue */
+    if (pdTRUE != xQueueSend(subscriber_task_q, &subscriber_q_data, 0))
+    {
+        xQueueSend(subscriber_free_q, &subscriber_q_data.message, 0);
+        LOG_WARN("Subscriber: queue full, message dropped\n");
+    }
+}
+
+/******************************************************************************
+ * Function Name: handle_message
+ ******************************************************************************
+ * Summary:
+ *  Function that routes a received message to the handlers of its topic and
+ *  returns its buffer to the pool.
+ *
+ * Parameters:
+ *  subscriber_message_t *message : Message copied by the MQTT callback
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void handle_message(subscriber_message_t *message)
+{
+    if (0u == topic_router_dispatch(&topic_router, message->data, message->topic_len,
+                                    &message->data[message->topic_len], message->payload_len))
+    {
+        LOG_WARN("Subscriber: no route for the topic\n");
+    }
+
+    xQueueSend(subscriber_free_q, &message, 0);
+}
+
+/******************************************************************************
+ * Function Name: route_commands
+ ******************************************************************************
+ * Summary:
+ *  Handler of 'MQTT_SUB_TOPIC', whose payload names the command, see the
+ *  command table.
+ *
+ * Parameters:
+ *  const char *topic : Topic of the message (unused)
+ *  size_t topic_len : Length of the topic (unused)
+ *  const char *payload : Payload of the message
+ *  size_t payload_len : Length of the payload
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void route_commands(const char *topic, size_t topic_len, const char *payload, size_t payload_len)
+{
+    (void) topic;
+    (void) topic_len;
+
+    if (COMMAND_OK != command_dispatch(&command_table, payload, payload_len))
+    {
+        LOG_WARN("Subscriber: payload is no valid command\n");
+    }
+}
+
+/******************************************************************************
+ * Function Name: route_read_ultrasound
+ ******************************************************************************
+ * Summary:
+ *  Handler of 'MQTT_SUB_NODE_TOPIC'/ultrasound, which requests a distance
+ *  measurement. The payload is ignored.
+ *
+ * Parameters:
+ *  const char *topic : Topic of the message (unused)
+ *  size_t topic_len : Length of the topic (unused)
+ *  const char *payload : Payload of the message (unused)
+ *  size_t payload_len : Length of the payload (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void route_read_ultrasound(const char *topic, size_t topic_len, const char *payload, size_t payload_len)
+{
+    (void) topic;
+    (void) topic_len;
+    (void) payload;
+    (void) payload_len;
+
+    command_read_ultrasound(0);
+}
+
+/******************************************************************************
+ * Function Name: command_read_ultrasound
+ ******************************************************************************
+ * Summary:
+ *  Handler of the "read_ultr" command. It publishes the latest distance
+ *  as the response to the command.
+ *
+ * Parameters:
+ *  int32_t argument : Unused
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void command_read_ultrasound(int32_t argument)
+{
+    publisher_data_t publisher_q_data;
+    int distance = read_ultrasound();
+
+    (void) argument;
+
+    publisher_q_data.cmd = PUBLISH_MQTT_MSG;
+    publisher_q_data.data = message_pool_acquire(0);
+    if (publisher_q_data.data == NULL)
+    {
+        LOG_WARN("Subscriber: no free message buffer, reading dropped.\n");
+        return;
     }
+    snprintf(publisher_q_data.data, MESSAGE_POOL_BUFFER_SIZE, "height = %d", distance);
+    LOG_INFO("Subscriber: sending height = %d\n", distance);
+
+    /* The publisher takes over the buffer in any case, so the subscriber
+     * task does not wait for it.
+     */
+    publisher_enqueue(&publisher_q_data, PUBLISHER_LANE_RESPONSE);
 }
 
 
 
-int read_ultrasound(){
-	cy_rslt_t result;
-	result = cyhal_gpio_init(P9_2, CYHAL_GPIO_DIR_OUTPUT, CYHAL_GPIO_DRIVE_STRONG, false); //trigger pin
-	result = cyhal_gpio_init(P9_1, CYHAL_GPIO_DIR_INPUT, CYHAL_GPIO_DRIVE_NONE, false);    // echo pin
-	int counter =0;
-	int flag =0;
-	int distance =0;
-	cyhal_gpio_toggle(P8_0);
-
-	cyhal_gpio_write(P9_2, true);
-	    	    	cyhal_system_delay_us(10);
-	    	    	cyhal_gpio_write(P9_2, false);
-
-	    	    	while(flag != 2)
-	    	    	{
-	    	    		 if(1UL == Cy_GPIO_Read(P9_1_PORT, P9_1_NUM))
-	    	    		    {
-	    	    		        //printf("high");
-	    	    		        counter = counter+1 ;
-	    	    		        flag = 1;
-
-	    	    		    }
-	    	    		    else
-	    	    		    {
-
-	    	    		    	if( flag == 1){
-	    	    		    		flag = 2 ;
-	    	    		    	}
-	    	    		        //printf("low");
-	    	    		    }
-	    	    	}
-	    	    	distance = (counter-132)/201.50; // is proefondervindelijk gevonden
-	    	    	if((distance>330) | (counter >1084900000))
-	    	    	{
-	    	    		printf("\n\r measurement inaccurate");
-	    	    		distance = -1;
-	    	    	}
-	    	    	else{
-	    	    	printf("\n\r distance in centimeters: %d ",distance );
-	    	    	printf("counter = %d\r\n", counter);
-	    	    	}
-	    	    	cyhal_system_delay_ms(1000);
-
-	    			cyhal_gpio_toggle(P8_0);
-	    	    	return(distance);
+/******************************************************************************
+ * Function Name: process_level
+ ******************************************************************************
+ * Summary:
+ *  Sink of the sensor scheduler. It keeps the latest distance measured by
+ *  the ultrasonic sensor and toggles P8_0 for every echo.
+ *
+ * Parameters:
+ *  const sensor_sample_t *samples : Samples of one read
+ *  uint32_t count : Number of samples
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void process_level(const sensor_sample_t *samples, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (samples[i].channel != SENSOR_CHANNEL_LEVEL)
+		{
+			continue;
+		}
+
+		taskENTER_CRITICAL();
+		latest_distance = (int)(samples[i].value / (1l << SENSOR_VALUE_FRAC_BITS));
+		latest_distance_tick = xTaskGetTickCount();
+		taskEXIT_CRITICAL();
+		cyhal_gpio_toggle(P8_0);
+	}
+}
+
+/******************************************************************************
+ * Function Name: read_ultrasound
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the latest distance measured by the sensor
+ *  scheduler, which pings the ultrasonic sensor on its own period, so the
+ *  caller never waits for an echo.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  int : Distance in centimeters, or -1 if there is no recent measurement
+ *
+ ******************************************************************************/
+int read_ultrasound(void)
+{
+	int distance;
+	TickType_t age;
+
+	taskENTER_CRITICAL();
+	distance = latest_distance;
+	age = xTaskGetTickCount() - latest_distance_tick;
+	taskEXIT_CRITICAL();
+
+	if ((distance == ULTRASOUND_INVALID_DISTANCE) ||
+	    (age > pdMS_TO_TICKS(SUBSCRIBER_DISTANCE_MAX_AGE_MS)))
+	{
+		LOG_WARN("Ultrasound: no recent measurement\n");
+		return ULTRASOUND_INVALID_DISTANCE;
+	}
+
+	LOG_INFO("Ultrasound: distance in centimeters: %d\n", distance);
+	return distance;
 }
 
 /******************************************************************************
  * Function Name: unsubscribe_from_topic
  ******************************************************************************
  * Summary:
- *  Function that unsubscribes from the topic specified by the macro 
- *  'MQTT_SUB_TOPIC'.
+ *  Function that unsubscribes from the topics of all routes.
  *
  * Parameters:
  *  void 
@@ -342,7 +556,7 @@ int read_ultrasound(){
 static void unsubscribe_from_topic(void)
 {
     cy_rslt_t result = cy_mqtt_unsubscribe(mqtt_connection, 
-                                           (cy_mqtt_unsubscribe_info_t *) &subscribe_info, 
+                                           (cy_mqtt_unsubscribe_info_t *) subscribe_info,
                                            SUBSCRIPTION_COUNT);
 
     if (result != CY_RSLT_SUCCESS)
@@ -47,6 +47,8 @@
 #include "queue.h"
 #include "cy_mqtt_api.h"
 
+#include "sensor.h"
+
 /*******************************************************************************
 * Macros
 ********************************************************************************/
@@ -58,6 +60,21 @@
 #define DEVICE_ON_STATE                    (0x00u)
 #define DEVICE_OFF_STATE                   (0x01u)
 
+/* Number of inbound message buffers. It bounds the number of received
+ * messages waiting for the subscriber task; further messages are dropped.
+ */
+#define SUBSCRIBER_MESSAGE_COUNT           (4u)
+
+/* Size in bytes of one inbound message buffer, which holds the topic and the
+ * payload back to back.
+ */
+#define SUBSCRIBER_MESSAGE_SIZE            (256u)
+
+/* Age in milliseconds after which the latest distance read by the sensor
+ * scheduler is no longer reported; the sensor then missed several pings.
+ */
+#define SUBSCRIBER_DISTANCE_MAX_AGE_MS     (500u)
+
 /*******************************************************************************
 * Global Variables
 ********************************************************************************/
@@ -66,13 +83,24 @@ typedef enum
 {
     SUBSCRIBE_TO_TOPIC,
     UNSUBSCRIBE_FROM_TOPIC,
-    UPDATE_DEVICE_STATE
+    GET_PUSHED_DATA
 } subscriber_cmd_t;
 
-/* Struct to be passed via the subscriber task queue */
+/* Received message, copied out of the MQTT receive buffer. */
+typedef struct
+{
+    uint16_t topic_len;
+    uint16_t payload_len;
+    char data[SUBSCRIBER_MESSAGE_SIZE];
+} subscriber_message_t;
+
+/* Struct to be passed via the subscriber task queue. For GET_PUSHED_DATA,
+ * 'message' is an inbound buffer that the subscriber task returns to the
+ * pool once it is handled.
+ */
 typedef struct{
     subscriber_cmd_t cmd;
-    uint8_t data;
+    subscriber_message_t *message;
 } subscriber_data_t;
 
 /*******************************************************************************
@@ -81,6 +109,7 @@ typedef struct{
 extern TaskHandle_t subscriber_task_handle;
 extern QueueHandle_t subscriber_task_q;
 extern uint32_t current_device_state;
+extern const sensor_sink_t subscriber_level_sink;
 
 /*******************************************************************************
 * Function Prototypes
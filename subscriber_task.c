@@ -2,9 +2,9 @@
 * File Name:   subscriber_task.c
 *
 * Description: This file contains the task that initializes the user LED GPIO,
-*              subscribes to the topic 'MQTT_SUB_TOPIC', and actuates the user LED
-*              based on the notifications received from the MQTT subscriber
-*              callback.
+*              subscribes to the MQTT topics of its routes, and routes each
+*              message that the MQTT subscriber callback hands over to the
+*              handlers of its topic.
 *
 * Related Document: See README.md
 *
@@ -58,6 +58,11 @@
 #include "cy_mqtt_api.h"
 #include "cy_retarget_io.h"
 #include "stdio.h"
+#include "deferred_log.h"
+#include "command_dispatch.h"
+#include "topic_router.h"
+#include "actuator.h"
+
 /******************************************************************************
 * Macros
 ******************************************************************************/
@@ -67,19 +72,14 @@
 /* Time interval in milliseconds between MQTT subscribe retries. */
 #define MQTT_SUBSCRIBE_RETRY_INTERVAL_MS        (1000)
 
-/* The number of MQTT topics to be subscribed to. */
-#define SUBSCRIPTION_COUNT                      (1)
+/* The number of MQTT topics to be subscribed to, one per route. */
+#define SUBSCRIPTION_COUNT                      (sizeof(routes) / sizeof(routes[0]))
 
 /* Queue length of a message queue that is used to communicate with the 
- * subscriber task.
+ * subscriber task: one entry per inbound message buffer, so the MQTT
+ * callback never has to wait, and one for the commands of the MQTT task.
  */
-#define SUBSCRIBER_TASK_QUEUE_LENGTH            (1u)
-
-
-#define SERVO_MAXIMUM_ROTATION_DEGREES 270
-#define SERVO_TIME_RANGE 2000
-#define MINIMUM_PULSE_WIDTH 500
-#define PULSE_PERIOD 20000
+#define SUBSCRIBER_TASK_QUEUE_LENGTH            (SUBSCRIBER_MESSAGE_COUNT + 1u)
 
 /******************************************************************************
 * Global Variables
@@ -95,24 +95,39 @@ QueueHandle_t subscriber_task_q;
  */
 uint32_t current_device_state = DEVICE_OFF_STATE;
 
-/* Configure the subscription information structure. */
-static cy_mqtt_subscribe_info_t subscribe_info =
-{
-    .qos = (cy_mqtt_qos_t) MQTT_MESSAGES_QOS,
-    .topic = MQTT_SUB_TOPIC,
-    .topic_len = (sizeof(MQTT_SUB_TOPIC) - 1)
-};
-
-cyhal_pwm_t pwm_obj;
-
-int previouspwm;
+/* Inbound message buffers, and the queue holding the free ones. */
+static subscriber_message_t subscriber_messages[SUBSCRIBER_MESSAGE_COUNT];
+static QueueHandle_t subscriber_free_q;
 
 /******************************************************************************
 * Function Prototypes
 *******************************************************************************/
 static void subscribe_to_topic(void);
 static void unsubscribe_from_topic(void);
-void print_heap_usage(char *msg);
+static void handle_message(subscriber_message_t *message);
+static void command_move_servo(int32_t degree);
+static void route_commands(const char *topic, size_t topic_len, const char *payload, size_t payload_len);
+static void route_servo(const char *topic, size_t topic_len, const char *payload, size_t payload_len);
+
+/* Subscribed topics and their handlers, and their topic tree. All topics are
+ * subscribed to in one SUBSCRIBE packet.
+ */
+static const topic_route_t routes[] =
+{
+    TOPIC_ROUTE(MQTT_SUB_TOPIC, route_commands),
+    TOPIC_ROUTE(MQTT_SUB_NODE_TOPIC "/servo", route_servo)
+};
+static topic_router_t topic_router;
+
+/* Commands accepted on 'MQTT_SUB_TOPIC', and their hash index. */
+static const command_t commands[] =
+{
+    COMMAND("move_servo_", COMMAND_ARG_INT, 0, SERVO_MAXIMUM_ROTATION_DEGREES, command_move_servo)
+};
+static command_table_t command_table;
+
+/* Subscription information, filled in from the routes. */
+static cy_mqtt_subscribe_info_t subscribe_info[SUBSCRIPTION_COUNT];
 
 /******************************************************************************
  * Function Name: subscriber_task
@@ -141,14 +156,40 @@ void subscriber_task(void *pvParameters)
     cyhal_gpio_init(CYBSP_USER_LED, CYHAL_GPIO_DIR_OUTPUT, CYHAL_GPIO_DRIVE_PULLUP,
                     CYBSP_LED_STATE_OFF);
 
-    /* Subscribe to the specified MQTT topic. */
-    subscribe_to_topic();
+    /* Index the commands before any message can arrive. */
+    if (!command_table_init(&command_table, commands, sizeof(commands) / sizeof(commands[0])))
+    {
+        printf("Command table is invalid!\n");
+    }
+    if (!topic_router_init(&topic_router, routes, SUBSCRIPTION_COUNT))
+    {
+        printf("Topic routes are invalid!\n");
+    }
+    for (uint32_t i = 0; i < SUBSCRIPTION_COUNT; i++)
+    {
+        subscribe_info[i].qos = (cy_mqtt_qos_t) MQTT_MESSAGES_QOS;
+        subscribe_info[i].topic = routes[i].filter;
+        subscribe_info[i].topic_len = (uint16_t) routes[i].filter_len;
+    }
 
-    /* Create a message queue to communicate with other tasks and callbacks. */
+    /* Create a message queue to communicate with other tasks and callbacks,
+     * and the pool of inbound message buffers, before any message can arrive.
+     */
     subscriber_task_q = xQueueCreate(SUBSCRIBER_TASK_QUEUE_LENGTH, sizeof(subscriber_data_t));
-    /* Initialize PWM on the supplied pin and assign a new clock */
-    cy_rslt_t result = cyhal_pwm_init(&pwm_obj, P6_2, NULL);
-    /* Set a duty cycle of 50% and frequency of 1Hz */
+    subscriber_free_q = xQueueCreate(SUBSCRIBER_MESSAGE_COUNT, sizeof(subscriber_message_t *));
+    if ((subscriber_task_q == NULL) || (subscriber_free_q == NULL))
+    {
+        printf("Subscriber queue creation failed!\n");
+        vTaskDelete(NULL);
+    }
+    for (uint32_t i = 0; i < SUBSCRIBER_MESSAGE_COUNT; i++)
+    {
+        subscriber_message_t *message = &subscriber_messages[i];
+        xQueueSend(subscriber_free_q, &message, 0);
+    }
+
+    /* Subscribe to the MQTT topics of the routes. */
+    subscribe_to_topic();
 
     while (true)
     {
@@ -171,7 +212,7 @@ void subscriber_task(void *pvParameters)
 
                 case GET_PUSHED_DATA:
                 {
-
+                    handle_message(subscriber_q_data.message);
                     break;
                 }
             }
@@ -183,8 +224,8 @@ void subscriber_task(void *pvParameters)
  * Function Name: subscribe_to_topic
  ******************************************************************************
  * Summary:
- *  Function that subscribes to the MQTT topic specified by the macro 
- *  'MQTT_SUB_TOPIC'. This operation is retried a maximum of 
+ *  Function that subscribes to the MQTT topics of all routes in one
+ *  SUBSCRIBE packet. This operation is retried a maximum of 
  *  'MAX_SUBSCRIBE_RETRIES' times with interval of 
  *  'MQTT_SUBSCRIBE_RETRY_INTERVAL_MS' milliseconds.
  *
@@ -206,11 +247,14 @@ static void subscribe_to_topic(void)
     /* Subscribe with the configured parameters. */
     for (uint32_t retry_count = 0; retry_count < MAX_SUBSCRIBE_RETRIES; retry_count++)
     {
-        result = cy_mqtt_subscribe(mqtt_connection, &subscribe_info, SUBSCRIPTION_COUNT);
+        result = cy_mqtt_subscribe(mqtt_connection, subscribe_info, SUBSCRIPTION_COUNT);
         if (result == CY_RSLT_SUCCESS)
         {
-            printf("\nMQTT client subscribed to the topic '%.*s' successfully.\n", 
-                    subscribe_info.topic_len, subscribe_info.topic);
+            for (uint32_t i = 0; i < SUBSCRIPTION_COUNT; i++)
+            {
+                printf("\nMQTT client subscribed to the topic '%.*s' successfully.\n",
+                        subscribe_info[i].topic_len, subscribe_info[i].topic);
+            }
             break;
         }
 
@@ -229,36 +273,13 @@ static void subscribe_to_topic(void)
 }
 
 
-void servoRotate(cyhal_pwm_t *pwm_obj, int degree)
-{
-	float pulseWidthPerDegree = ((float)SERVO_TIME_RANGE/(float)SERVO_MAXIMUM_ROTATION_DEGREES);
-	int pulseWidthPosition = (int)(pulseWidthPerDegree * degree) + MINIMUM_PULSE_WIDTH;
-	printf("moving servo to %d\r\n", degree);
-	if (previouspwm < pulseWidthPosition){
-		for(int i = previouspwm; i < pulseWidthPosition; i ++){
-			cyhal_pwm_set_period(pwm_obj, PULSE_PERIOD, i);
-			cyhal_pwm_start(pwm_obj);
-			vTaskDelay(pdMS_TO_TICKS(10));  // Add a delay between readings
-		}
-	}
-	if (previouspwm > pulseWidthPosition){
-			for(int i = previouspwm; i > pulseWidthPosition; i --){
-				cyhal_pwm_set_period(pwm_obj, PULSE_PERIOD, i);
-				cyhal_pwm_start(pwm_obj);
-				vTaskDelay(pdMS_TO_TICKS(10));  // Add a delay between readings
-			}
-		}
-	previouspwm = pulseWidthPosition;
-}
-
 /******************************************************************************
  * Function Name: mqtt_subscription_callback
  ******************************************************************************
  * Summary:
- *  Callback to handle incoming MQTT messages. This callback prints the 
- *  contents of the incoming message and informs the subscriber task, via a 
- *  message queue, to turn on / turn off the device based on the received 
- *  message.
+ *  Callback to handle incoming MQTT messages. This callback copies the
+ *  topic and payload into an inbound message buffer and hands it to the
+ *  subscriber task, via a message queue, which handles the message.
  *
  * Parameters:
  *  cy_mqtt_publish_info_t *received_msg_info : Information structure of the 
@@ -272,44 +293,161 @@ void mqtt_subscription_callback(cy_mqtt_publish_info_t *received_msg_info)
 {
     /* Data to be sent to the subscriber task queue. */
     subscriber_data_t subscriber_q_data;
+    size_t topic_len = received_msg_info->topic_len;
+    size_t payload_len = received_msg_info->payload_len;
+
+    /* The topic and payload live in the MQTT receive buffer, which is reused
+     * once this callback returns, so only their lengths are logged.
+     */
+    LOG_INFO("Subscriber: Incoming MQTT message, topic %u bytes, QoS %d, payload %u bytes\n",
+             (unsigned int) topic_len, (int) received_msg_info->qos, (unsigned int) payload_len);
+
+    if ((topic_len + payload_len) > SUBSCRIBER_MESSAGE_SIZE)
+    {
+        LOG_WARN("Subscriber: message too large, dropped\n");
+        return;
+    }
+
+    /* Never wait here: the MQTT client handles nothing else, not even its
+     * keep-alive, until this callback returns.
+     */
+    if (pdTRUE != xQueueReceive(subscriber_free_q, &subscriber_q_data.message, 0))
+    {
+        LOG_WARN("Subscriber: no free message buffer, message dropped\n");
+        return;
+    }
 
-    printf("  \nSubsciber: Incoming MQTT message received:\n"
-           "    Publish topic name: %.*s\n"
-           "    Publish QoS: %d\n"
-           "    Publish payload: %.*s\n",
-           received_msg_info->topic_len, received_msg_info->topic,
-           (int) received_msg_info->qos,
-           (int) received_msg_info->payload_len, (const char *)received_msg_info->payload);
+    subscriber_q_data.message->topic_len = (uint16_t) topic_len;
+    subscriber_q_data.message->payload_len = (uint16_t) payload_len;
+    memcpy(subscriber_q_data.message->data, received_msg_info->topic, topic_len);
+    memcpy(&subscriber_q_data.message->data[topic_len], received_msg_info->payload, payload_len);
 
     /* Assign the command to be sent to the subscriber task. */
     subscriber_q_data.cmd = GET_PUSHED_DATA;
 
-    print_heap_usage("MQTT subscription callback");
-    const char moveServoPrefix[] = "move_servo_";
-
-	if (received_msg_info->payload_len >= sizeof(moveServoPrefix) - 1 &&
-		memcmp(received_msg_info->payload, moveServoPrefix, sizeof(moveServoPrefix) - 1) == 0) {
-		printf("prefix is a match!\r\n");
-		// Extract the integer part from the payload
-		int value = 0;
-		if (sscanf(received_msg_info->payload + sizeof(moveServoPrefix) - 1, "%d", &value) == 1) {
-			printf("value = %d\r\n", value);
-		}
-		if (value >= 0) {
-			// Use the extracted value as a parameter in turnServo
-			servoRotate(&pwm_obj, value);
-		}
-    }
     /* Send the command and data to subscriber task queue */
-    xQueueSend(subscriber_task_q, &subscriber_q_data, portMAX_DELAY);
+    if (pdTRUE != xQueueSend(subscriber_task_q, &subscriber_q_data, 0))
+    {
+        xQueueSend(subscriber_free_q, &subscriber_q_data.message, 0);
+        LOG_WARN("Subscriber: queue full, message dropped\n");
+    }
+}
+
+/******************************************************************************
+ * Function Name: handle_message
+ ******************************************************************************
+ * Summary:
+ *  Function that routes a received message to the handlers of its topic and
+ *  returns its buffer to the pool.
+ *
+ * Parameters:
+ *  subscriber_message_t *message : Message copied by the MQTT callback
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void handle_message(subscriber_message_t *message)
+{
+    if (0u == topic_router_dispatch(&topic_router, message->data, message->topic_len,
+                                    &message->data[message->topic_len], message->payload_len))
+    {
+        LOG_WARN("Subscriber: no route for the topic\n");
+    }
+
+    xQueueSend(subscriber_free_q, &message, 0);
+}
+
+/******************************************************************************
+ * Function Name: route_commands
+ ******************************************************************************
+ * Summary:
+ *  Handler of 'MQTT_SUB_TOPIC', whose payload names the command, see the
+ *  command table.
+ *
+ * Parameters:
+ *  const char *topic : Topic of the message (unused)
+ *  size_t topic_len : Length of the topic (unused)
+ *  const char *payload : Payload of the message
+ *  size_t payload_len : Length of the payload
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void route_commands(const char *topic, size_t topic_len, const char *payload, size_t payload_len)
+{
+    (void) topic;
+    (void) topic_len;
+
+    if (COMMAND_OK != command_dispatch(&command_table, payload, payload_len))
+    {
+        LOG_WARN("Subscriber: payload is no valid command\n");
+    }
+}
+
+/******************************************************************************
+ * Function Name: route_servo
+ ******************************************************************************
+ * Summary:
+ *  Handler of 'MQTT_SUB_NODE_TOPIC'/servo, whose payload is the servo
+ *  position in degrees.
+ *
+ * Parameters:
+ *  const char *topic : Topic of the message (unused)
+ *  size_t topic_len : Length of the topic (unused)
+ *  const char *payload : Payload of the message
+ *  size_t payload_len : Length of the payload
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void route_servo(const char *topic, size_t topic_len, const char *payload, size_t payload_len)
+{
+    int32_t degree;
+
+    (void) topic;
+    (void) topic_len;
+
+    if (!command_parse_int(payload, payload_len, 0, SERVO_MAXIMUM_ROTATION_DEGREES, &degree))
+    {
+        LOG_WARN("Subscriber: servo position is invalid\n");
+        return;
+    }
+    command_move_servo(degree);
+}
+
+/******************************************************************************
+ * Function Name: command_move_servo
+ ******************************************************************************
+ * Summary:
+ *  Handler of the "move_servo_<degree>" command.
+ *
+ * Parameters:
+ *  int32_t degree : Servo position in degrees, 0 to
+ *                   'SERVO_MAXIMUM_ROTATION_DEGREES'
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void command_move_servo(int32_t degree)
+{
+    /* The servo is moved by the actuator task, so the subscriber task
+     * returns at once whatever the travel.
+     */
+    if (!actuator_move_servo(degree))
+    {
+        LOG_WARN("Subscriber: actuator not ready, servo command dropped\n");
+    }
 }
 
 /******************************************************************************
  * Function Name: unsubscribe_from_topic
  ******************************************************************************
  * Summary:
- *  Function that unsubscribes from the topic specified by the macro 
- *  'MQTT_SUB_TOPIC'.
+ *  Function that unsubscribes from the topics of all routes.
  *
  * Parameters:
  *  void 
@@ -321,7 +459,7 @@ void mqtt_subscription_callback(cy_mqtt_publish_info_t *received_msg_info)
 static void unsubscribe_from_topic(void)
 {
     cy_rslt_t result = cy_mqtt_unsubscribe(mqtt_connection, 
-                                           (cy_mqtt_unsubscribe_info_t *) &subscribe_info, 
+                                           (cy_mqtt_unsubscribe_info_t *) subscribe_info,
                                            SUBSCRIPTION_COUNT);
 
     if (result != CY_RSLT_SUCCESS)
@@ -58,6 +58,16 @@
 #define DEVICE_ON_STATE                    (0x00u)
 #define DEVICE_OFF_STATE                   (0x01u)
 
+/* Number of inbound message buffers. It bounds the number of received
+ * messages waiting for the subscriber task; further messages are dropped.
+ */
+#define SUBSCRIBER_MESSAGE_COUNT           (4u)
+
+/* Size in bytes of one inbound message buffer, which holds the topic and the
+ * payload back to back.
+ */
+#define SUBSCRIBER_MESSAGE_SIZE            (256u)
+
 /*******************************************************************************
 * Global Variables
 ********************************************************************************/
@@ -69,10 +79,21 @@ typedef enum
     GET_PUSHED_DATA
 } subscriber_cmd_t;
 
-/* Struct to be passed via the subscriber task queue */
+/* Received message, copied out of the MQTT receive buffer. */
+typedef struct
+{
+    uint16_t topic_len;
+    uint16_t payload_len;
+    char data[SUBSCRIBER_MESSAGE_SIZE];
+} subscriber_message_t;
+
+/* Struct to be passed via the subscriber task queue. For GET_PUSHED_DATA,
+ * 'message' is an inbound buffer that the subscriber task returns to the
+ * pool once it is handled.
+ */
 typedef struct{
     subscriber_cmd_t cmd;
-    uint8_t data;
+    subscriber_message_t *message;
 } subscriber_data_t;
 
 /*******************************************************************************
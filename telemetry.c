@@ -0,0 +1,844 @@
+/******************************************************************************
+* File Name:   telemetry.c
+*
+* Description: This file contains the telemetry stage between the sensor
+*              scheduler and the publisher task. Depending on the
+*              configuration it either publishes the latest sample of every
+*              channel at a fixed interval, or accumulates running statistics
+*              per channel and publishes one aggregate record per window. In
+*              report-by-exception mode a message is only sent when a channel
+*              has left its deadband or the heartbeat interval has expired.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <string.h>
+
+#include "cyhal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "cy_retarget_io.h"
+
+#include "telemetry.h"
+#include "publisher_task.h"
+#include "running_stats.h"
+#include "device_clock.h"
+#include "telemetry_codec.h"
+#include "mqtt_client_config.h"
+#include "journal.h"
+#include "deferred_log.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Size of a sample value formatted as text, e.g. "-12345.6789". */
+#define VALUE_TEXT_LEN                  (14u)
+
+/* Size of a device clock timestamp formatted as text, e.g. "4294967295.999999". */
+#define TIMESTAMP_TEXT_LEN              (18u)
+
+/* Number of decimals of the published values and variances. */
+#define VALUE_DECIMALS                  (2u)
+#define VARIANCE_DECIMALS               (4u)
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Values of every channel in the last published message of a report. */
+typedef struct
+{
+    int32_t value[SENSOR_CHANNEL_COUNT];
+    bool valid[SENSOR_CHANNEL_COUNT];
+    TickType_t last_publish;
+} report_state_t;
+
+#if TELEMETRY_ENABLE_STATISTICS
+/* Running statistics of every channel over one window. */
+typedef struct
+{
+    uint32_t length_ms;
+    TickType_t start;
+    running_stats_t stats[SENSOR_CHANNEL_COUNT];
+    uint64_t first_us;
+    uint64_t last_us;
+    report_state_t report;
+} stats_window_t;
+#endif /* TELEMETRY_ENABLE_STATISTICS */
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static bool report_due(const report_state_t *report, const int32_t *value,
+                       const bool *valid, TickType_t now);
+static void report_sent(report_state_t *report, const int32_t *value,
+                        const bool *valid, TickType_t now);
+static char *acquire_message(void);
+static void publish_record(const telemetry_record_t *record);
+static size_t format_text(const telemetry_record_t *record, char *msg, size_t size);
+static publisher_outcome_t send_message(const char *topic, char *msg, size_t length,
+                                        uint64_t timestamp_us);
+static void format_value(char *text, int32_t value, uint32_t decimals);
+static void format_timestamp(char *text, uint64_t timestamp_us);
+#if TELEMETRY_ENABLE_STATISTICS
+static void close_window(stats_window_t *window, TickType_t now);
+#else
+static void publish_latest(TickType_t now);
+#endif /* TELEMETRY_ENABLE_STATISTICS */
+
+/* Names of the channels as they appear in the published message. */
+static const char *const channel_names[SENSOR_CHANNEL_COUNT] =
+{
+    [SENSOR_CHANNEL_PH] = "pH",
+    [SENSOR_CHANNEL_TDS] = "Tds",
+    [SENSOR_CHANNEL_LEVEL] = "Level"
+};
+
+/* Topics on which the telemetry is published and their encoding. */
+const telemetry_topic_t telemetry_topics[TELEMETRY_TOPIC_COUNT] =
+{
+    { MQTT_PUB_TOPIC, MQTT_PUB_TOPIC_ENCODING },
+    { MQTT_PUB_BIN_TOPIC, MQTT_PUB_BIN_TOPIC_ENCODING }
+};
+const uint32_t telemetry_topic_count = sizeof(telemetry_topics) / sizeof(telemetry_topics[0]);
+
+/* Sink through which the sensor scheduler hands over the samples. */
+const sensor_sink_t telemetry_sink =
+{
+    .init = telemetry_init,
+    .process = telemetry_process
+};
+
+/* Absolute (Q16.16) and relative (per-mille) deadband of every channel. */
+static const struct
+{
+    int32_t absolute;
+    uint32_t relative;
+} deadband[SENSOR_CHANNEL_COUNT] =
+{
+    [SENSOR_CHANNEL_PH] = { SENSOR_VALUE(TELEMETRY_DEADBAND_PH_ABS), TELEMETRY_DEADBAND_PH_REL },
+    [SENSOR_CHANNEL_TDS] = { SENSOR_VALUE(TELEMETRY_DEADBAND_TDS_ABS), TELEMETRY_DEADBAND_TDS_REL },
+    [SENSOR_CHANNEL_LEVEL] = { SENSOR_VALUE(TELEMETRY_DEADBAND_LEVEL_ABS), TELEMETRY_DEADBAND_LEVEL_REL }
+};
+
+#if TELEMETRY_ENABLE_STATISTICS
+/* Statistics windows, one aggregate record is published per window. */
+static stats_window_t windows[TELEMETRY_STATS_WINDOW_COUNT];
+static const uint32_t window_length_ms[TELEMETRY_STATS_WINDOW_COUNT] = TELEMETRY_STATS_WINDOWS_MS;
+#else
+/* Latest value of every channel and whether one has been received. */
+static int32_t latest_value[SENSOR_CHANNEL_COUNT];
+static bool latest_valid[SENSOR_CHANNEL_COUNT];
+static uint64_t latest_timestamp_us;
+static report_state_t latest_report;
+
+/* Tick count of the last evaluation of the latest values. */
+static TickType_t last_evaluation;
+#endif /* TELEMETRY_ENABLE_STATISTICS */
+
+/* Number of reports that were suppressed by the deadbands. */
+static uint32_t suppressed_count;
+
+/* Number of reports that were dropped because the message pool was empty. */
+static uint32_t dropped_count;
+
+/* Records recently handed to the publisher, with the topics whose message
+ * the publisher has not completed yet. The oldest entry is reused first.
+ */
+static struct
+{
+    telemetry_record_t record;
+    uint32_t queued;
+} history[TELEMETRY_HISTORY_LENGTH];
+static uint32_t history_next;
+
+/******************************************************************************
+ * Function Name: telemetry_init
+ ******************************************************************************
+ * Summary:
+ *  Function that sets up the activity LED and starts the publish interval or
+ *  the statistics windows.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void telemetry_init(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    cyhal_gpio_init(TELEMETRY_ACTIVITY_LED_PIN, CYHAL_GPIO_DIR_OUTPUT,
+                    CYHAL_GPIO_DRIVE_STRONG, 0);
+
+#if TELEMETRY_ENABLE_STATISTICS
+    for (uint32_t i = 0; i < TELEMETRY_STATS_WINDOW_COUNT; i++)
+    {
+        windows[i].length_ms = window_length_ms[i];
+        windows[i].start = now;
+        windows[i].report.last_publish = now;
+        for (uint32_t channel = 0; channel < SENSOR_CHANNEL_COUNT; channel++)
+        {
+            running_stats_reset(&windows[i].stats[channel]);
+        }
+    }
+#else
+    last_evaluation = now;
+    latest_report.last_publish = now;
+#endif /* TELEMETRY_ENABLE_STATISTICS */
+}
+
+/******************************************************************************
+ * Function Name: telemetry_process
+ ******************************************************************************
+ * Summary:
+ *  Function that takes the samples produced by a sensor read. With
+ *  statistics enabled every sample updates the statistics of all windows in
+ *  O(1) and a record is published when a window closes. Otherwise, once per
+ *  'TELEMETRY_PUBLISH_INTERVAL_MS' milliseconds, the latest value of every
+ *  channel is published if a report is due.
+ *
+ * Parameters:
+ *  const sensor_sample_t *samples : Samples in chronological order
+ *  uint32_t count : Number of samples
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void telemetry_process(const sensor_sample_t *samples, uint32_t count)
+{
+    TickType_t now = xTaskGetTickCount();
+
+#if TELEMETRY_ENABLE_STATISTICS
+    for (uint32_t i = 0; i < TELEMETRY_STATS_WINDOW_COUNT; i++)
+    {
+        for (uint32_t s = 0; s < count; s++)
+        {
+            if (samples[s].channel < SENSOR_CHANNEL_COUNT)
+            {
+                stats_window_t *window = &windows[i];
+
+                if ((window->last_us == 0u) || (samples[s].timestamp_us < window->first_us))
+                {
+                    window->first_us = samples[s].timestamp_us;
+                }
+                if (samples[s].timestamp_us > window->last_us)
+                {
+                    window->last_us = samples[s].timestamp_us;
+                }
+                running_stats_add(&window->stats[samples[s].channel], samples[s].value);
+            }
+        }
+
+        if ((now - windows[i].start) >= pdMS_TO_TICKS(windows[i].length_ms))
+        {
+            close_window(&windows[i], now);
+        }
+    }
+#else
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (samples[i].channel < SENSOR_CHANNEL_COUNT)
+        {
+            latest_value[samples[i].channel] = samples[i].value;
+            latest_valid[samples[i].channel] = true;
+            if (samples[i].timestamp_us > latest_timestamp_us)
+            {
+                latest_timestamp_us = samples[i].timestamp_us;
+            }
+        }
+    }
+
+    if ((now - last_evaluation) >= pdMS_TO_TICKS(TELEMETRY_PUBLISH_INTERVAL_MS))
+    {
+        last_evaluation = now;
+        publish_latest(now);
+    }
+#endif /* TELEMETRY_ENABLE_STATISTICS */
+}
+
+#if TELEMETRY_ENABLE_STATISTICS
+/******************************************************************************
+ * Function Name: close_window
+ ******************************************************************************
+ * Summary:
+ *  Function that ends a statistics window, publishes its record if a report
+ *  is due and starts the next window.
+ *
+ * Parameters:
+ *  stats_window_t *window : Window that has ended
+ *  TickType_t now : Current tick count
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void close_window(stats_window_t *window, TickType_t now)
+{
+    telemetry_record_t record = { .type = TELEMETRY_RECORD_WINDOW };
+    running_stats_summary_t summary;
+    int32_t mean[SENSOR_CHANNEL_COUNT];
+    bool valid[SENSOR_CHANNEL_COUNT];
+
+    record.window_s = window->length_ms / 1000u;
+    record.first_us = window->first_us;
+    record.last_us = window->last_us;
+
+    for (uint32_t channel = 0; channel < SENSOR_CHANNEL_COUNT; channel++)
+    {
+        valid[channel] = running_stats_summary(&window->stats[channel], &summary);
+        mean[channel] = valid[channel] ? summary.mean : 0;
+        if (valid[channel])
+        {
+            record.channel_mask |= (1lu << channel);
+            record.channel[channel].value = summary.mean;
+            record.channel[channel].min = summary.min;
+            record.channel[channel].max = summary.max;
+            record.channel[channel].variance = summary.variance;
+            record.channel[channel].count = summary.count;
+        }
+        running_stats_reset(&window->stats[channel]);
+    }
+    window->first_us = 0;
+    window->last_us = 0;
+
+    /* Start the next window on the same grid unless a whole window was missed. */
+    window->start += pdMS_TO_TICKS(window->length_ms);
+    if ((now - window->start) >= pdMS_TO_TICKS(window->length_ms))
+    {
+        window->start = now;
+    }
+
+    if (!report_due(&window->report, mean, valid, now))
+    {
+        suppressed_count++;
+        return;
+    }
+
+    publish_record(&record);
+    report_sent(&window->report, mean, valid, now);
+}
+#else
+/******************************************************************************
+ * Function Name: publish_latest
+ ******************************************************************************
+ * Summary:
+ *  Function that publishes the latest value of every channel if a report is
+ *  due.
+ *
+ * Parameters:
+ *  TickType_t now : Current tick count
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void publish_latest(TickType_t now)
+{
+    telemetry_record_t record = { .type = TELEMETRY_RECORD_LATEST };
+
+    if (!report_due(&latest_report, latest_value, latest_valid, now))
+    {
+        suppressed_count++;
+        return;
+    }
+
+    record.first_us = latest_timestamp_us;
+    record.last_us = latest_timestamp_us;
+    for (uint32_t channel = 0; channel < SENSOR_CHANNEL_COUNT; channel++)
+    {
+        if (latest_valid[channel])
+        {
+            record.channel_mask |= (1lu << channel);
+            record.channel[channel].value = latest_value[channel];
+        }
+    }
+
+    publish_record(&record);
+    report_sent(&latest_report, latest_value, latest_valid, now);
+}
+#endif /* TELEMETRY_ENABLE_STATISTICS */
+
+/******************************************************************************
+ * Function Name: publish_record
+ ******************************************************************************
+ * Summary:
+ *  Function that encodes a record for every telemetry topic in the encoding
+ *  configured for that topic and hands the messages to the publisher. While
+ *  the broker is unreachable the record goes to the journal instead, and
+ *  it is kept in the history in case the publisher cannot publish it.
+ *
+ * Parameters:
+ *  const telemetry_record_t *record : Record to publish
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void publish_record(const telemetry_record_t *record)
+{
+    uint32_t spilled = 0;
+    uint32_t entry;
+
+    if (journal_append(record))
+    {
+        return;
+    }
+
+    /* The record is remembered before any of its messages is queued, so
+     * that the publisher can hand it back if a publish fails.
+     */
+    vTaskSuspendAll();
+    entry = history_next;
+    history_next = (history_next + 1u) % TELEMETRY_HISTORY_LENGTH;
+    history[entry].record = *record;
+    history[entry].queued = 0;
+    xTaskResumeAll();
+
+    for (uint32_t i = 0; i < telemetry_topic_count; i++)
+    {
+        char *msg;
+        size_t length;
+
+        if (telemetry_topics[i].encoding == MQTT_ENCODING_NONE)
+        {
+            continue;
+        }
+
+        msg = acquire_message();
+        if (msg == NULL)
+        {
+            continue;
+        }
+
+        length = telemetry_encode(record, telemetry_topics[i].encoding, msg, TELEMETRY_MSG_MAX_LEN);
+        if (length == 0u)
+        {
+            message_pool_release(msg);
+            continue;
+        }
+
+        taskENTER_CRITICAL();
+        history[entry].queued |= (1u << i);
+        taskEXIT_CRITICAL();
+
+        /* Text messages are passed as null-terminated strings. */
+        if (PUBLISHER_SPILLED == send_message(telemetry_topics[i].topic, msg,
+                                              (telemetry_topics[i].encoding == MQTT_ENCODING_BINARY) ? length : 0u,
+                                              record->last_us))
+        {
+            taskENTER_CRITICAL();
+            history[entry].queued &= ~(1u << i);
+            taskEXIT_CRITICAL();
+            spilled |= (1u << i);
+        }
+    }
+
+    /* The publisher is backed up, so keep the record in the journal, but
+     * only for the topics whose message was not queued.
+     */
+    if ((spilled != 0u) && !journal_store(record, spilled))
+    {
+        dropped_count++;
+        LOG_WARN("Telemetry: publisher full and no journal, %lu reports dropped\n",
+                 (unsigned long)dropped_count);
+    }
+}
+
+/******************************************************************************
+ * Function Name: telemetry_completed
+ ******************************************************************************
+ * Summary:
+ *  Function called by the publisher task when it has finished with the
+ *  telemetry of a topic captured between two times. If the telemetry was
+ *  not published, because the publish failed or the connection was lost
+ *  before it, the records are journaled for that topic and published again
+ *  once the connection is back. A record no longer in the history is lost.
+ *
+ * Parameters:
+ *  const char *topic : Topic of the publish
+ *  uint64_t oldest_us : Capture time of the oldest record, 0 if the publish
+ *                       carries no telemetry
+ *  uint64_t newest_us : Capture time of the newest record
+ *  bool published : true if the broker acknowledged the publish
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void telemetry_completed(const char *topic, uint64_t oldest_us, uint64_t newest_us, bool published)
+{
+    uint32_t index;
+    uint32_t lost = 0;
+
+    if ((topic == NULL) || (oldest_us == 0u))
+    {
+        return;
+    }
+
+    for (index = 0; index < telemetry_topic_count; index++)
+    {
+        if (strcmp(topic, telemetry_topics[index].topic) == 0)
+        {
+            break;
+        }
+    }
+    if (index == telemetry_topic_count)
+    {
+        return;
+    }
+
+    /* journal_store() never waits, so it is called with the scheduler
+     * suspended and the history cannot change under it.
+     */
+    vTaskSuspendAll();
+    for (uint32_t i = 0; i < TELEMETRY_HISTORY_LENGTH; i++)
+    {
+        if (((history[i].queued & (1u << index)) == 0u) ||
+            (history[i].record.last_us < oldest_us) || (history[i].record.last_us > newest_us))
+        {
+            continue;
+        }
+
+        history[i].queued &= ~(1u << index);
+        if (!published && !journal_store(&history[i].record, 1u << index))
+        {
+            lost++;
+        }
+    }
+    xTaskResumeAll();
+
+    if (lost != 0u)
+    {
+        dropped_count += lost;
+        LOG_WARN("Telemetry: publish failed and no journal, %lu reports dropped\n",
+                 (unsigned long)dropped_count);
+    }
+}
+
+/******************************************************************************
+ * Function Name: telemetry_encode
+ ******************************************************************************
+ * Summary:
+ *  Function that encodes a record as text or as a packed binary record.
+ *
+ * Parameters:
+ *  const telemetry_record_t *record : Record to encode
+ *  uint32_t encoding : MQTT_ENCODING_TEXT or MQTT_ENCODING_BINARY
+ *  char *buffer : Buffer receiving the encoded record; text is
+ *                 null-terminated
+ *  size_t size : Capacity of the buffer
+ *
+ * Return:
+ *  size_t : Length of the encoded record without the terminating null, or 0
+ *           if it could not be encoded
+ *
+ ******************************************************************************/
+size_t telemetry_encode(const telemetry_record_t *record, uint32_t encoding, char *buffer, size_t size)
+{
+    if (encoding == MQTT_ENCODING_BINARY)
+    {
+        return telemetry_codec_encode(record, (uint8_t *)buffer, size);
+    }
+    if ((encoding == MQTT_ENCODING_TEXT) && (size > 0u))
+    {
+        return format_text(record, buffer, size);
+    }
+    return 0;
+}
+
+/******************************************************************************
+ * Function Name: format_text
+ ******************************************************************************
+ * Summary:
+ *  Function that formats a record as text. A latest-value record reads
+ *  "t=12.345678::pH=7.00::Tds=250.00::Level=42.00", 't' being the capture
+ *  time in seconds of the newest sample. A window record reads
+ *  "win=10::t=first/last::pH=min/max/mean/variance::Tds=...", 'first' and
+ *  'last' being the capture times of the oldest and newest sample.
+ *
+ * Parameters:
+ *  const telemetry_record_t *record : Record to format
+ *  char *msg : Buffer receiving the text
+ *  size_t size : Capacity of the buffer
+ *
+ * Return:
+ *  size_t : Length of the text, truncated to fit the buffer
+ *
+ ******************************************************************************/
+static size_t format_text(const telemetry_record_t *record, char *msg, size_t size)
+{
+    char first_text[TIMESTAMP_TEXT_LEN];
+    char last_text[TIMESTAMP_TEXT_LEN];
+    char value_text[VALUE_TEXT_LEN];
+    char min_text[VALUE_TEXT_LEN];
+    char max_text[VALUE_TEXT_LEN];
+    char variance_text[VALUE_TEXT_LEN];
+    size_t length;
+
+    format_timestamp(last_text, record->last_us);
+    if (record->type == TELEMETRY_RECORD_WINDOW)
+    {
+        format_timestamp(first_text, record->first_us);
+        length = snprintf(msg, size, "win=%lu::t=%s/%s",
+                          (unsigned long)record->window_s, first_text, last_text);
+    }
+    else
+    {
+        length = snprintf(msg, size, "t=%s", last_text);
+    }
+
+    for (uint32_t channel = 0; (channel < SENSOR_CHANNEL_COUNT) && (length < size); channel++)
+    {
+        const telemetry_channel_record_t *values = &record->channel[channel];
+
+        if ((record->channel_mask & (1lu << channel)) == 0u)
+        {
+            continue;
+        }
+
+        format_value(value_text, values->value, VALUE_DECIMALS);
+        if (record->type == TELEMETRY_RECORD_WINDOW)
+        {
+            format_value(min_text, values->min, VALUE_DECIMALS);
+            format_value(max_text, values->max, VALUE_DECIMALS);
+            format_value(variance_text, values->variance, VARIANCE_DECIMALS);
+            length += snprintf(&msg[length], size - length, "::%s=%s/%s/%s/%s",
+                               channel_names[channel], min_text, max_text, value_text, variance_text);
+        }
+        else
+        {
+            length += snprintf(&msg[length], size - length, "::%s=%s",
+                               channel_names[channel], value_text);
+        }
+    }
+
+    /* snprintf() reports the untruncated length. */
+    return (length < size) ? length : (size - 1u);
+}
+
+/******************************************************************************
+ * Function Name: report_due
+ ******************************************************************************
+ * Summary:
+ *  Function that decides whether a set of values must be published. With
+ *  report-by-exception disabled every report is published.
+ *
+ * Parameters:
+ *  const report_state_t *report : Values of the last published message
+ *  const int32_t *value : Candidate values, indexed by channel
+ *  const bool *valid : Channels that have a candidate value
+ *  TickType_t now : Current tick count
+ *
+ * Return:
+ *  bool : true if a message must be published
+ *
+ ******************************************************************************/
+static bool report_due(const report_state_t *report, const int32_t *value,
+                       const bool *valid, TickType_t now)
+{
+#if TELEMETRY_REPORT_BY_EXCEPTION
+    if ((now - report->last_publish) >= pdMS_TO_TICKS(TELEMETRY_HEARTBEAT_INTERVAL_MS))
+    {
+        return true;
+    }
+
+    for (uint32_t channel = 0; channel < SENSOR_CHANNEL_COUNT; channel++)
+    {
+        int64_t change;
+        int64_t reference;
+
+        if (!valid[channel])
+        {
+            continue;
+        }
+        if (!report->valid[channel])
+        {
+            return true;
+        }
+
+        change = (int64_t)value[channel] - report->value[channel];
+        change = (change < 0) ? -change : change;
+        reference = (report->value[channel] < 0) ? -(int64_t)report->value[channel] :
+                                                   report->value[channel];
+
+        if (((deadband[channel].absolute > 0) && (change > deadband[channel].absolute)) ||
+            ((deadband[channel].relative > 0u) &&
+             ((change * 1000) > (reference * deadband[channel].relative))))
+        {
+            return true;
+        }
+    }
+
+    return false;
+#else
+    (void) report;
+    (void) value;
+    (void) valid;
+    (void) now;
+    return true;
+#endif /* TELEMETRY_REPORT_BY_EXCEPTION */
+}
+
+/******************************************************************************
+ * Function Name: report_sent
+ ******************************************************************************
+ * Summary:
+ *  Function that records the values of a published message as the reference
+ *  for the next deadband evaluation.
+ *
+ * Parameters:
+ *  report_state_t *report : Report to update
+ *  const int32_t *value : Published values, indexed by channel
+ *  const bool *valid : Channels that were published
+ *  TickType_t now : Current tick count
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void report_sent(report_state_t *report, const int32_t *value,
+                        const bool *valid, TickType_t now)
+{
+    for (uint32_t channel = 0; channel < SENSOR_CHANNEL_COUNT; channel++)
+    {
+        if (valid[channel])
+        {
+            report->value[channel] = value[channel];
+            report->valid[channel] = true;
+        }
+    }
+    report->last_publish = now;
+}
+
+/******************************************************************************
+ * Function Name: acquire_message
+ ******************************************************************************
+ * Summary:
+ *  Function that takes a buffer for the next message from the message pool.
+ *  It does not wait, so a slow publisher never stalls the sampling; the
+ *  report is dropped instead.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  char * : Message buffer, or NULL if the pool is empty
+ *
+ ******************************************************************************/
+static char *acquire_message(void)
+{
+    char *msg = message_pool_acquire(0);
+
+    if (msg == NULL)
+    {
+        dropped_count++;
+        LOG_WARN("Telemetry: no free message buffer, %lu reports dropped\n",
+                 (unsigned long)dropped_count);
+    }
+
+    return msg;
+}
+
+/******************************************************************************
+ * Function Name: send_message
+ ******************************************************************************
+ * Summary:
+ *  Function that hands an encoded message to the publisher task, which
+ *  takes over the buffer and releases it after publishing. It never waits,
+ *  so the sampling does not depend on the network; if the telemetry lane is
+ *  full, its overflow policy applies.
+ *
+ * Parameters:
+ *  const char *topic : Topic to publish on
+ *  char *msg : Message in a buffer of the message pool
+ *  size_t length : Length of a binary message in bytes, 0 for text
+ *  uint64_t timestamp_us : Capture time of the newest sample in the message
+ *
+ * Return:
+ *  publisher_outcome_t : What the publisher did with the message
+ *
+ ******************************************************************************/
+static publisher_outcome_t send_message(const char *topic, char *msg, size_t length,
+                                        uint64_t timestamp_us)
+{
+    publisher_data_t publisher_q_data;
+    publisher_outcome_t outcome;
+
+    /* Send the message to the publisher task queue. */
+    publisher_q_data.cmd = PUBLISH_MQTT_MSG;
+    publisher_q_data.topic = topic;
+    publisher_q_data.data = msg;
+    publisher_q_data.length = length;
+    publisher_q_data.timestamp_us = timestamp_us;
+    publisher_q_data.complete = NULL;
+    outcome = publisher_enqueue(&publisher_q_data, PUBLISHER_LANE_TELEMETRY);
+    cyhal_gpio_toggle(TELEMETRY_ACTIVITY_LED_PIN);
+
+    return outcome;
+}
+
+/******************************************************************************
+ * Function Name: format_value
+ ******************************************************************************
+ * Summary:
+ *  Function that formats a Q16.16 value with a fixed number of decimals
+ *  using integer arithmetic only.
+ *
+ * Parameters:
+ *  char *text : Buffer of at least VALUE_TEXT_LEN characters
+ *  int32_t value : Value in Q16.16
+ *  uint32_t decimals : Number of decimals, at most 4
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void format_value(char *text, int32_t value, uint32_t decimals)
+{
+    int64_t scale = 1;
+    int64_t scaled;
+    const char *sign;
+
+    for (uint32_t i = 0; i < decimals; i++)
+    {
+        scale *= 10;
+    }
+
+    scaled = (((int64_t)value * scale) + (1l << (SENSOR_VALUE_FRAC_BITS - 1u))) >> SENSOR_VALUE_FRAC_BITS;
+    sign = (scaled < 0) ? "-" : "";
+    if (scaled < 0)
+    {
+        scaled = -scaled;
+    }
+    snprintf(text, VALUE_TEXT_LEN, "%s%ld.%0*ld", sign, (long)(scaled / scale),
+             (int)decimals, (long)(scaled % scale));
+}
+
+/******************************************************************************
+ * Function Name: format_timestamp
+ ******************************************************************************
+ * Summary:
+ *  Function that formats a device clock time as seconds with microsecond
+ *  decimals, without relying on 64-bit printf support.
+ *
+ * Parameters:
+ *  char *text : Buffer of at least TIMESTAMP_TEXT_LEN characters
+ *  uint64_t timestamp_us : Device clock time in microseconds
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void format_timestamp(char *text, uint64_t timestamp_us)
+{
+    snprintf(text, TIMESTAMP_TEXT_LEN, "%lu.%06lu",
+             (unsigned long)(timestamp_us / DEVICE_CLOCK_US_PER_SEC),
+             (unsigned long)(timestamp_us % DEVICE_CLOCK_US_PER_SEC));
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,114 @@
+/******************************************************************************
+* File Name:   telemetry.h
+*
+* Description: This file is the public interface of telemetry.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sensor.h"
+#include "message_pool.h"
+#include "telemetry_codec.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Interval in milliseconds at which the latest values are evaluated for
+ * publishing. This is the shortest time between two published messages.
+ */
+#define TELEMETRY_PUBLISH_INTERVAL_MS       (2000u)
+
+/* Set this macro to 1 to publish only when a channel has moved outside its
+ * deadband since it was last reported, or when nothing has been published
+ * for 'TELEMETRY_HEARTBEAT_INTERVAL_MS'. Set it to 0 to publish on every
+ * interval.
+ */
+#define TELEMETRY_REPORT_BY_EXCEPTION       (1)
+
+/* Maximum time in milliseconds without a published message. */
+#define TELEMETRY_HEARTBEAT_INTERVAL_MS     (5u * 60u * 1000u)
+
+/* Deadband of every channel. A change is reported when it exceeds the
+ * absolute deadband (in engineering units) or the relative deadband (in
+ * per-mille of the last reported value). A deadband of 0 disables that
+ * check.
+ */
+#define TELEMETRY_DEADBAND_PH_ABS           (0.05)
+#define TELEMETRY_DEADBAND_PH_REL           (0u)
+#define TELEMETRY_DEADBAND_TDS_ABS          (5.0)
+#define TELEMETRY_DEADBAND_TDS_REL          (20u)
+#define TELEMETRY_DEADBAND_LEVEL_ABS        (1.0)
+#define TELEMETRY_DEADBAND_LEVEL_REL        (0u)
+
+/* Set this macro to 1 to publish windowed statistics (minimum, maximum,
+ * mean and variance of every channel) instead of the latest values. One
+ * record is published per window; the deadbands above are then applied to
+ * the mean of the window. Set it to 0 to publish the latest values.
+ */
+#define TELEMETRY_ENABLE_STATISTICS         (1)
+
+/* Lengths in milliseconds of the statistics windows. */
+#define TELEMETRY_STATS_WINDOWS_MS          { 10u * 1000u, 60u * 1000u }
+#define TELEMETRY_STATS_WINDOW_COUNT        (2u)
+
+/* Size of a message published by the telemetry. Messages are encoded
+ * directly in buffers of the message pool, as text or as packed binary
+ * records depending on the topic (see mqtt_client_config.h).
+ */
+#define TELEMETRY_MSG_MAX_LEN               (MESSAGE_POOL_BUFFER_SIZE)
+
+/* Number of topics on which the telemetry is published, see
+ * 'telemetry_topics' in telemetry.c.
+ */
+#define TELEMETRY_TOPIC_COUNT               (2u)
+
+/* Number of records remembered after their messages were handed to the
+ * publisher, so that a failed publish can be journaled instead of lost (see
+ * telemetry_completed()). It covers the telemetry lane, the held message
+ * and a full batch.
+ */
+#define TELEMETRY_HISTORY_LENGTH            (16u)
+
+/* Pin toggled every time a message is handed to the publisher. P9_1 is the
+ * echo line of the ultrasonic sensor, so the activity LED uses the pin that
+ * node 2 toggles around its measurements.
+ */
+#define TELEMETRY_ACTIVITY_LED_PIN          (P8_0)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* A topic on which the telemetry is published and its payload encoding, one
+ * of the MQTT_ENCODING_* values of mqtt_client_config.h.
+ */
+typedef struct
+{
+    const char *topic;
+    uint32_t encoding;
+} telemetry_topic_t;
+
+/*******************************************************************************
+* Extern Variables
+********************************************************************************/
+extern const telemetry_topic_t telemetry_topics[TELEMETRY_TOPIC_COUNT];
+extern const uint32_t telemetry_topic_count;
+extern const sensor_sink_t telemetry_sink;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void telemetry_init(void);
+size_t telemetry_encode(const telemetry_record_t *record, uint32_t encoding, char *buffer, size_t size);
+void telemetry_process(const sensor_sample_t *samples, uint32_t count);
+void telemetry_completed(const char *topic, uint64_t oldest_us, uint64_t newest_us, bool published);
+
+#endif /* TELEMETRY_H_ */
+
+/* [] END OF FILE */
@@ -0,0 +1,263 @@
+/******************************************************************************
+* File Name:   telemetry_codec.c
+*
+* Description: This file contains the packed binary encoding of the telemetry
+*              records, an alternative to the text format that is several
+*              times smaller and needs no printf. All fields are scaled
+*              integers in little-endian byte order:
+*
+*                offset  size  field
+*                0       1     version (TELEMETRY_CODEC_VERSION)
+*                1       1     record type (telemetry_record_type_t)
+*                2       1     channel mask, bit n set if channel n follows
+*                3       1     reserved, 0
+*                4       8     capture time of the newest sample in us
+*              Window records continue with
+*                12      4     time from the oldest to the newest sample in us
+*                16      2     window length in s
+*              and then, for every channel in the mask in increasing order,
+*              a latest-value record holds the value (int32, Q16.16) and a
+*              window record holds the number of samples (uint16, saturated)
+*              followed by min, max, mean and variance (int32, Q16.16).
+*
+*              Records are self-delimiting, so several of them can be sent
+*              back to back in one payload. The module only depends on the
+*              C library, so the decoder can be built on a host to check or
+*              convert captured payloads.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <string.h>
+
+#include "telemetry_codec.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Largest sample count that fits in the encoded count field. */
+#define CODEC_COUNT_MAX                 (0xFFFFu)
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static uint8_t *put_le(uint8_t *buffer, uint64_t value, uint32_t bytes);
+static uint64_t get_le(const uint8_t **buffer, uint32_t bytes);
+
+/******************************************************************************
+ * Function Name: telemetry_codec_encode
+ ******************************************************************************
+ * Summary:
+ *  Function that encodes a telemetry record in the packed binary format.
+ *
+ * Parameters:
+ *  const telemetry_record_t *record : Record to encode
+ *  uint8_t *buffer : Buffer receiving the encoded record
+ *  size_t size : Capacity of the buffer
+ *
+ * Return:
+ *  size_t : Number of bytes written, or 0 if the buffer is too small or the
+ *           record is invalid
+ *
+ ******************************************************************************/
+size_t telemetry_codec_encode(const telemetry_record_t *record, uint8_t *buffer, size_t size)
+{
+    bool window = (record->type == TELEMETRY_RECORD_WINDOW);
+    size_t needed = TELEMETRY_CODEC_HEADER_SIZE + (window ? TELEMETRY_CODEC_WINDOW_SIZE : 0u);
+    uint8_t *out = buffer;
+
+    if (((record->type != TELEMETRY_RECORD_LATEST) && !window) ||
+        ((record->channel_mask >> TELEMETRY_CODEC_MAX_CHANNELS) != 0u))
+    {
+        return 0;
+    }
+
+    for (uint32_t channel = 0; channel < TELEMETRY_CODEC_MAX_CHANNELS; channel++)
+    {
+        if ((record->channel_mask & (1lu << channel)) != 0u)
+        {
+            needed += window ? TELEMETRY_CODEC_WINDOW_CHANNEL_SIZE :
+                               TELEMETRY_CODEC_LATEST_CHANNEL_SIZE;
+        }
+    }
+    if (needed > size)
+    {
+        return 0;
+    }
+
+    out = put_le(out, TELEMETRY_CODEC_VERSION, 1);
+    out = put_le(out, (uint64_t)record->type, 1);
+    out = put_le(out, record->channel_mask, 1);
+    out = put_le(out, 0, 1);
+    out = put_le(out, record->last_us, 8);
+
+    if (window)
+    {
+        out = put_le(out, (uint32_t)(record->last_us - record->first_us), 4);
+        out = put_le(out, record->window_s, 2);
+    }
+
+    for (uint32_t channel = 0; channel < TELEMETRY_CODEC_MAX_CHANNELS; channel++)
+    {
+        const telemetry_channel_record_t *values = &record->channel[channel];
+
+        if ((record->channel_mask & (1lu << channel)) == 0u)
+        {
+            continue;
+        }
+
+        if (window)
+        {
+            out = put_le(out, (values->count > CODEC_COUNT_MAX) ? CODEC_COUNT_MAX : values->count, 2);
+            out = put_le(out, (uint32_t)values->min, 4);
+            out = put_le(out, (uint32_t)values->max, 4);
+            out = put_le(out, (uint32_t)values->value, 4);
+            out = put_le(out, (uint32_t)values->variance, 4);
+        }
+        else
+        {
+            out = put_le(out, (uint32_t)values->value, 4);
+        }
+    }
+
+    return (size_t)(out - buffer);
+}
+
+/******************************************************************************
+ * Function Name: telemetry_codec_decode
+ ******************************************************************************
+ * Summary:
+ *  Function that decodes the first telemetry record of a payload in the
+ *  packed binary format. Call it again on the remaining bytes to decode a
+ *  payload holding several records.
+ *
+ * Parameters:
+ *  const uint8_t *buffer : Encoded records
+ *  size_t length : Number of bytes available in 'buffer'
+ *  telemetry_record_t *record : Decoded record; fields not carried by the
+ *                               record type are set to 0
+ *
+ * Return:
+ *  size_t : Number of bytes consumed, or 0 if the record is truncated or has
+ *           an unknown version or type
+ *
+ ******************************************************************************/
+size_t telemetry_codec_decode(const uint8_t *buffer, size_t length, telemetry_record_t *record)
+{
+    const uint8_t *in = buffer;
+    const uint8_t *end = buffer + length;
+    bool window;
+
+    memset(record, 0, sizeof(*record));
+
+    if ((length < TELEMETRY_CODEC_HEADER_SIZE) || (get_le(&in, 1) != TELEMETRY_CODEC_VERSION))
+    {
+        return 0;
+    }
+
+    record->type = (telemetry_record_type_t)get_le(&in, 1);
+    record->channel_mask = (uint32_t)get_le(&in, 1);
+    (void) get_le(&in, 1);
+    record->last_us = get_le(&in, 8);
+    record->first_us = record->last_us;
+
+    window = (record->type == TELEMETRY_RECORD_WINDOW);
+    if ((record->type != TELEMETRY_RECORD_LATEST) && !window)
+    {
+        return 0;
+    }
+
+    if (window)
+    {
+        if ((size_t)(end - in) < TELEMETRY_CODEC_WINDOW_SIZE)
+        {
+            return 0;
+        }
+        record->first_us = record->last_us - get_le(&in, 4);
+        record->window_s = (uint32_t)get_le(&in, 2);
+    }
+
+    for (uint32_t channel = 0; channel < TELEMETRY_CODEC_MAX_CHANNELS; channel++)
+    {
+        telemetry_channel_record_t *values = &record->channel[channel];
+
+        if ((record->channel_mask & (1lu << channel)) == 0u)
+        {
+            continue;
+        }
+
+        if ((size_t)(end - in) < (window ? TELEMETRY_CODEC_WINDOW_CHANNEL_SIZE :
+                                           TELEMETRY_CODEC_LATEST_CHANNEL_SIZE))
+        {
+            return 0;
+        }
+
+        if (window)
+        {
+            values->count = (uint32_t)get_le(&in, 2);
+            values->min = (int32_t)(uint32_t)get_le(&in, 4);
+            values->max = (int32_t)(uint32_t)get_le(&in, 4);
+            values->value = (int32_t)(uint32_t)get_le(&in, 4);
+            values->variance = (int32_t)(uint32_t)get_le(&in, 4);
+        }
+        else
+        {
+            values->value = (int32_t)(uint32_t)get_le(&in, 4);
+        }
+    }
+
+    return (size_t)(in - buffer);
+}
+
+/******************************************************************************
+ * Function Name: put_le
+ ******************************************************************************
+ * Summary:
+ *  Function that stores the low bytes of a value in little-endian order.
+ *
+ * Parameters:
+ *  uint8_t *buffer : Position to write to
+ *  uint64_t value : Value to store
+ *  uint32_t bytes : Number of bytes to store
+ *
+ * Return:
+ *  uint8_t * : Position after the stored bytes
+ *
+ ******************************************************************************/
+static uint8_t *put_le(uint8_t *buffer, uint64_t value, uint32_t bytes)
+{
+    for (uint32_t i = 0; i < bytes; i++)
+    {
+        *buffer++ = (uint8_t)(value >> (8u * i));
+    }
+    return buffer;
+}
+
+/******************************************************************************
+ * Function Name: get_le
+ ******************************************************************************
+ * Summary:
+ *  Function that loads a little-endian value and advances the read position.
+ *
+ * Parameters:
+ *  const uint8_t **buffer : Read position, advanced by 'bytes'
+ *  uint32_t bytes : Number of bytes to load
+ *
+ * Return:
+ *  uint64_t : Loaded value
+ *
+ ******************************************************************************/
+static uint64_t get_le(const uint8_t **buffer, uint32_t bytes)
+{
+    uint64_t value = 0;
+
+    for (uint32_t i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)(*buffer)[i] << (8u * i);
+    }
+    *buffer += bytes;
+    return value;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,78 @@
+/******************************************************************************
+* File Name:   telemetry_codec.h
+*
+* Description: This file is the public interface of telemetry_codec.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef TELEMETRY_CODEC_H_
+#define TELEMETRY_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Version written in the first byte of every binary record. */
+#define TELEMETRY_CODEC_VERSION             (1u)
+
+/* Highest number of channels a record can carry. */
+#define TELEMETRY_CODEC_MAX_CHANNELS        (8u)
+
+/* Encoded size of the record header, of the window fields and of one
+ * channel in a latest-value and in a window record.
+ */
+#define TELEMETRY_CODEC_HEADER_SIZE         (12u)
+#define TELEMETRY_CODEC_WINDOW_SIZE         (6u)
+#define TELEMETRY_CODEC_LATEST_CHANNEL_SIZE (4u)
+#define TELEMETRY_CODEC_WINDOW_CHANNEL_SIZE (18u)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Kinds of telemetry record. */
+typedef enum
+{
+    TELEMETRY_RECORD_LATEST = 0,
+    TELEMETRY_RECORD_WINDOW = 1
+} telemetry_record_type_t;
+
+/* Values of one channel, all in Q16.16. A latest-value record only uses
+ * 'value'; a window record uses 'value' for the mean and all other fields.
+ */
+typedef struct
+{
+    int32_t value;
+    int32_t min;
+    int32_t max;
+    int32_t variance;
+    uint32_t count;
+} telemetry_channel_record_t;
+
+/* One telemetry record. Bit n of 'channel_mask' tells that channel n is
+ * present. 'first_us' and 'last_us' are the device clock times of the
+ * oldest and newest sample; a latest-value record only uses 'last_us'.
+ */
+typedef struct
+{
+    telemetry_record_type_t type;
+    uint32_t window_s;
+    uint64_t first_us;
+    uint64_t last_us;
+    uint32_t channel_mask;
+    telemetry_channel_record_t channel[TELEMETRY_CODEC_MAX_CHANNELS];
+} telemetry_record_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+size_t telemetry_codec_encode(const telemetry_record_t *record, uint8_t *buffer, size_t size);
+size_t telemetry_codec_decode(const uint8_t *buffer, size_t length, telemetry_record_t *record);
+
+#endif /* TELEMETRY_CODEC_H_ */
+
+/* [] END OF FILE */
@@ -0,0 +1,463 @@
+/******************************************************************************
+* File Name:   telemetry_delta.c
+*
+* Description: This file contains the delta encoding of batched telemetry
+*              records. Consecutive records of a batch are strongly
+*              correlated, so instead of the packed records of
+*              telemetry_codec.c a batch is sent as the difference of every
+*              field to the same field of the previous record, in zig-zag
+*              varints: small differences of either sign take one byte.
+*              Timestamps are sent as the difference of the sampling step
+*              to the previous step (delta-of-delta), which is 0 for a
+*              steady sample rate.
+*
+*              A batch starts with the version byte TELEMETRY_DELTA_VERSION
+*              and is followed by the records, each made of
+*                1 byte     flags: bit 0 set for a window record, bit 1 set
+*                           if the channel mask follows
+*                1 byte     channel mask, only if it changed
+*                varint     capture time step of the newest sample in us,
+*                           minus the previous step
+*              Window records continue with
+*                varint     time from the oldest to the newest sample in us
+*                varint     window length in s
+*              and then, for every channel in the mask in increasing order,
+*              the value (Q16.16) of a latest-value record, or the mean,
+*              number of samples, min, max and variance of a window record.
+*              All fields are differences to the previous record of the
+*              batch, which starts from all fields 0; a channel that is
+*              absent keeps its last values.
+*
+*              The module only depends on the C library and on
+*              telemetry_codec.c, so the decoder can be built on a host.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <string.h>
+
+#include "telemetry_delta.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Record flags. */
+#define DELTA_FLAG_WINDOW               (0x01u)
+#define DELTA_FLAG_MASK                 (0x02u)
+
+/* Longest varint, for a 64-bit value. */
+#define DELTA_VARINT_MAX_SIZE           (10u)
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static uint8_t *put_signed(uint8_t *buffer, const uint8_t *end, int64_t value);
+static bool get_signed(const uint8_t **buffer, const uint8_t *end, int64_t *value);
+
+/******************************************************************************
+ * Function Name: telemetry_delta_begin
+ ******************************************************************************
+ * Summary:
+ *  Function that starts a delta encoded batch: it writes the batch header
+ *  and resets the encoder state.
+ *
+ * Parameters:
+ *  telemetry_delta_t *state : Encoder state
+ *  uint8_t *buffer : Buffer receiving the batch
+ *  size_t size : Capacity of the buffer
+ *
+ * Return:
+ *  size_t : Number of bytes written, or 0 if the buffer is too small
+ *
+ ******************************************************************************/
+size_t telemetry_delta_begin(telemetry_delta_t *state, uint8_t *buffer, size_t size)
+{
+    if (size < TELEMETRY_DELTA_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    memset(state, 0, sizeof(*state));
+    buffer[0] = TELEMETRY_DELTA_VERSION;
+
+    return TELEMETRY_DELTA_HEADER_SIZE;
+}
+
+/******************************************************************************
+ * Function Name: telemetry_delta_encode
+ ******************************************************************************
+ * Summary:
+ *  Function that appends a record to a delta encoded batch. The encoder
+ *  state only advances when the record is written, so a batch can be
+ *  filled until a record no longer fits.
+ *
+ * Parameters:
+ *  telemetry_delta_t *state : Encoder state, see telemetry_delta_begin()
+ *  const telemetry_record_t *record : Record to encode
+ *  uint8_t *buffer : Position in the batch to write the record to
+ *  size_t size : Space left in the batch
+ *
+ * Return:
+ *  size_t : Number of bytes written, or 0 if the record does not fit or is
+ *           invalid
+ *
+ ******************************************************************************/
+size_t telemetry_delta_encode(telemetry_delta_t *state, const telemetry_record_t *record,
+                              uint8_t *buffer, size_t size)
+{
+    bool window = (record->type == TELEMETRY_RECORD_WINDOW);
+    const uint8_t *end = buffer + size;
+    uint8_t *out = buffer;
+    int64_t step = (int64_t)(record->last_us - state->last_us);
+    uint32_t span = window ? (uint32_t)(record->last_us - record->first_us) : 0u;
+    uint8_t flags = window ? DELTA_FLAG_WINDOW : 0u;
+
+    if (((record->type != TELEMETRY_RECORD_LATEST) && !window) ||
+        ((record->channel_mask >> TELEMETRY_CODEC_MAX_CHANNELS) != 0u))
+    {
+        return 0;
+    }
+
+    if (record->channel_mask != state->channel_mask)
+    {
+        flags |= DELTA_FLAG_MASK;
+    }
+    if (size < ((flags & DELTA_FLAG_MASK) ? 2u : 1u))
+    {
+        return 0;
+    }
+    *out++ = flags;
+    if ((flags & DELTA_FLAG_MASK) != 0u)
+    {
+        *out++ = (uint8_t)record->channel_mask;
+    }
+
+    out = put_signed(out, end, (int64_t)((uint64_t)step - (uint64_t)state->step_us));
+    if (window)
+    {
+        out = put_signed(out, end, (int64_t)span - (int64_t)state->span_us);
+        out = put_signed(out, end, (int64_t)record->window_s - (int64_t)state->window_s);
+    }
+
+    for (uint32_t channel = 0; channel < TELEMETRY_CODEC_MAX_CHANNELS; channel++)
+    {
+        const telemetry_channel_record_t *values = &record->channel[channel];
+        const telemetry_channel_record_t *previous = &state->channel[channel];
+
+        if ((record->channel_mask & (1lu << channel)) == 0u)
+        {
+            continue;
+        }
+
+        out = put_signed(out, end, (int64_t)values->value - previous->value);
+        if (window)
+        {
+            out = put_signed(out, end, (int64_t)values->count - (int64_t)previous->count);
+            out = put_signed(out, end, (int64_t)values->min - previous->min);
+            out = put_signed(out, end, (int64_t)values->max - previous->max);
+            out = put_signed(out, end, (int64_t)values->variance - previous->variance);
+        }
+    }
+
+    if (out == NULL)
+    {
+        return 0;
+    }
+
+    state->channel_mask = record->channel_mask;
+    state->last_us = record->last_us;
+    state->step_us = step;
+    if (window)
+    {
+        state->span_us = span;
+        state->window_s = record->window_s;
+    }
+    for (uint32_t channel = 0; channel < TELEMETRY_CODEC_MAX_CHANNELS; channel++)
+    {
+        if ((record->channel_mask & (1lu << channel)) == 0u)
+        {
+            continue;
+        }
+        if (window)
+        {
+            state->channel[channel] = record->channel[channel];
+        }
+        else
+        {
+            state->channel[channel].value = record->channel[channel].value;
+        }
+    }
+
+    return (size_t)(out - buffer);
+}
+
+/******************************************************************************
+ * Function Name: telemetry_delta_open
+ ******************************************************************************
+ * Summary:
+ *  Function that checks the header of a delta encoded batch and resets the
+ *  decoder state.
+ *
+ * Parameters:
+ *  telemetry_delta_t *state : Decoder state
+ *  const uint8_t *buffer : Payload
+ *  size_t length : Length of the payload
+ *
+ * Return:
+ *  size_t : Size of the header, or 0 if the payload is no delta encoded
+ *           batch
+ *
+ ******************************************************************************/
+size_t telemetry_delta_open(telemetry_delta_t *state, const uint8_t *buffer, size_t length)
+{
+    if ((length < TELEMETRY_DELTA_HEADER_SIZE) || (buffer[0] != TELEMETRY_DELTA_VERSION))
+    {
+        return 0;
+    }
+
+    memset(state, 0, sizeof(*state));
+
+    return TELEMETRY_DELTA_HEADER_SIZE;
+}
+
+/******************************************************************************
+ * Function Name: telemetry_delta_decode
+ ******************************************************************************
+ * Summary:
+ *  Function that decodes the next record of a delta encoded batch. Call it
+ *  on the remaining bytes until they are used up.
+ *
+ * Parameters:
+ *  telemetry_delta_t *state : Decoder state, see telemetry_delta_open()
+ *  const uint8_t *buffer : Next record of the batch
+ *  size_t length : Number of bytes left in the batch
+ *  telemetry_record_t *record : Decoded record; fields not carried by the
+ *                               record type are set to 0
+ *
+ * Return:
+ *  size_t : Number of bytes consumed, or 0 if the record is truncated or
+ *           invalid
+ *
+ ******************************************************************************/
+size_t telemetry_delta_decode(telemetry_delta_t *state, const uint8_t *buffer, size_t length,
+                              telemetry_record_t *record)
+{
+    const uint8_t *in = buffer;
+    const uint8_t *end = buffer + length;
+    int64_t delta[5];
+    uint8_t flags;
+    bool window;
+
+    memset(record, 0, sizeof(*record));
+
+    if (length == 0u)
+    {
+        return 0;
+    }
+    flags = *in++;
+    if ((flags & ~(DELTA_FLAG_WINDOW | DELTA_FLAG_MASK)) != 0u)
+    {
+        return 0;
+    }
+    window = ((flags & DELTA_FLAG_WINDOW) != 0u);
+    record->type = window ? TELEMETRY_RECORD_WINDOW : TELEMETRY_RECORD_LATEST;
+
+    record->channel_mask = state->channel_mask;
+    if ((flags & DELTA_FLAG_MASK) != 0u)
+    {
+        if (in == end)
+        {
+            return 0;
+        }
+        record->channel_mask = *in++;
+    }
+
+    if (!get_signed(&in, end, &delta[0]))
+    {
+        return 0;
+    }
+    state->step_us = (int64_t)((uint64_t)state->step_us + (uint64_t)delta[0]);
+    record->last_us = state->last_us + (uint64_t)state->step_us;
+    record->first_us = record->last_us;
+
+    if (window)
+    {
+        if (!get_signed(&in, end, &delta[0]) || !get_signed(&in, end, &delta[1]))
+        {
+            return 0;
+        }
+        state->span_us = (uint32_t)((int64_t)state->span_us + delta[0]);
+        state->window_s = (uint32_t)((int64_t)state->window_s + delta[1]);
+        record->first_us = record->last_us - state->span_us;
+        record->window_s = state->window_s;
+    }
+
+    for (uint32_t channel = 0; channel < TELEMETRY_CODEC_MAX_CHANNELS; channel++)
+    {
+        telemetry_channel_record_t *previous = &state->channel[channel];
+        uint32_t fields = window ? 5u : 1u;
+
+        if ((record->channel_mask & (1lu << channel)) == 0u)
+        {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < fields; i++)
+        {
+            if (!get_signed(&in, end, &delta[i]))
+            {
+                return 0;
+            }
+        }
+
+        previous->value = (int32_t)(previous->value + delta[0]);
+        record->channel[channel].value = previous->value;
+        if (window)
+        {
+            previous->count = (uint32_t)((int64_t)previous->count + delta[1]);
+            previous->min = (int32_t)(previous->min + delta[2]);
+            previous->max = (int32_t)(previous->max + delta[3]);
+            previous->variance = (int32_t)(previous->variance + delta[4]);
+            record->channel[channel] = *previous;
+        }
+    }
+
+    state->channel_mask = record->channel_mask;
+    state->last_us = record->last_us;
+
+    return (size_t)(in - buffer);
+}
+
+/******************************************************************************
+ * Function Name: telemetry_delta_compress
+ ******************************************************************************
+ * Summary:
+ *  Function that converts a batch of back to back packed records, see
+ *  telemetry_codec.c, into a delta encoded batch.
+ *
+ * Parameters:
+ *  const uint8_t *records : Packed records
+ *  size_t length : Length of the packed records
+ *  uint8_t *buffer : Buffer receiving the delta encoded batch
+ *  size_t size : Capacity of the buffer
+ *
+ * Return:
+ *  size_t : Length of the delta encoded batch, or 0 if a record could not
+ *           be decoded or the batch does not fit
+ *
+ ******************************************************************************/
+size_t telemetry_delta_compress(const uint8_t *records, size_t length, uint8_t *buffer, size_t size)
+{
+    telemetry_delta_t state;
+    telemetry_record_t record;
+    size_t used = telemetry_delta_begin(&state, buffer, size);
+
+    if (used == 0u)
+    {
+        return 0;
+    }
+
+    while (length > 0u)
+    {
+        size_t consumed = telemetry_codec_decode(records, length, &record);
+        size_t written = (consumed != 0u) ?
+                         telemetry_delta_encode(&state, &record, &buffer[used], size - used) : 0u;
+
+        if (written == 0u)
+        {
+            return 0;
+        }
+        records += consumed;
+        length -= consumed;
+        used += written;
+    }
+
+    return used;
+}
+
+/******************************************************************************
+ * Function Name: put_signed
+ ******************************************************************************
+ * Summary:
+ *  Function that stores a signed value as a zig-zag varint: the value is
+ *  mapped to 0, -1, 1, -2, ... => 0, 1, 2, 3, ... and stored 7 bits per
+ *  byte, low bits first, with the top bit of every byte but the last set.
+ *
+ * Parameters:
+ *  uint8_t *buffer : Position to write to, or NULL after an earlier overflow
+ *  const uint8_t *end : End of the buffer
+ *  int64_t value : Value to store
+ *
+ * Return:
+ *  uint8_t * : Position after the stored bytes, or NULL if they do not fit
+ *
+ ******************************************************************************/
+static uint8_t *put_signed(uint8_t *buffer, const uint8_t *end, int64_t value)
+{
+    uint64_t zigzag = (value < 0) ? ~((uint64_t)value << 1) : ((uint64_t)value << 1);
+
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    do
+    {
+        if (buffer == end)
+        {
+            return NULL;
+        }
+        *buffer = (uint8_t)(zigzag & 0x7Fu);
+        zigzag >>= 7;
+        if (zigzag != 0u)
+        {
+            *buffer |= 0x80u;
+        }
+        buffer++;
+    } while (zigzag != 0u);
+
+    return buffer;
+}
+
+/******************************************************************************
+ * Function Name: get_signed
+ ******************************************************************************
+ * Summary:
+ *  Function that loads a zig-zag varint, see put_signed(), and advances the
+ *  read position.
+ *
+ * Parameters:
+ *  const uint8_t **buffer : Read position
+ *  const uint8_t *end : End of the buffer
+ *  int64_t *value : Loaded value
+ *
+ * Return:
+ *  bool : true if a complete varint was loaded
+ *
+ ******************************************************************************/
+static bool get_signed(const uint8_t **buffer, const uint8_t *end, int64_t *value)
+{
+    uint64_t zigzag = 0;
+
+    for (uint32_t i = 0; i < DELTA_VARINT_MAX_SIZE; i++)
+    {
+        uint8_t byte;
+
+        if (*buffer == end)
+        {
+            return false;
+        }
+        byte = *(*buffer)++;
+        zigzag |= (uint64_t)(byte & 0x7Fu) << (7u * i);
+        if ((byte & 0x80u) == 0u)
+        {
+            *value = (int64_t)((zigzag >> 1) ^ (0u - (zigzag & 1u)));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* [] END OF FILE */
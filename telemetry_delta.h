@@ -0,0 +1,60 @@
+/******************************************************************************
+* File Name:   telemetry_delta.h
+*
+* Description: This file is the public interface of telemetry_delta.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef TELEMETRY_DELTA_H_
+#define TELEMETRY_DELTA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "telemetry_codec.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Version written in the first byte of a delta encoded batch. It differs
+ * from TELEMETRY_CODEC_VERSION, so a payload tells by its first byte whether
+ * it holds packed records or a delta encoded batch.
+ */
+#define TELEMETRY_DELTA_VERSION             (2u)
+
+/* Size of the batch header. */
+#define TELEMETRY_DELTA_HEADER_SIZE         (1u)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Fields of the previous record of a batch, against which the next record is
+ * encoded. Channels keep their last values while they are absent.
+ */
+typedef struct
+{
+    uint32_t channel_mask;
+    uint64_t last_us;
+    int64_t step_us;
+    uint32_t span_us;
+    uint32_t window_s;
+    telemetry_channel_record_t channel[TELEMETRY_CODEC_MAX_CHANNELS];
+} telemetry_delta_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+size_t telemetry_delta_begin(telemetry_delta_t *state, uint8_t *buffer, size_t size);
+size_t telemetry_delta_encode(telemetry_delta_t *state, const telemetry_record_t *record,
+                              uint8_t *buffer, size_t size);
+size_t telemetry_delta_open(telemetry_delta_t *state, const uint8_t *buffer, size_t length);
+size_t telemetry_delta_decode(telemetry_delta_t *state, const uint8_t *buffer, size_t length,
+                              telemetry_record_t *record);
+size_t telemetry_delta_compress(const uint8_t *records, size_t length, uint8_t *buffer, size_t size);
+
+#endif /* TELEMETRY_DELTA_H_ */
+
+/* [] END OF FILE */
@@ -0,0 +1,510 @@
+/******************************************************************************
+* File Name:   telemetry_delta_test.c
+*
+* Description: This file contains a host test of the delta encoding of
+*              telemetry batches. Records are packed with telemetry_codec.c
+*              and decoded again with telemetry_codec_decode() to get the
+*              reference records; the same records are then delta encoded,
+*              decoded and compared field by field against the reference.
+*              It needs no board and no RTOS. Build and run it from this
+*              directory with:
+*
+*                gcc -std=c99 -Wall -Wextra -I.. -o telemetry_delta_test \
+*                    telemetry_delta_test.c ../telemetry_delta.c ../telemetry_codec.c
+*                ./telemetry_delta_test
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry_codec.h"
+#include "telemetry_delta.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Largest number of records in one test batch. */
+#define TEST_MAX_RECORDS                (16u)
+
+/* Size of the test buffers, enough for TEST_MAX_RECORDS packed records. */
+#define TEST_BUFFER_SIZE                (TEST_MAX_RECORDS * 256u)
+
+/* Q16.16 value of an integer. */
+#define Q16(value)                      ((int32_t)((value) * 65536))
+
+/* Records a failed check and carries on with the next one. */
+#define CHECK(condition)                check((condition), #condition, __LINE__)
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void check(int condition, const char *text, int line);
+static uint32_t reference_records(const telemetry_record_t *records, uint32_t count,
+                                  uint8_t *packed, size_t *length,
+                                  telemetry_record_t *reference);
+static uint32_t decode_batch(const uint8_t *batch, size_t length, telemetry_record_t *decoded);
+static int records_equal(const telemetry_record_t *a, const telemetry_record_t *b);
+static void check_round_trip(const char *name, const telemetry_record_t *records, uint32_t count);
+static void test_mask_change(void);
+static void test_negative_deltas(void);
+static void test_size_exhaustion(void);
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Number of failed checks. */
+static uint32_t failures;
+
+/******************************************************************************
+ * Function Name: main
+ ******************************************************************************
+ * Summary:
+ *  Runs all tests and reports the failed checks.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  int : 0 if all checks passed, else 1
+ *
+ ******************************************************************************/
+int main(void)
+{
+    test_mask_change();
+    test_negative_deltas();
+    test_size_exhaustion();
+
+    if (failures != 0u)
+    {
+        printf("telemetry_delta_test: %lu checks failed\n", (unsigned long)failures);
+        return 1;
+    }
+
+    printf("telemetry_delta_test: all checks passed\n");
+    return 0;
+}
+
+/******************************************************************************
+ * Function Name: check
+ ******************************************************************************
+ * Summary:
+ *  Function that counts and prints a failed check.
+ *
+ * Parameters:
+ *  int condition : Result of the check
+ *  const char *text : Checked expression
+ *  int line : Line of the check
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void check(int condition, const char *text, int line)
+{
+    if (!condition)
+    {
+        failures++;
+        printf("telemetry_delta_test.c:%d: check failed: %s\n", line, text);
+    }
+}
+
+/******************************************************************************
+ * Function Name: reference_records
+ ******************************************************************************
+ * Summary:
+ *  Function that packs records back to back with telemetry_codec_encode()
+ *  and decodes them with telemetry_codec_decode(). The decoded records are
+ *  what any encoding of the batch must reproduce.
+ *
+ * Parameters:
+ *  const telemetry_record_t *records : Records to pack
+ *  uint32_t count : Number of records
+ *  uint8_t *packed : Packed records, TEST_BUFFER_SIZE bytes
+ *  size_t *length : Length of the packed records
+ *  telemetry_record_t *reference : Decoded records
+ *
+ * Return:
+ *  uint32_t : Number of records packed and decoded
+ *
+ ******************************************************************************/
+static uint32_t reference_records(const telemetry_record_t *records, uint32_t count,
+                                  uint8_t *packed, size_t *length,
+                                  telemetry_record_t *reference)
+{
+    size_t offset = 0;
+    uint32_t decoded = 0;
+
+    *length = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        size_t size = telemetry_codec_encode(&records[i], &packed[*length],
+                                             TEST_BUFFER_SIZE - *length);
+        if (size == 0u)
+        {
+            break;
+        }
+        *length += size;
+    }
+
+    while (offset < *length)
+    {
+        size_t size = telemetry_codec_decode(&packed[offset], *length - offset,
+                                             &reference[decoded]);
+        if (size == 0u)
+        {
+            break;
+        }
+        offset += size;
+        decoded++;
+    }
+
+    return decoded;
+}
+
+/******************************************************************************
+ * Function Name: decode_batch
+ ******************************************************************************
+ * Summary:
+ *  Function that decodes all records of a delta encoded batch.
+ *
+ * Parameters:
+ *  const uint8_t *batch : Delta encoded batch
+ *  size_t length : Length of the batch
+ *  telemetry_record_t *decoded : Decoded records, TEST_MAX_RECORDS
+ *
+ * Return:
+ *  uint32_t : Number of records decoded, or TEST_MAX_RECORDS + 1 if the
+ *             batch is invalid
+ *
+ ******************************************************************************/
+static uint32_t decode_batch(const uint8_t *batch, size_t length, telemetry_record_t *decoded)
+{
+    telemetry_delta_t state;
+    size_t offset = telemetry_delta_open(&state, batch, length);
+    uint32_t count = 0;
+
+    if (offset == 0u)
+    {
+        return TEST_MAX_RECORDS + 1u;
+    }
+
+    while (offset < length)
+    {
+        size_t size;
+
+        if (count == TEST_MAX_RECORDS)
+        {
+            return TEST_MAX_RECORDS + 1u;
+        }
+        size = telemetry_delta_decode(&state, &batch[offset], length - offset, &decoded[count]);
+        if (size == 0u)
+        {
+            return TEST_MAX_RECORDS + 1u;
+        }
+        offset += size;
+        count++;
+    }
+
+    return count;
+}
+
+/******************************************************************************
+ * Function Name: records_equal
+ ******************************************************************************
+ * Summary:
+ *  Function that compares two decoded records field by field.
+ *
+ * Parameters:
+ *  const telemetry_record_t *a : First record
+ *  const telemetry_record_t *b : Second record
+ *
+ * Return:
+ *  int : 1 if all fields are equal, else 0
+ *
+ ******************************************************************************/
+static int records_equal(const telemetry_record_t *a, const telemetry_record_t *b)
+{
+    if ((a->type != b->type) || (a->window_s != b->window_s) || (a->first_us != b->first_us) ||
+        (a->last_us != b->last_us) || (a->channel_mask != b->channel_mask))
+    {
+        return 0;
+    }
+
+    for (uint32_t channel = 0; channel < TELEMETRY_CODEC_MAX_CHANNELS; channel++)
+    {
+        const telemetry_channel_record_t *x = &a->channel[channel];
+        const telemetry_channel_record_t *y = &b->channel[channel];
+
+        if ((x->value != y->value) || (x->min != y->min) || (x->max != y->max) ||
+            (x->variance != y->variance) || (x->count != y->count))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/******************************************************************************
+ * Function Name: check_round_trip
+ ******************************************************************************
+ * Summary:
+ *  Function that checks that a batch decodes to the reference records both
+ *  when it is delta encoded record by record and when the packed records
+ *  are converted with telemetry_delta_compress().
+ *
+ * Parameters:
+ *  const char *name : Name of the test, for the report
+ *  const telemetry_record_t *records : Records of the batch
+ *  uint32_t count : Number of records
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void check_round_trip(const char *name, const telemetry_record_t *records, uint32_t count)
+{
+    static uint8_t packed[TEST_BUFFER_SIZE];
+    static uint8_t batch[TEST_BUFFER_SIZE];
+    static telemetry_record_t reference[TEST_MAX_RECORDS];
+    static telemetry_record_t decoded[TEST_MAX_RECORDS];
+    telemetry_delta_t state;
+    size_t packed_length;
+    size_t length;
+    uint32_t failed = failures;
+
+    CHECK(reference_records(records, count, packed, &packed_length, reference) == count);
+
+    /* Encoded record by record, as the journal drains. */
+    length = telemetry_delta_begin(&state, batch, sizeof(batch));
+    CHECK(length == TELEMETRY_DELTA_HEADER_SIZE);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        size_t size = telemetry_delta_encode(&state, &reference[i], &batch[length],
+                                             sizeof(batch) - length);
+        CHECK(size != 0u);
+        length += size;
+    }
+    CHECK(decode_batch(batch, length, decoded) == count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        CHECK(records_equal(&decoded[i], &reference[i]));
+    }
+
+    /* Converted from the packed records, as the publisher batches. */
+    length = telemetry_delta_compress(packed, packed_length, batch, sizeof(batch));
+    CHECK(length != 0u);
+    CHECK(length < packed_length);
+    CHECK(decode_batch(batch, length, decoded) == count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        CHECK(records_equal(&decoded[i], &reference[i]));
+    }
+
+    printf("%s: %s\n", name, (failures == failed) ? "passed" : "FAILED");
+}
+
+/******************************************************************************
+ * Function Name: test_mask_change
+ ******************************************************************************
+ * Summary:
+ *  Latest-value and window records whose channel mask changes in the middle
+ *  of the batch. A channel that leaves and comes back must be encoded
+ *  against its last value, not against the record before.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void test_mask_change(void)
+{
+    static const uint32_t masks[] = { 0x07u, 0x07u, 0x05u, 0x01u, 0x07u, 0x06u, 0x07u, 0xFFu };
+    const uint32_t count = sizeof(masks) / sizeof(masks[0]);
+    telemetry_record_t records[TEST_MAX_RECORDS];
+
+    memset(records, 0, sizeof(records));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        telemetry_record_t *record = &records[i];
+
+        record->type = (i < 5u) ? TELEMETRY_RECORD_LATEST : TELEMETRY_RECORD_WINDOW;
+        record->last_us = 1000000u + (i * 2000000u);
+        record->first_us = (record->type == TELEMETRY_RECORD_WINDOW) ?
+                           (record->last_us - 1900000u) : record->last_us;
+        record->window_s = (record->type == TELEMETRY_RECORD_WINDOW) ? 10u : 0u;
+        record->channel_mask = masks[i];
+
+        for (uint32_t channel = 0; channel < TELEMETRY_CODEC_MAX_CHANNELS; channel++)
+        {
+            telemetry_channel_record_t *values = &record->channel[channel];
+
+            if ((masks[i] & (1lu << channel)) == 0u)
+            {
+                continue;
+            }
+            values->value = Q16(7) + (int32_t)(channel * 1000u) + (int32_t)(i * 3u);
+            if (record->type == TELEMETRY_RECORD_WINDOW)
+            {
+                values->min = values->value - 200;
+                values->max = values->value + 300;
+                values->variance = 40 + (int32_t)i;
+                values->count = 100u;
+            }
+        }
+    }
+
+    check_round_trip("mask change mid-batch", records, count);
+}
+
+/******************************************************************************
+ * Function Name: test_negative_deltas
+ ******************************************************************************
+ * Summary:
+ *  Window records whose fields fall as often as they rise: negative values,
+ *  a shrinking capture step and span, a shorter window and fewer samples.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void test_negative_deltas(void)
+{
+    static const int32_t values[] = { Q16(3), Q16(-2), Q16(-40), Q16(5), Q16(-1), Q16(-1) };
+    static const uint32_t steps_us[] = { 5000000u, 4000000u, 9000000u, 1000u, 700000u, 700000u };
+    const uint32_t count = sizeof(values) / sizeof(values[0]);
+    telemetry_record_t records[TEST_MAX_RECORDS];
+    uint64_t now_us = 0x123456789ull;
+
+    memset(records, 0, sizeof(records));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        telemetry_record_t *record = &records[i];
+
+        now_us += steps_us[i];
+        record->type = TELEMETRY_RECORD_WINDOW;
+        record->last_us = now_us;
+        record->first_us = now_us - (steps_us[i] / 2u);
+        record->window_s = 60u - (i * 7u);
+        record->channel_mask = 0x03u;
+
+        for (uint32_t channel = 0; channel < 2u; channel++)
+        {
+            telemetry_channel_record_t *channel_values = &record->channel[channel];
+            int32_t sign = (channel == 0u) ? 1 : -1;
+
+            channel_values->value = sign * values[i];
+            channel_values->min = channel_values->value - Q16(1);
+            channel_values->max = channel_values->value + Q16(1);
+            channel_values->variance = (int32_t)(1000u / (i + 1u));
+            channel_values->count = 600u - (i * 90u);
+        }
+    }
+
+    check_round_trip("negative deltas", records, count);
+}
+
+/******************************************************************************
+ * Function Name: test_size_exhaustion
+ ******************************************************************************
+ * Summary:
+ *  A batch filled until a record no longer fits. The records that fit must
+ *  decode to the reference, the encoder state must not advance on the
+ *  record that did not fit, and a new batch started from that record must
+ *  carry the rest. Compressing into a buffer that is too small must fail.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void test_size_exhaustion(void)
+{
+    static uint8_t packed[TEST_BUFFER_SIZE];
+    static telemetry_record_t reference[TEST_MAX_RECORDS];
+    static telemetry_record_t decoded[TEST_MAX_RECORDS];
+    const uint32_t count = TEST_MAX_RECORDS;
+    telemetry_record_t records[TEST_MAX_RECORDS];
+    telemetry_delta_t state;
+    uint8_t batch[48];
+    size_t packed_length;
+    uint32_t next = 0;
+    uint32_t batches = 0;
+    uint32_t failed = failures;
+
+    memset(records, 0, sizeof(records));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        records[i].type = TELEMETRY_RECORD_LATEST;
+        records[i].last_us = 2000000u * (i + 1u) + ((i % 3u) * 1500u);
+        records[i].first_us = records[i].last_us;
+        records[i].channel_mask = 0x07u;
+        for (uint32_t channel = 0; channel < 3u; channel++)
+        {
+            records[i].channel[channel].value = Q16(10) - (int32_t)(i * 777u * (channel + 1u));
+        }
+    }
+    CHECK(reference_records(records, count, packed, &packed_length, reference) == count);
+
+    /* Every batch takes the records that fit and the next one goes on. */
+    while ((next < count) && (batches < count))
+    {
+        size_t length = telemetry_delta_begin(&state, batch, sizeof(batch));
+        uint32_t first = next;
+        uint32_t decoded_count;
+
+        for (; next < count; next++)
+        {
+            telemetry_delta_t before = state;
+            size_t size = telemetry_delta_encode(&state, &reference[next], &batch[length],
+                                                 sizeof(batch) - length);
+            if (size == 0u)
+            {
+                CHECK(memcmp(&before, &state, sizeof(state)) == 0);
+                break;
+            }
+            length += size;
+        }
+        CHECK(next > first);
+        if (next == first)
+        {
+            break;
+        }
+
+        decoded_count = decode_batch(batch, length, decoded);
+        CHECK(decoded_count == (next - first));
+        for (uint32_t i = 0; (i < decoded_count) && ((first + i) < count); i++)
+        {
+            CHECK(records_equal(&decoded[i], &reference[first + i]));
+        }
+        batches++;
+    }
+    CHECK(next == count);
+    CHECK(batches > 1u);
+
+    /* The whole batch does not fit in the small buffer. */
+    CHECK(telemetry_delta_compress(packed, packed_length, batch, sizeof(batch)) == 0u);
+
+    /* A truncated batch is rejected rather than decoded short. */
+    {
+        static uint8_t full[TEST_BUFFER_SIZE];
+        size_t length = telemetry_delta_compress(packed, packed_length, full, sizeof(full));
+
+        CHECK(length > TELEMETRY_DELTA_HEADER_SIZE);
+        CHECK(decode_batch(full, length - 1u, decoded) == (TEST_MAX_RECORDS + 1u));
+    }
+
+    printf("size exhaustion: %s\n", (failures == failed) ? "passed" : "FAILED");
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,116 @@
+/******************************************************************************
+* File Name:   token_bucket.c
+*
+* Description: This file contains a token bucket rate limiter. Time is given
+*              by the caller in ticks of any monotonic counter that may wrap
+*              around, and the credit is kept in the same ticks, so the
+*              refill is a subtraction and needs no division.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include "token_bucket.h"
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void token_bucket_refill(token_bucket_t *bucket, uint32_t now);
+
+/******************************************************************************
+ * Function Name: token_bucket_init
+ ******************************************************************************
+ * Summary:
+ *  Function that configures a bucket and fills it.
+ *
+ * Parameters:
+ *  token_bucket_t *bucket : Bucket to configure
+ *  uint32_t interval : Ticks between two tokens at the sustained rate, or 0
+ *                      to disable the limit
+ *  uint32_t burst : Number of tokens the bucket holds, at least 1
+ *  uint32_t now : Current time in ticks
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void token_bucket_init(token_bucket_t *bucket, uint32_t interval, uint32_t burst, uint32_t now)
+{
+    if (burst == 0u)
+    {
+        burst = 1;
+    }
+
+    bucket->interval = interval;
+    bucket->capacity = ((UINT32_MAX / burst) < interval) ? UINT32_MAX : (interval * burst);
+    bucket->level = bucket->capacity;
+    bucket->last = now;
+}
+
+/******************************************************************************
+ * Function Name: token_bucket_delay
+ ******************************************************************************
+ * Summary:
+ *  Function that returns how long to wait for the next token.
+ *
+ * Parameters:
+ *  token_bucket_t *bucket : Bucket
+ *  uint32_t now : Current time in ticks
+ *
+ * Return:
+ *  uint32_t : Ticks until a token is available, 0 if one is available now
+ *
+ ******************************************************************************/
+uint32_t token_bucket_delay(token_bucket_t *bucket, uint32_t now)
+{
+    token_bucket_refill(bucket, now);
+
+    return (bucket->level >= bucket->interval) ? 0u : (bucket->interval - bucket->level);
+}
+
+/******************************************************************************
+ * Function Name: token_bucket_take
+ ******************************************************************************
+ * Summary:
+ *  Function that uses up one token. If none is available the bucket is
+ *  emptied, so traffic that cannot be held back still slows down the rest.
+ *
+ * Parameters:
+ *  token_bucket_t *bucket : Bucket
+ *  uint32_t now : Current time in ticks
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void token_bucket_take(token_bucket_t *bucket, uint32_t now)
+{
+    token_bucket_refill(bucket, now);
+
+    bucket->level = (bucket->level >= bucket->interval) ? (bucket->level - bucket->interval) : 0u;
+}
+
+/******************************************************************************
+ * Function Name: token_bucket_refill
+ ******************************************************************************
+ * Summary:
+ *  Function that adds the credit earned since the last call.
+ *
+ * Parameters:
+ *  token_bucket_t *bucket : Bucket
+ *  uint32_t now : Current time in ticks
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void token_bucket_refill(token_bucket_t *bucket, uint32_t now)
+{
+    uint32_t elapsed = now - bucket->last;
+
+    bucket->last = now;
+    bucket->level = (elapsed >= (bucket->capacity - bucket->level)) ?
+                    bucket->capacity : (bucket->level + elapsed);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,40 @@
+/******************************************************************************
+* File Name:   token_bucket.h
+*
+* Description: This file is the public interface of token_bucket.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef TOKEN_BUCKET_H_
+#define TOKEN_BUCKET_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Token bucket measured in ticks: a token is 'interval' ticks of credit and
+ * the bucket holds at most 'capacity' ticks, 'burst' tokens. An interval of
+ * 0 disables the limit.
+ */
+typedef struct
+{
+    uint32_t interval;
+    uint32_t capacity;
+    uint32_t level;
+    uint32_t last;
+} token_bucket_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void token_bucket_init(token_bucket_t *bucket, uint32_t interval, uint32_t burst, uint32_t now);
+uint32_t token_bucket_delay(token_bucket_t *bucket, uint32_t now);
+void token_bucket_take(token_bucket_t *bucket, uint32_t now);
+
+#endif /* TOKEN_BUCKET_H_ */
+
+/* [] END OF FILE */
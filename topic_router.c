@@ -0,0 +1,338 @@
+/******************************************************************************
+* File Name:   topic_router.c
+*
+* Description: This file contains the router of the messages received on the
+*              subscribed MQTT topics. The topic filters of a node are listed
+*              with their handlers in a constant table; at start-up they are
+*              split into levels and merged into a tree, where filters with a
+*              common prefix share nodes. A message is routed by walking the
+*              tree one topic level at a time, so the cost follows the depth
+*              of the topic rather than the number of routes, and the topic
+*              is matched in place without copies or allocations.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include <string.h>
+
+#include "topic_router.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+#define TOPIC_LEVEL_SEPARATOR           ('/')
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static size_t level_length(const char *text, size_t length);
+static uint8_t find_or_add_child(topic_router_t *router, uint8_t parent,
+                                 const char *level, size_t level_len);
+static uint32_t route_level(const topic_router_t *router, uint8_t parent,
+                            const char *level, size_t remaining, bool first,
+                            const char *topic, size_t topic_len,
+                            const char *payload, size_t payload_len);
+static uint32_t call_route(const topic_router_t *router, const topic_node_t *node,
+                           const char *topic, size_t topic_len,
+                           const char *payload, size_t payload_len);
+
+/******************************************************************************
+ * Function Name: topic_router_init
+ ******************************************************************************
+ * Summary:
+ *  Function that builds the topic tree of a route table.
+ *
+ * Parameters:
+ *  topic_router_t *router : Router to build
+ *  const topic_route_t *routes : Routes, which must stay valid
+ *  uint32_t count : Number of routes
+ *
+ * Return:
+ *  bool : true if the tree was built, false if a filter is invalid or listed
+ *         twice, or the tree needs more than 'TOPIC_ROUTER_MAX_NODES' nodes
+ *
+ ******************************************************************************/
+bool topic_router_init(topic_router_t *router, const topic_route_t *routes, uint32_t count)
+{
+    memset(router, 0, sizeof(*router));
+    router->node_count = 1u;
+
+    if (count > UINT8_MAX)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const char *level = routes[i].filter;
+        size_t remaining = routes[i].filter_len;
+        uint8_t node = 1u;
+
+        if (remaining == 0u)
+        {
+            return false;
+        }
+
+        while (true)
+        {
+            size_t level_len = level_length(level, remaining);
+
+            /* Wildcards must make up a whole level, and '#' must be last. */
+            if (((memchr(level, '+', level_len) != NULL) || (memchr(level, '#', level_len) != NULL)) &&
+                ((level_len != 1u) || ((level[0] == '#') && (level_len != remaining))))
+            {
+                return false;
+            }
+
+            node = find_or_add_child(router, node, level, level_len);
+            if (node == 0u)
+            {
+                return false;
+            }
+
+            if (level_len == remaining)
+            {
+                break;
+            }
+            level += level_len + 1u;
+            remaining -= level_len + 1u;
+        }
+
+        if (router->node[node - 1u].route != 0u)
+        {
+            return false;
+        }
+        router->node[node - 1u].route = (uint8_t)(i + 1u);
+    }
+
+    router->routes = routes;
+    router->count = count;
+
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: topic_router_dispatch
+ ******************************************************************************
+ * Summary:
+ *  Function that calls the handler of every route whose filter matches a
+ *  topic. As in MQTT, wildcards at the first level do not match topics that
+ *  start with '$'.
+ *
+ * Parameters:
+ *  const topic_router_t *router : Router
+ *  const char *topic : Topic of the received message
+ *  size_t topic_len : Length of the topic
+ *  const char *payload : Payload of the received message
+ *  size_t payload_len : Length of the payload
+ *
+ * Return:
+ *  uint32_t : Number of handlers called, 0 if no route matches
+ *
+ ******************************************************************************/
+uint32_t topic_router_dispatch(const topic_router_t *router, const char *topic, size_t topic_len,
+                               const char *payload, size_t payload_len)
+{
+    if ((router->routes == NULL) || (topic_len == 0u))
+    {
+        return 0;
+    }
+
+    return route_level(router, 1u, topic, topic_len, true, topic, topic_len, payload, payload_len);
+}
+
+/******************************************************************************
+ * Function Name: level_length
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the length of the first level of a topic.
+ *
+ * Parameters:
+ *  const char *text : Topic or topic filter, from the start of a level
+ *  size_t length : Length of the text
+ *
+ * Return:
+ *  size_t : Length up to the next separator or the end of the text
+ *
+ ******************************************************************************/
+static size_t level_length(const char *text, size_t length)
+{
+    const char *separator = memchr(text, TOPIC_LEVEL_SEPARATOR, length);
+
+    return (separator != NULL) ? (size_t)(separator - text) : length;
+}
+
+/******************************************************************************
+ * Function Name: find_or_add_child
+ ******************************************************************************
+ * Summary:
+ *  Function that returns the child of a node for a filter level, and adds it
+ *  if the node has none yet.
+ *
+ * Parameters:
+ *  topic_router_t *router : Router being built
+ *  uint8_t parent : Index + 1 of the parent node
+ *  const char *level : Filter level
+ *  size_t level_len : Length of the filter level
+ *
+ * Return:
+ *  uint8_t : Index + 1 of the child, or 0 if the tree is full
+ *
+ ******************************************************************************/
+static uint8_t find_or_add_child(topic_router_t *router, uint8_t parent,
+                                 const char *level, size_t level_len)
+{
+    topic_node_t *node;
+    uint8_t child;
+
+    for (child = router->node[parent - 1u].child; child != 0u; child = router->node[child - 1u].sibling)
+    {
+        node = &router->node[child - 1u];
+        if ((node->level_len == level_len) && (memcmp(node->level, level, level_len) == 0))
+        {
+            return child;
+        }
+    }
+
+    if ((router->node_count >= TOPIC_ROUTER_MAX_NODES) || (level_len > UINT16_MAX))
+    {
+        return 0;
+    }
+
+    node = &router->node[router->node_count];
+    node->level = level;
+    node->level_len = (uint16_t)level_len;
+    node->kind = TOPIC_LEVEL_NAME;
+    if ((level_len == 1u) && (level[0] == '+'))
+    {
+        node->kind = TOPIC_LEVEL_SINGLE;
+    }
+    else if ((level_len == 1u) && (level[0] == '#'))
+    {
+        node->kind = TOPIC_LEVEL_MULTI;
+    }
+
+    /* Prepend, the order of the children does not matter. */
+    node->sibling = router->node[parent - 1u].child;
+    router->node_count++;
+    router->node[parent - 1u].child = (uint8_t)router->node_count;
+
+    return (uint8_t)router->node_count;
+}
+
+/******************************************************************************
+ * Function Name: route_level
+ ******************************************************************************
+ * Summary:
+ *  Function that matches one topic level against the children of a node and
+ *  descends into every child that matches. The recursion is bounded by the
+ *  depth of the tree, not by the topic.
+ *
+ * Parameters:
+ *  const topic_router_t *router : Router
+ *  uint8_t parent : Index + 1 of the node matched so far
+ *  const char *level : Topic, from the start of the level to match
+ *  size_t remaining : Length of the topic from 'level' on
+ *  bool first : true for the first topic level
+ *  const char *topic : Whole topic, passed to the handlers
+ *  size_t topic_len : Length of the whole topic
+ *  const char *payload : Payload, passed to the handlers
+ *  size_t payload_len : Length of the payload
+ *
+ * Return:
+ *  uint32_t : Number of handlers called
+ *
+ ******************************************************************************/
+static uint32_t route_level(const topic_router_t *router, uint8_t parent,
+                            const char *level, size_t remaining, bool first,
+                            const char *topic, size_t topic_len,
+                            const char *payload, size_t payload_len)
+{
+    size_t level_len = level_length(level, remaining);
+    bool last = (level_len == remaining);
+    bool wildcards = !(first && (level_len > 0u) && (level[0] == '$'));
+    uint32_t called = 0;
+
+    for (uint8_t child = router->node[parent - 1u].child; child != 0u;
+         child = router->node[child - 1u].sibling)
+    {
+        const topic_node_t *node = &router->node[child - 1u];
+
+        if (node->kind == TOPIC_LEVEL_MULTI)
+        {
+            if (wildcards)
+            {
+                called += call_route(router, node, topic, topic_len, payload, payload_len);
+            }
+            continue;
+        }
+
+        if (node->kind == TOPIC_LEVEL_SINGLE)
+        {
+            if (!wildcards)
+            {
+                continue;
+            }
+        }
+        else if ((node->level_len != level_len) || (memcmp(node->level, level, level_len) != 0))
+        {
+            continue;
+        }
+
+        if (!last)
+        {
+            called += route_level(router, child, &level[level_len + 1u], remaining - level_len - 1u,
+                                  false, topic, topic_len, payload, payload_len);
+            continue;
+        }
+
+        called += call_route(router, node, topic, topic_len, payload, payload_len);
+
+        /* A trailing '#' also matches the level above it. */
+        for (uint8_t grandchild = node->child; grandchild != 0u;
+             grandchild = router->node[grandchild - 1u].sibling)
+        {
+            if (router->node[grandchild - 1u].kind == TOPIC_LEVEL_MULTI)
+            {
+                called += call_route(router, &router->node[grandchild - 1u],
+                                     topic, topic_len, payload, payload_len);
+            }
+        }
+    }
+
+    return called;
+}
+
+/******************************************************************************
+ * Function Name: call_route
+ ******************************************************************************
+ * Summary:
+ *  Function that calls the handler of the route ending at a node, if any.
+ *
+ * Parameters:
+ *  const topic_router_t *router : Router
+ *  const topic_node_t *node : Matched node
+ *  const char *topic : Topic, passed to the handler
+ *  size_t topic_len : Length of the topic
+ *  const char *payload : Payload, passed to the handler
+ *  size_t payload_len : Length of the payload
+ *
+ * Return:
+ *  uint32_t : 1 if a handler was called, else 0
+ *
+ ******************************************************************************/
+static uint32_t call_route(const topic_router_t *router, const topic_node_t *node,
+                           const char *topic, size_t topic_len,
+                           const char *payload, size_t payload_len)
+{
+    if (node->route == 0u)
+    {
+        return 0;
+    }
+
+    router->routes[node->route - 1u].handler(topic, topic_len, payload, payload_len);
+    return 1;
+}
+
+/* [] END OF FILE */
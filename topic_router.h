@@ -0,0 +1,91 @@
+/******************************************************************************
+* File Name:   topic_router.h
+*
+* Description: This file is the public interface of topic_router.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef TOPIC_ROUTER_H_
+#define TOPIC_ROUTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of nodes of the topic tree of a router, one per distinct topic
+ * filter prefix plus the root. At most 255.
+ */
+#define TOPIC_ROUTER_MAX_NODES              (32u)
+
+/* Entry of a route table. */
+#define TOPIC_ROUTE(filter, handler) \
+    { (filter), sizeof(filter) - 1u, (handler) }
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Handler of a route. It receives the topic the message was published on,
+ * which matters for filters with wildcards. Neither topic nor payload is
+ * null terminated.
+ */
+typedef void (*topic_handler_t)(const char *topic, size_t topic_len,
+                                const char *payload, size_t payload_len);
+
+/* One route, see the TOPIC_ROUTE() macro. The filter follows the MQTT topic
+ * filter syntax: '+' matches one topic level and a trailing '#' matches any
+ * number of levels, including none.
+ */
+typedef struct
+{
+    const char *filter;
+    size_t filter_len;
+    topic_handler_t handler;
+} topic_route_t;
+
+/* Kind of topic level of a node. */
+typedef enum
+{
+    TOPIC_LEVEL_NAME,
+    TOPIC_LEVEL_SINGLE,     /* '+' */
+    TOPIC_LEVEL_MULTI       /* '#' */
+} topic_level_t;
+
+/* Node of the topic tree. 'child', 'sibling' and 'route' hold an index + 1,
+ * or 0 if there is none.
+ */
+typedef struct
+{
+    const char *level;
+    uint16_t level_len;
+    uint8_t kind;
+    uint8_t child;
+    uint8_t sibling;
+    uint8_t route;
+} topic_node_t;
+
+/* Topic tree of a route table, built once by topic_router_init(). The first
+ * node is the root, above the first topic level.
+ */
+typedef struct
+{
+    const topic_route_t *routes;
+    uint32_t count;
+    uint32_t node_count;
+    topic_node_t node[TOPIC_ROUTER_MAX_NODES];
+} topic_router_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+bool topic_router_init(topic_router_t *router, const topic_route_t *routes, uint32_t count);
+uint32_t topic_router_dispatch(const topic_router_t *router, const char *topic, size_t topic_len,
+                               const char *payload, size_t payload_len);
+
+#endif /* TOPIC_ROUTER_H_ */
+
+/* [] END OF FILE */
@@ -0,0 +1,362 @@
+/******************************************************************************
+* File Name:   ultrasound.c
+*
+* Description: This file contains the driver for the ultrasonic distance
+*              sensor. The echo pulse is timed with GPIO edge interrupts that
+*              sample a free-running 1 MHz hardware timer, so the measurement
+*              does not depend on the CPU clock and no task polls the echo
+*              pin. The sensor scheduler reads the driver on both nodes: every
+*              read collects the echo of the previous ping and sends the next
+*              one, so no task ever waits for an echo.
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#include "cyhal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "ultrasound.h"
+#include "device_clock.h"
+
+/******************************************************************************
+* Macros
+******************************************************************************/
+/* Frequency of the echo timer. One tick is one microsecond. */
+#define ECHO_TIMER_FREQUENCY_HZ         (1000000u)
+
+/* The timer wraps at 16 bits so the same code works on 16-bit and 32-bit
+ * counters. This covers pulses of up to 65 ms, longer than any valid echo.
+ */
+#define ECHO_TIMER_PERIOD               (0xFFFFu)
+
+/* Length in microseconds of the trigger pulse. */
+#define TRIGGER_PULSE_US                (10u)
+
+/* Round trip time of sound in microseconds per centimeter. */
+#define ECHO_US_PER_CM                  (58u)
+
+/* The scheduler period is the only spacing between two pings. */
+#if (ULTRASOUND_SENSOR_PERIOD_MS < ULTRASOUND_MIN_PING_INTERVAL_MS)
+#error "ULTRASOUND_SENSOR_PERIOD_MS must be at least ULTRASOUND_MIN_PING_INTERVAL_MS"
+#endif
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void isr_echo_edge(void *callback_arg, cyhal_gpio_event_t event);
+static int echo_distance(void);
+static uint32_t ultrasound_read(sensor_sample_t *samples, uint32_t max_samples);
+
+/******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Driver operations table registered with the sensor scheduler. */
+const sensor_driver_t ultrasound_sensor =
+{
+    .name = "Ultrasound",
+    .period_ms = ULTRASOUND_SENSOR_PERIOD_MS,
+    .init = ultrasound_init,
+    .start = NULL,
+    .read = ultrasound_read,
+    .deinit = ultrasound_deinit
+};
+
+/* Free-running timer used to timestamp the echo edges. */
+static cyhal_timer_t echo_timer;
+
+/* Signalled by the echo ISR when the falling edge has been captured. */
+static SemaphoreHandle_t echo_done_semaphore;
+
+/* Timer values captured on the rising and falling edge of the echo. */
+static volatile uint32_t echo_start;
+static volatile uint32_t echo_width_us;
+static volatile bool echo_started;
+
+/* Device clock time of the rising edge of the last echo. */
+static volatile uint64_t echo_timestamp_us;
+
+/* Set when a ping has been sent and its echo has not been collected yet. */
+static bool ping_pending;
+
+/* Tick count of the last trigger, used to enforce the ping interval. */
+static TickType_t last_ping;
+
+/* Structure that stores the callback data for the echo pin interrupt. */
+static cyhal_gpio_callback_data_t echo_cb_data =
+{
+    .callback = isr_echo_edge,
+    .callback_arg = NULL
+};
+
+/******************************************************************************
+ * Function Name: ultrasound_init
+ ******************************************************************************
+ * Summary:
+ *  Function that sets up the trigger and echo pins, the echo edge interrupt
+ *  and the free-running timer used to measure the echo pulse.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code
+ *
+ ******************************************************************************/
+cy_rslt_t ultrasound_init(void)
+{
+    cy_rslt_t result;
+    const cyhal_timer_cfg_t timer_cfg =
+    {
+        .compare_value = 0,
+        .period = ECHO_TIMER_PERIOD,
+        .direction = CYHAL_TIMER_DIR_UP,
+        .is_compare = false,
+        .is_continuous = true,
+        .value = 0
+    };
+
+    echo_done_semaphore = xSemaphoreCreateBinary();
+    if (echo_done_semaphore == NULL)
+    {
+        return ~CY_RSLT_SUCCESS;
+    }
+
+    result = cyhal_gpio_init(ULTRASOUND_TRIGGER_PIN, CYHAL_GPIO_DIR_OUTPUT,
+                             CYHAL_GPIO_DRIVE_STRONG, false);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    result = cyhal_gpio_init(ULTRASOUND_ECHO_PIN, CYHAL_GPIO_DIR_INPUT,
+                             CYHAL_GPIO_DRIVE_NONE, false);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    result = cyhal_timer_init(&echo_timer, NC, NULL);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cyhal_timer_configure(&echo_timer, &timer_cfg);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cyhal_timer_set_frequency(&echo_timer, ECHO_TIMER_FREQUENCY_HZ);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cyhal_timer_start(&echo_timer);
+    }
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    cyhal_gpio_register_callback(ULTRASOUND_ECHO_PIN, &echo_cb_data);
+    cyhal_gpio_enable_event(ULTRASOUND_ECHO_PIN, CYHAL_GPIO_IRQ_BOTH,
+                            ULTRASOUND_ECHO_INTR_PRIORITY, true);
+
+    last_ping = xTaskGetTickCount() - pdMS_TO_TICKS(ULTRASOUND_MIN_PING_INTERVAL_MS);
+    return CY_RSLT_SUCCESS;
+}
+
+/******************************************************************************
+ * Function Name: ultrasound_deinit
+ ******************************************************************************
+ * Summary:
+ *  Function that disables the echo interrupt and releases the pins and the
+ *  timer used by the driver.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void ultrasound_deinit(void)
+{
+    cyhal_gpio_enable_event(ULTRASOUND_ECHO_PIN, CYHAL_GPIO_IRQ_BOTH,
+                            ULTRASOUND_ECHO_INTR_PRIORITY, false);
+    cyhal_timer_free(&echo_timer);
+    cyhal_gpio_free(ULTRASOUND_ECHO_PIN);
+    cyhal_gpio_free(ULTRASOUND_TRIGGER_PIN);
+}
+
+/******************************************************************************
+ * Function Name: ultrasound_trigger
+ ******************************************************************************
+ * Summary:
+ *  Function that sends one ping without waiting for its echo. The result is
+ *  collected later with ultrasound_get_result(). The caller is responsible
+ *  for spacing pings at least 'ULTRASOUND_MIN_PING_INTERVAL_MS' apart.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void ultrasound_trigger(void)
+{
+    /* Discard a completion left over from a previous, timed out ping. */
+    xSemaphoreTake(echo_done_semaphore, 0);
+    echo_started = false;
+
+    cyhal_gpio_write(ULTRASOUND_TRIGGER_PIN, true);
+    cyhal_system_delay_us(TRIGGER_PULSE_US);
+    cyhal_gpio_write(ULTRASOUND_TRIGGER_PIN, false);
+    last_ping = xTaskGetTickCount();
+    ping_pending = true;
+}
+
+/******************************************************************************
+ * Function Name: ultrasound_get_result
+ ******************************************************************************
+ * Summary:
+ *  Function that collects the result of the last ping sent with
+ *  ultrasound_trigger(), without blocking.
+ *
+ * Parameters:
+ *  int *distance : Distance in centimeters, or ULTRASOUND_INVALID_DISTANCE
+ *                  if the echo was out of range or has timed out
+ *
+ * Return:
+ *  bool : true if a result is available, false if the echo is still pending
+ *         or no ping was sent
+ *
+ ******************************************************************************/
+bool ultrasound_get_result(int *distance)
+{
+    if (!ping_pending)
+    {
+        return false;
+    }
+
+    if (pdTRUE == xSemaphoreTake(echo_done_semaphore, 0))
+    {
+        *distance = echo_distance();
+    }
+    else if ((xTaskGetTickCount() - last_ping) >= pdMS_TO_TICKS(ULTRASOUND_ECHO_TIMEOUT_MS))
+    {
+        *distance = ULTRASOUND_INVALID_DISTANCE;
+    }
+    else
+    {
+        return false;
+    }
+
+    ping_pending = false;
+    return true;
+}
+
+/******************************************************************************
+ * Function Name: ultrasound_read
+ ******************************************************************************
+ * Summary:
+ *  Sensor driver read operation. It collects the echo of the previous ping
+ *  and sends the next one, so the scheduler never waits for an echo.
+ *
+ * Parameters:
+ *  sensor_sample_t *samples : Buffer receiving the samples
+ *  uint32_t max_samples : Capacity of the buffer
+ *
+ * Return:
+ *  uint32_t : Number of samples stored
+ *
+ ******************************************************************************/
+static uint32_t ultrasound_read(sensor_sample_t *samples, uint32_t max_samples)
+{
+    uint32_t stored = 0;
+    int distance;
+
+    if (ultrasound_get_result(&distance) && (distance != ULTRASOUND_INVALID_DISTANCE) &&
+        (max_samples > 0u))
+    {
+        samples[0].channel = SENSOR_CHANNEL_LEVEL;
+        samples[0].value = SENSOR_VALUE_FROM_INT(distance);
+        samples[0].timestamp_us = echo_timestamp_us;
+        stored = 1;
+    }
+
+    if (!ping_pending)
+    {
+        ultrasound_trigger();
+    }
+
+    return stored;
+}
+
+/******************************************************************************
+ * Function Name: echo_distance
+ ******************************************************************************
+ * Summary:
+ *  Function that converts the last captured echo width to a distance.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  int : Distance in centimeters, or ULTRASOUND_INVALID_DISTANCE if out of
+ *        range
+ *
+ ******************************************************************************/
+static int echo_distance(void)
+{
+    int distance = (int)(echo_width_us / ECHO_US_PER_CM);
+
+    if (distance > ULTRASOUND_MAX_DISTANCE_CM)
+    {
+        return ULTRASOUND_INVALID_DISTANCE;
+    }
+
+    return distance;
+}
+
+/******************************************************************************
+ * Function Name: isr_echo_edge
+ ******************************************************************************
+ * Summary:
+ *  GPIO interrupt service routine for both edges of the echo pin. The rising
+ *  edge latches the timer value and the device clock; the falling edge
+ *  computes the pulse width and signals that the echo is complete.
+ *
+ * Parameters:
+ *  void *callback_arg : pointer to variable passed to the ISR (unused)
+ *  cyhal_gpio_event_t event : GPIO event type (unused)
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+static void isr_echo_edge(void *callback_arg, cyhal_gpio_event_t event)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t now = cyhal_timer_read(&echo_timer);
+
+    (void) callback_arg;
+    (void) event;
+
+    /* The event reports both edges, the pin level tells which one fired. */
+    if (cyhal_gpio_read(ULTRASOUND_ECHO_PIN))
+    {
+        echo_start = now;
+        echo_timestamp_us = device_clock_now_us();
+        echo_started = true;
+    }
+    else if (echo_started)
+    {
+        echo_width_us = (now - echo_start) & ECHO_TIMER_PERIOD;
+        echo_started = false;
+        xSemaphoreGiveFromISR(echo_done_semaphore, &xHigherPriorityTaskWoken);
+    }
+
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* [] END OF FILE */
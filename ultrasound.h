@@ -0,0 +1,64 @@
+/******************************************************************************
+* File Name:   ultrasound.h
+*
+* Description: This file is the public interface of ultrasound.c
+*
+* Related Document: See README.md
+*
+*******************************************************************************/
+
+#ifndef ULTRASOUND_H_
+#define ULTRASOUND_H_
+
+#include <stdbool.h>
+
+#include "cyhal.h"
+#include "sensor.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Pins connected to the trigger and echo lines of the ultrasonic sensor. */
+#define ULTRASOUND_TRIGGER_PIN              (P9_2)
+#define ULTRASOUND_ECHO_PIN                 (P9_1)
+
+/* Interrupt priority of the echo pin edge events. */
+#define ULTRASOUND_ECHO_INTR_PRIORITY       (3u)
+
+/* Maximum time in milliseconds to wait for a complete echo pulse. The sensor
+ * drops the echo line after about 38 ms when no object is detected.
+ */
+#define ULTRASOUND_ECHO_TIMEOUT_MS          (40u)
+
+/* Minimum time in milliseconds between two pings, so that the echo of the
+ * previous ping has died out before the next trigger.
+ */
+#define ULTRASOUND_MIN_PING_INTERVAL_MS     (60u)
+
+/* Measurements beyond this distance are reported as invalid. */
+#define ULTRASOUND_MAX_DISTANCE_CM          (330)
+
+/* Distance reported by ultrasound_get_result() when no valid echo was
+ * received.
+ */
+#define ULTRASOUND_INVALID_DISTANCE         (-1)
+
+/* Period in milliseconds at which the sensor scheduler pings the sensor. */
+#define ULTRASOUND_SENSOR_PERIOD_MS         (100u)
+
+/*******************************************************************************
+* Extern Variables
+********************************************************************************/
+extern const sensor_driver_t ultrasound_sensor;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t ultrasound_init(void);
+void ultrasound_deinit(void);
+void ultrasound_trigger(void);
+bool ultrasound_get_result(int *distance);
+
+#endif /* ULTRASOUND_H_ */
+
+/* [] END OF FILE */